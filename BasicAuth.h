@@ -15,22 +15,28 @@
 #include <boost/thread/locks.hpp>
 
 #include <string/StrUtil.h>
-#include <string/UriRegex.h>
 #include <other/Log.h>
 
 #include "CryptoUtil.h"
+#include "RegexSet.h"
+#include "Rcu.h"
 
 namespace tzhttpd {
 
 // 每个Virtual Host持有一个这个认证结构，主要用户Http BasicAuth鉴权
 
-typedef std::vector<std::pair<roo::UriRegex, std::set<std::string>>> BasicAuthContain;
+// 所有规则的uri表达式合并成一个RegexSet，一次匹配得到第一个匹配的规则
+struct BasicAuthContain {
+    RegexSet uri_regexes_;
+    std::vector<std::set<std::string>> auth_sets_;
+};
 
 class BasicAuth {
 
 public:
     BasicAuth() :
-        basic_auths_(new BasicAuthContain()) {
+        basic_auths_() {
+        basic_auths_.store(std::make_shared<BasicAuthContain>());
     }
 
     // strict == true，如果遇到错误的配置将会报错终止解析
@@ -42,6 +48,7 @@ public:
         }
 
         std::shared_ptr<BasicAuthContain> basic_auths_load(new BasicAuthContain());
+        std::vector<std::string> uri_patterns;
 
         const libconfig::Setting& basic_auth = setting["basic_auth"];
         for (int i = 0; i < basic_auth.getLength(); ++i) {
@@ -87,20 +94,22 @@ public:
                                  auth_uri_regex.c_str());
             }
 
-            roo::UriRegex rgx{auth_uri_regex};
-            basic_auths_load->push_back({ rgx, auth_set });
+            uri_patterns.push_back(auth_uri_regex);
+            basic_auths_load->auth_sets_.push_back(auth_set);
             roo::log_info("successfully add %d auth items for uri %s.",
                           static_cast<int>(auth_set.size()), auth_uri_regex.c_str());
         }
 
+        if (!basic_auths_load->uri_regexes_.assign(uri_patterns)) {
+            roo::log_err("compile basic_auth uri regex failed.");
+            return false;
+        }
+
         roo::log_info("total valid auth rules count: %d detected.",
-                      static_cast<int>(basic_auths_load->size()));
+                      static_cast<int>(basic_auths_load->auth_sets_.size()));
 
-        {
-            // update with new settings here
-            std::lock_guard<std::mutex> lock(lock_);
-            basic_auths_.swap(basic_auths_load);
-        }
+        // update with new settings here
+        basic_auths_.store(basic_auths_load);
 
         return true;
     }
@@ -122,41 +131,35 @@ public:
 
         std::string pure_uri = roo::StrUtil::pure_uri_path(uri);
 
-        std::shared_ptr<BasicAuthContain> auth_rule{};
-        {
-            std::lock_guard<std::mutex> lock(lock_);
-            auth_rule = basic_auths_;
-        }
+        RcuReadGuard guard;
+        const BasicAuthContain* auth_rule = basic_auths_.get();
 
         // 在配置文件中按照优先级的顺序向下检索，如果发现请求URI匹配了正则表达式
         // 如果检索到了账号，表示授权成功，返回true
         // 否则拒绝本次请求，不再尝试后续表达式匹配
-        std::vector<std::pair<roo::UriRegex, std::set<std::string>>>::const_iterator it;
-        boost::smatch what;
-        for (it = auth_rule->cbegin(); it != auth_rule->cend(); ++it) {
-            if (boost::regex_match(pure_uri, what, it->first)) {
-
-                // empty auth, we will allow all access
-                if (it->second.empty()) {
-                    return true;
-                }
+        int idx = auth_rule->uri_regexes_.match(pure_uri);
+        if (idx < 0) {
+            return true;
+        }
 
-                // normal rule check
-                if (it->second.find(auth_code) == it->second.end()) {
-                    roo::log_err("reject access to %s with auth_str: %s", uri.c_str(), auth_str.c_str());
-                    return false;
-                } else {
-                    return true;
-                }
-            }
+        const std::set<std::string>& auth_set = auth_rule->auth_sets_[idx];
+
+        // empty auth, we will allow all access
+        if (auth_set.empty()) {
+            return true;
+        }
+
+        // normal rule check
+        if (auth_set.find(auth_code) == auth_set.end()) {
+            roo::log_err("reject access to %s with auth_str: %s", uri.c_str(), auth_str.c_str());
+            return false;
         }
 
         return true;
     }
 
 private:
-    std::mutex lock_;
-    std::shared_ptr<BasicAuthContain> basic_auths_;
+    RcuPtr<BasicAuthContain> basic_auths_;
 };
 
 
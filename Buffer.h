@@ -12,8 +12,100 @@
 #include <xtra_rhel.h>
 #include <cstdint>
 
+#include <deque>
+#include <mutex>
+
+#include <boost/asio/buffer.hpp>
+
 namespace tzhttpd {
 
+// 缓冲区的基本单元，固定大小的内存块
+// rpos_ ~ wpos_ 之间是可读数据，wpos_ ~ kBlockSize 之间是可写空间
+
+struct BufferBlock {
+
+    static const uint32_t kBlockSize = 4096;
+
+    BufferBlock() :
+        rpos_(0),
+        wpos_(0) {
+    }
+
+    uint32_t readable() const { return wpos_ - rpos_; }
+    uint32_t writable() const { return kBlockSize - wpos_; }
+
+    uint32_t rpos_;
+    uint32_t wpos_;
+    char data_[kBlockSize];
+};
+
+
+// 进程内共享的内存块池，避免大包体收发的时候频繁malloc/free
+// 只缓存有限数目的空闲块，超出的部分直接释放
+
+class BufferBlockPool {
+
+    __noncopyable__(BufferBlockPool)
+
+public:
+    static BufferBlockPool& instance() {
+        static BufferBlockPool pool;
+        return pool;
+    }
+
+    BufferBlock* alloc() {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (!free_.empty()) {
+                BufferBlock* block = free_.back();
+                free_.pop_back();
+                block->rpos_ = block->wpos_ = 0;
+                return block;
+            }
+        }
+
+        return new BufferBlock();
+    }
+
+    void free(BufferBlock* block) {
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (free_.size() < kMaxCachedBlocks) {
+                free_.push_back(block);
+                return;
+            }
+        }
+
+        delete block;
+    }
+
+private:
+    BufferBlockPool() :
+        lock_(),
+        free_() {
+    }
+
+    ~BufferBlockPool() {
+        for (size_t i = 0; i < free_.size(); ++i) {
+            delete free_[i];
+        }
+    }
+
+    // 最多缓存 4M 的空闲内存
+    static const size_t kMaxCachedBlocks = 1024;
+
+    std::mutex lock_;
+    std::vector<BufferBlock*> free_;
+};
+
+
+// 由固定大小内存块串接而成的缓冲区
+// 追加数据只会写入尾部块或者挂接新块，消费数据只会推进头部块的读位置或者摘除
+// 头部块，所以追加和消费都是O(1)的，不会像vector那样每次部分消费都搬移剩余的数据
+//
+// 可读区域和可写区域都可以以buffer序列的方式导出，网络层可以直接从缓冲区
+// 中writev发送数据，或者先prepare可写空间直接读入，读完之后再commit
+
 class Buffer {
 
     __noncopyable__(Buffer)
@@ -22,88 +114,194 @@ public:
     // 构造函数
 
     Buffer() :
-        data_({ }) {
+        blocks_(),
+        length_(0) {
     }
 
     explicit Buffer(const std::string& data) :
-        data_(data.begin(), data.end()) {
+        blocks_(),
+        length_(0) {
+        append(data.c_str(), data.size());
+    }
+
+    ~Buffer() {
+        clear();
     }
 
     // used internally, user should prefer Message
     uint32_t append_internal(const std::string& data) {
-        std::copy(data.begin(), data.end(), std::back_inserter(data_));
-        return static_cast<uint32_t>(data_.size());
+        append(data.c_str(), data.size());
+        return length_;
+    }
+
+    void append(const char* data, size_t sz) {
+
+        size_t idx = first_writable();
+        while (sz > 0) {
+
+            if (idx == blocks_.size()) {
+                blocks_.push_back(BufferBlockPool::instance().alloc());
+            }
+
+            BufferBlock* block = blocks_[idx++];
+            uint32_t len = std::min(static_cast<uint32_t>(sz), block->writable());
+            ::memcpy(block->data_ + block->wpos_, data, len);
+            block->wpos_ += len;
+            length_ += len;
+
+            data += len;
+            sz   -= len;
+        }
     }
 
     // 从队列的开头取出若干个(最多sz)字符，返回实际得到的字符数
     bool consume(std::string& store, uint32_t sz) {
 
-        if (sz == 0 || data_.empty()) {
+        if (sz == 0 || length_ == 0) {
             return false;
         }
 
-        // 全部取走
-        if (sz >= data_.size()) {
-            store = std::string(data_.begin(), data_.end());
-            data_.clear();
-            return true;
-        }
+        sz = std::min(sz, length_);
+        store.clear();
+        store.reserve(sz);
 
-        // 部分数据
-        std::vector<char> remain(data_.begin() + sz, data_.end());    // 剩余的数据
-        store = std::string(data_.begin(), data_.begin() + sz);    // 要取的数据
+        while (sz > 0) {
+            BufferBlock* block = blocks_.front();
+            uint32_t len = std::min(sz, block->readable());
+            store.append(block->data_ + block->rpos_, len);
+            sz -= len;
+            drop_front(len);
+        }
 
-        data_.swap(remain);
         return true;
     }
 
     // 调用者需要保证至少能够容纳 sz 数据，拷贝的同时原始数据不会改动
     bool consume(char* store, uint32_t sz) {
 
-        if (!store || sz == 0 || data_.empty()) {
+        if (!store || sz == 0 || length_ == 0) {
             return false;
         }
 
-        ::memcpy(store, data_.data(), sz);
+        sz = std::min(sz, length_);
+        while (sz > 0) {
+            BufferBlock* block = blocks_.front();
+            uint32_t len = std::min(sz, block->readable());
+            ::memcpy(store, block->data_ + block->rpos_, len);
+            store += len;
+            sz    -= len;
+            drop_front(len);
+        }
 
-        // 之前的设计思路:
-        // 先将send_bound_中的数据拷贝到io_block_中进行发送，然后根据传输的结果
-        // 从send_bound_中将这部份数据移走，没有发送成功的数据可以重发
-        // 但是在异步调用中，调用1发起-调用2发起-调用1回调之间会产生竞争条件，导致
-        // 调用2实际发送的是调用1没有移走的数据
-        // 实际上再boost::asio中是通过transfer_exactly发送的，如果返回时没有发送
-        // 这么多数据，那么应该是网络层出现问题了，此时就直接socket错误返回了，不再
-        // 考虑发送量小于请求量这种部分发送的情形了。
-        front_sink(sz);
         return true;
     }
 
     void front_sink(uint32_t sz) {
 
-        if (sz >= data_.size()) {
-            data_.clear();
-            return;
+        sz = std::min(sz, length_);
+        while (sz > 0) {
+            uint32_t len = std::min(sz, blocks_.front()->readable());
+            sz -= len;
+            drop_front(len);
         }
+    }
+
+    // 导出当前所有可读的数据区域，可以直接用于async_write(writev)
+    // 发送完成之后调用front_sink()移走已经发送的数据
+    void data(std::vector<boost::asio::const_buffer>& bufs) const {
 
-        std::vector<char> remain(data_.begin() + sz, data_.end());    // 剩余的数据
-        data_.swap(remain);
+        bufs.clear();
+        for (auto iter = blocks_.cbegin(); iter != blocks_.cend(); ++iter) {
+            if ((*iter)->readable() > 0) {
+                bufs.push_back(boost::asio::buffer((*iter)->data_ + (*iter)->rpos_, (*iter)->readable()));
+            }
+        }
     }
 
-    // 访问成员数据
-    char* get_data() {
-        if (data_.empty()) {
-            return static_cast<char*>(nullptr);
+    // 保证尾部至少有sz字节的可写空间，并导出这些可写区域，可以直接用于读操作
+    // 读操作完成之后需要调用commit()登记实际写入的数据量
+    void prepare(size_t sz, std::vector<boost::asio::mutable_buffer>& bufs) {
+
+        bufs.clear();
+
+        size_t avail = 0;
+        for (size_t idx = first_writable(); idx < blocks_.size(); ++idx) {
+            avail += blocks_[idx]->writable();
+        }
+        while (avail < sz) {
+            blocks_.push_back(BufferBlockPool::instance().alloc());
+            avail += BufferBlock::kBlockSize;
+        }
+
+        for (size_t idx = first_writable(); idx < blocks_.size() && sz > 0; ++idx) {
+            BufferBlock* block = blocks_[idx];
+            size_t len = std::min(sz, static_cast<size_t>(block->writable()));
+            bufs.push_back(boost::asio::buffer(block->data_ + block->wpos_, len));
+            sz -= len;
         }
-        return static_cast<char*>(data_.data());
     }
 
-    uint32_t get_length() {
-        return static_cast<uint32_t>(data_.size());
+    // 登记prepare()导出区域中实际写入的sz字节数据
+    void commit(size_t sz) {
+
+        for (size_t idx = first_writable(); idx < blocks_.size() && sz > 0; ++idx) {
+            BufferBlock* block = blocks_[idx];
+            uint32_t len = std::min(static_cast<uint32_t>(sz), block->writable());
+            block->wpos_ += len;
+            length_ += len;
+            sz -= len;
+        }
+    }
+
+    void clear() {
+        for (auto iter = blocks_.begin(); iter != blocks_.end(); ++iter) {
+            BufferBlockPool::instance().free(*iter);
+        }
+        blocks_.clear();
+        length_ = 0;
+    }
+
+    uint32_t get_length() const {
+        return length_;
     }
 
 private:
 
-    std::vector<char> data_;
+    // 数据总是连续的写入，所以可写位置之后的块都是全空的(prepare预留下来的)
+    // 从尾部向前找到第一个还有可写空间的块，不存在就返回blocks_.size()
+    size_t first_writable() const {
+
+        size_t idx = blocks_.size();
+        while (idx > 0 && blocks_[idx - 1]->wpos_ == 0) {
+            --idx;
+        }
+        if (idx > 0 && blocks_[idx - 1]->writable() > 0) {
+            --idx;
+        }
+
+        return idx;
+    }
+
+    // 移除头部块中的len字节，如果该块已经读空就将其归还给内存池
+    void drop_front(uint32_t len) {
+
+        BufferBlock* block = blocks_.front();
+        block->rpos_ += len;
+        length_ -= len;
+
+        // 最后一个块读空了也保留，继续用于后续的追加
+        if (block->readable() == 0) {
+            if (blocks_.size() > 1 || block->writable() == 0) {
+                blocks_.pop_front();
+                BufferBlockPool::instance().free(block);
+            } else {
+                block->rpos_ = block->wpos_ = 0;
+            }
+        }
+    }
+
+    std::deque<BufferBlock*> blocks_;
+    uint32_t length_;
 };
 
 } // end tzhttpd
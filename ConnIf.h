@@ -8,7 +8,11 @@
 #ifndef __TZHTTPD_CONN_IF_H__
 #define __TZHTTPD_CONN_IF_H__
 
+#include <unistd.h>
+
+#include <map>
 #include <mutex>
+#include <vector>
 #include "Buffer.h"
 
 #include <boost/system/error_code.hpp>
@@ -137,20 +141,142 @@ protected:
     std::shared_ptr<boost::asio::ip::tcp::socket> socket_;
 };
 
-// 固定的发送、接收缓冲区大小
-const static uint32_t kFixedIoBufferSize = 2048;
+// sendfile发送文件的时候，单次调用的最大长度，以及连续发送多少之后让出线程
+const static size_t kSendfileChunkSize = 1024 * 1024;
+const static size_t kSendfileBurstSize = 4 * 1024 * 1024;
+
+// 单次读取请求体的最大长度，限制单个读操作占用的缓冲区
+const static uint32_t kMaxIoReadSize = 64 * 1024;
+
+// 请求头部接收缓冲区的初始大小和最大大小，超过最大大小的头部将被拒绝
+const static uint32_t kHeadBufferInitSize = 4096;
+const static uint32_t kMaxHeaderSize = 64 * 1024;
 
 struct IOBound {
     IOBound() :
-        io_block_({ }),
         length_hint_({ 0 }),
         buffer_() {
     }
 
-    char io_block_[kFixedIoBufferSize];     // 读写操作的固定缓存
     size_t length_hint_;
-    Buffer buffer_;                         // 已经传输字节
+    Buffer buffer_;                         // 已经传输字节，读操作直接读入其中
+};
+
+// 流水线上允许同时在处理中的最大请求数目，超过之后暂停读取新的请求
+const static uint32_t kMaxPipelineDepth = 16;
+
+// 作为响应体的文件，析构的时候关闭
+struct FileBody {
+    FileBody() :
+        fd_(-1),
+        size_(0),
+        mtime_(0),
+        ino_(0) {
+    }
+
+    ~FileBody() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    int fd_;
+    off_t size_;
+    time_t mtime_;
+    ino_t ino_;
 };
+
+// 发送的分段，内存数据、共享的只读内存数据或者文件中的一段
+// 文件分段通过sendfile(2)由内核直接从page cache发送，不经过用户态拷贝
+// 共享分段引用静态缓存中的内容，多个连接同时发送也不需要拷贝
+// 共享分段和文件分段发送[offset_, offset_ + length_)，提交发送时length_为0表示全部内容
+struct SendSegment {
+    SendSegment() :
+        data_(),
+        shared_(),
+        file_(),
+        offset_(0),
+        length_(0) {
+    }
+
+    bool empty() const {
+        return data_.empty() && !shared_ && !file_;
+    }
+
+    // 实际发送的字节数，length_为0的时候补全为全部内容
+    size_t prepare() {
+        if (shared_ || file_) {
+            if (length_ == 0) {
+                offset_ = 0;
+                length_ = shared_ ? shared_->size() : static_cast<size_t>(file_->size_);
+            }
+            return length_;
+        }
+        return data_.size();
+    }
+
+    void swap(SendSegment& other) {
+        data_.swap(other.data_);
+        shared_.swap(other.shared_);
+        file_.swap(other.file_);
+        std::swap(offset_, other.offset_);
+        std::swap(length_, other.length_);
+    }
+
+    std::string data_;
+    std::shared_ptr<const std::string> shared_;     // 不为空的时候是共享分段，data_不使用
+    std::shared_ptr<FileBody> file_;                // 不为空的时候是文件分段，data_不使用
+    off_t offset_;
+    size_t length_;
+};
+
+// 已经生成但是还不能发送的响应(前面的请求还没有处理完成)
+struct PendingResponse {
+    PendingResponse() :
+        segments_() {
+    }
+
+    std::vector<SendSegment> segments_;
+};
+
+// 发送使用的分段队列
+// 状态行+头部和正文作为独立的分段持有(通过swap取得，不拷贝)，发送的时候组装成
+// const_buffer序列交给一次async_write，底层走writev，不再拷贝后分块发送
+//
+// HTTP/1.1流水线: 连接上的每个请求按照读取的顺序分配一个序号，请求被并发的派发
+// 处理，响应完成的时候只有轮到其序号的才会进入pending_，提前完成的暂存在
+// completed_中，等前面的响应都进入pending_之后再按序移入，保证响应的顺序和请求一致。
+// 写操作进行中积累的多个响应会在下一次async_write中合并发送
+struct SendBound {
+
+    static const uint64_t kInvalidSeq = static_cast<uint64_t>(-1);
+
+    SendBound() :
+        lock_(),
+        writing_(false),
+        pending_(),
+        inflight_(),
+        next_seq_(0),
+        send_seq_(0),
+        close_seq_(kInvalidSeq),
+        closing_(false),
+        read_paused_(false),
+        completed_() {
+    }
+
+    std::mutex lock_;
+    bool writing_;                          // 当前是否有async_write在进行中
+    std::vector<SendSegment> pending_;      // 等待发送的分段
+    std::vector<SendSegment> inflight_;     // 已经提交发送的分段，回调之前必须保持有效
+
+    uint64_t next_seq_;                     // 分配给下一个请求的序号
+    uint64_t send_seq_;                     // 下一个可以进入pending_的响应序号
+    uint64_t close_seq_;                    // 不保持连接的请求序号，之后不再读取新请求
+    bool closing_;                          // close_seq_的响应已经进入pending_，发送完后关闭连接
+    bool read_paused_;                      // 在处理中的请求太多，暂停了读取
+    std::map<uint64_t, PendingResponse> completed_;
+};
+
 } // end namespace tzhttpd
 
 #endif //__TZHTTPD_CONN_IF_H__
@@ -69,18 +69,66 @@ bool Dispatcher::init() {
     return true;
 }
 
-void Dispatcher::handle_http_request(std::shared_ptr<HttpReqInstance> http_req_instance) {
+// 转成小写，去掉结尾表示根域名的'.'
+std::string Dispatcher::normalize_host(const std::string& hostname) {
 
-    std::shared_ptr<ServiceIf> service;
-    auto it = services_.find(http_req_instance->hostname_);
-    if (it != services_.end()) {
-        service = it->second;
+    std::string host(hostname);
+    while (!host.empty() && host[host.size() - 1] == '.') {
+        host.erase(host.size() - 1);
     }
 
-    if (!service) {
-        roo::log_info("find http service_impl (virtualhost) for %s failed, using default.",
-                      http_req_instance->hostname_.c_str());
-        service = default_service_;
+    for (size_t i = 0; i < host.size(); ++i) {
+        if (host[i] >= 'A' && host[i] <= 'Z') {
+            host[i] = static_cast<char>(host[i] - 'A' + 'a');
+        }
+    }
+
+    return host;
+}
+
+// 精确匹配优先，然后从最长的后缀开始查找通配的主机
+Executor* Dispatcher::resolve_virtual_host(const std::string& hostname) const {
+
+    std::string host = normalize_host(hostname);
+
+    auto it = host_index_.find(host);
+    if (it != host_index_.end()) {
+        return it->second;
+    }
+
+    if (!wildcard_index_.empty()) {
+        for (size_t pos = host.find('.'); pos != std::string::npos; pos = host.find('.', pos + 1)) {
+            auto wild = wildcard_index_.find(host.substr(pos));
+            if (wild != wildcard_index_.end()) {
+                return wild->second;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void Dispatcher::handle_http_request(std::shared_ptr<HttpReqInstance> http_req_instance, VhostMemo* memo) {
+
+    const std::string& hostname = http_req_instance->hostname_;
+
+    Executor* service = NULL;
+    if (memo && memo->service_ && memo->host_ == hostname) {
+        service = memo->service_;
+    } else {
+
+        service = resolve_virtual_host(hostname);
+        if (!service) {
+            roo::log_info("find http service_impl (virtualhost) for %s failed, using default.",
+                          hostname.c_str());
+            service = default_service_.get();
+        }
+
+        // 默认主机的结果也记录下来，同一个连接上不会重复查找和打印日志
+        if (memo) {
+            memo->host_ = hostname;
+            memo->service_ = service;
+        }
     }
 
     service->handle_http_request(http_req_instance);
@@ -94,7 +142,12 @@ int Dispatcher::add_virtual_host(const std::string& hostname) {
         return -1;
     }
 
-    if (services_.find(hostname) != services_.end()) {
+    std::string host = normalize_host(hostname);
+    bool wildcard = host.size() > 2 && host.compare(0, 2, "*.") == 0;
+    std::unordered_map<std::string, Executor*>& index = wildcard ? wildcard_index_ : host_index_;
+    std::string key = wildcard ? host.substr(1) : host;
+
+    if (services_.find(hostname) != services_.end() || index.find(key) != index.end()) {
         roo::log_err("already found host %s added, please check.", hostname.c_str());
         return -1;
     }
@@ -113,72 +166,77 @@ int Dispatcher::add_virtual_host(const std::string& hostname) {
     }
 
     services_[hostname] = default_http;
+    index[key] = default_http.get();
     roo::log_info("successful add service %s ", default_http->instance_name().c_str());
 
     return 0;
 }
 
 
-int Dispatcher::add_http_get_handler(const std::string& hostname, const std::string& uri_regex,
-                                     const HttpGetHandler& handler, bool built_in) {
-
-    std::shared_ptr<Executor> service;
+std::shared_ptr<Executor> Dispatcher::find_service(const std::string& hostname) const {
 
     if (hostname.empty() || hostname == "[default]") {
-        service = default_service_;
-    } else {
-        auto it = services_.find(hostname);
-        if (it != services_.end()) {
-            service = it->second;
-        } else {
-            roo::log_err("hostname %s not found.",  hostname.c_str());
-            return -1;
-        }
+        return default_service_;
     }
 
-    SAFE_ASSERT(service);
+    auto it = services_.find(hostname);
+    if (it == services_.end()) {
+        roo::log_err("hostname %s not found.",  hostname.c_str());
+        return std::shared_ptr<Executor>();
+    }
+
+    return it->second;
+}
+
+int Dispatcher::add_http_get_handler(const std::string& hostname, const std::string& uri_regex,
+                                     const HttpGetHandler& handler, bool built_in, bool run_inline) {
+
+    std::shared_ptr<Executor> service = find_service(hostname);
+    if (!service) {
+        return -1;
+    }
 
-    return service->add_get_handler(uri_regex, handler, built_in);
+    return service->add_get_handler(uri_regex, handler, built_in, run_inline);
 }
 
 int Dispatcher::add_http_post_handler(const std::string& hostname, const std::string& uri_regex,
-                                      const HttpPostHandler& handler, bool built_in) {
+                                      const HttpPostHandler& handler, bool built_in, bool run_inline) {
 
-    std::shared_ptr<Executor> service;
+    std::shared_ptr<Executor> service = find_service(hostname);
+    if (!service) {
+        return -1;
+    }
+    return service->add_post_handler(uri_regex, handler, built_in, run_inline);
+}
 
-    if (hostname.empty() || hostname == "[default]") {
-        service = default_service_;
-    } else {
-        auto it = services_.find(hostname);
-        if (it != services_.end()) {
-            service = it->second;
-        } else {
-            roo::log_err("hostname %s not found.",  hostname.c_str());
-            return -1;
-        }
+int Dispatcher::add_http_async_get_handler(const std::string& hostname, const std::string& uri_regex,
+                                           const HttpAsyncGetHandler& handler, bool built_in, bool run_inline) {
+
+    std::shared_ptr<Executor> service = find_service(hostname);
+    if (!service) {
+        return -1;
     }
 
-    SAFE_ASSERT(service);
-    return service->add_post_handler(uri_regex, handler, built_in);
+    return service->add_async_get_handler(uri_regex, handler, built_in, run_inline);
 }
 
-int Dispatcher::drop_http_handler(const std::string& hostname, const std::string& uri_regex, enum HTTP_METHOD method) {
-
-    std::shared_ptr<Executor> service;
+int Dispatcher::add_http_async_post_handler(const std::string& hostname, const std::string& uri_regex,
+                                            const HttpAsyncPostHandler& handler, bool built_in, bool run_inline) {
 
-    if (hostname.empty() || hostname == "[default]") {
-        service = default_service_;
-    } else {
-        auto it = services_.find(hostname);
-        if (it != services_.end()) {
-            service = it->second;
-        } else {
-            roo::log_err("hostname %s not found.",  hostname.c_str());
-            return -1;
-        }
+    std::shared_ptr<Executor> service = find_service(hostname);
+    if (!service) {
+        return -1;
     }
 
-    SAFE_ASSERT(service);
+    return service->add_async_post_handler(uri_regex, handler, built_in, run_inline);
+}
+
+int Dispatcher::drop_http_handler(const std::string& hostname, const std::string& uri_regex, enum HTTP_METHOD method) {
+
+    std::shared_ptr<Executor> service = find_service(hostname);
+    if (!service) {
+        return -1;
+    }
     return service->drop_handler(uri_regex, method);
 }
 
@@ -14,6 +14,7 @@
 
 #include <map>
 #include <mutex>
+#include <unordered_map>
 
 #include "HttpHandler.h"
 
@@ -31,16 +32,36 @@ public:
 
     bool init();
 
-    void handle_http_request(std::shared_ptr<HttpReqInstance> http_req_instance);
+    // 连接上最近一次解析的虚拟主机，同一个连接上的请求通常都是同一个Host
+    // 只在连接自己的处理流程中访问，不需要加锁
+    struct VhostMemo {
+        VhostMemo() :
+            host_(),
+            service_(NULL) {
+        }
 
-    // 注册虚拟主机
+        std::string host_;
+        Executor* service_;     // 虚拟主机不会被删除，和Dispatcher的生命周期相同
+    };
+
+    void handle_http_request(std::shared_ptr<HttpReqInstance> http_req_instance, VhostMemo* memo = NULL);
+
+    // 注册虚拟主机，支持*.example.com形式的后缀通配
+    // 主机名不区分大小写
     int add_virtual_host(const std::string& hostname);
 
     // 外部注册http handler的接口
+    // run_inline的handler在IO线程中直接执行，必须是不会阻塞的快速处理
     int add_http_get_handler(const std::string& hostname, const std::string& uri_regex,
-                             const HttpGetHandler& handler, bool built_in);
+                             const HttpGetHandler& handler, bool built_in, bool run_inline = false);
     int add_http_post_handler(const std::string& hostname, const std::string& uri_regex,
-                              const HttpPostHandler& handler, bool built_in);
+                              const HttpPostHandler& handler, bool built_in, bool run_inline = false);
+
+    // 异步handler通过HttpResponder在之后完成响应
+    int add_http_async_get_handler(const std::string& hostname, const std::string& uri_regex,
+                                   const HttpAsyncGetHandler& handler, bool built_in, bool run_inline = false);
+    int add_http_async_post_handler(const std::string& hostname, const std::string& uri_regex,
+                                    const HttpAsyncPostHandler& handler, bool built_in, bool run_inline = false);
 
     int drop_http_handler(const std::string& hostname, const std::string& uri_regex, enum HTTP_METHOD method);
 
@@ -50,7 +71,9 @@ private:
 
     Dispatcher() :
         initialized_(false),
-        services_({ }) {
+        services_({ }),
+        host_index_(),
+        wildcard_index_() {
     }
 
     ~Dispatcher() = default;
@@ -61,6 +84,16 @@ private:
     // 这边就不使用锁结构进行保护了，防止影响性能
     std::map<std::string, std::shared_ptr<Executor>> services_;
 
+    // 请求路由使用的索引，键是小写的主机名，通配的主机保存去掉'*'之后的后缀(.example.com)
+    std::unordered_map<std::string, Executor*> host_index_;
+    std::unordered_map<std::string, Executor*> wildcard_index_;
+
+    // 注册handler时根据配置的主机名查找，空或者[default]表示默认主机
+    std::shared_ptr<Executor> find_service(const std::string& hostname) const;
+
+    static std::string normalize_host(const std::string& hostname);
+    Executor* resolve_virtual_host(const std::string& hostname) const;
+
     // 默认的http虚拟主机
     std::shared_ptr<Executor> default_service_;
 };
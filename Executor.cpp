@@ -44,6 +44,25 @@ bool Executor::init() {
         return false;
     }
 
+    if (conf_.exec_queue_size_ < 0) {
+        roo::log_err("invalid exec_queue_size setting: %d", conf_.exec_queue_size_);
+        return false;
+    }
+
+    // 本地队列的总容量和共享队列一样
+    size_t queue_size = conf_.exec_queue_size_ > 0 ? static_cast<size_t>(conf_.exec_queue_size_) : kRequestQueueSize;
+    if (conf_.exec_work_stealing_) {
+        size_t slot_count = static_cast<size_t>(conf_.exec_thread_number_hard_);
+        stealing_queue_.reset(new WorkStealingQueue<std::shared_ptr<HttpReqInstance>>(
+                                  slot_count, (queue_size + slot_count - 1) / slot_count));
+        roo::log_warning("executor for %s in work stealing mode, %d local queues.",
+                         instance_name().c_str(), static_cast<int>(slot_count));
+    } else {
+        http_req_queue_.reset(new MpmcQueue<std::shared_ptr<HttpReqInstance>>(queue_size));
+    }
+
+    drop_oldest_ = (conf_.exec_queue_reject_policy_ == QueueRejectPolicy::kDropOldest);
+
     if (!executor_threads_.init_threads(
             std::bind(&Executor::executor_service_run, this, std::placeholders::_1), conf_.exec_thread_number_)) {
         roo::log_err("executor_service_run init task for %s failed!", instance_name().c_str());
@@ -74,10 +93,44 @@ bool Executor::init() {
 }
 
 
+void Executor::handle_http_request(std::shared_ptr<HttpReqInstance> http_req_instance) {
+
+    // 内联的handler在当前IO线程中直接处理完成，省去队列交接和线程切换
+    if (service_impl_->handle_http_request_inline(http_req_instance)) {
+        return;
+    }
+
+    if (queue_push(http_req_instance)) {
+        return;
+    }
+
+    // 过载的时候尽快拒绝，不让排队时间无限增长
+    if (drop_oldest_) {
+        std::shared_ptr<HttpReqInstance> oldest;
+        if (queue_try_pop(oldest)) {
+            rejected_count_++;
+            oldest->http_std_response(http_proto::StatusCode::server_error_service_unavailable);
+        }
+
+        if (queue_push(http_req_instance)) {
+            return;
+        }
+    }
+
+    rejected_count_++;
+    roo::log_err("request queue for %s is full (%lu), reject %s.",
+                 instance_name().c_str(), static_cast<unsigned long>(queue_capacity()),
+                 http_req_instance->uri_.c_str());
+    http_req_instance->http_std_response(http_proto::StatusCode::server_error_service_unavailable);
+}
+
 void Executor::executor_service_run(roo::ThreadObjPtr ptr) {
 
     roo::log_warning("executor_service thread %#lx about to loop ...", (long)pthread_self());
 
+    // work stealing模式下运行期间占用的本地队列
+    size_t slot = WorkStealingQueue<std::shared_ptr<HttpReqInstance>>::kNoSlot;
+
     while (true) {
 
         std::shared_ptr<HttpReqInstance> http_req_instance{};
@@ -89,11 +142,31 @@ void Executor::executor_service_run(roo::ThreadObjPtr ptr) {
 
         // 线程启动
         if (unlikely(ptr->status_ == roo::ThreadStatus::kSuspend)) {
+            if (stealing_queue_) {
+                stealing_queue_->release_slot(slot);
+                slot = WorkStealingQueue<std::shared_ptr<HttpReqInstance>>::kNoSlot;
+            }
             ::usleep(1 * 1000 * 1000);
             continue;
         }
 
-        if (!http_req_queue_.POP(http_req_instance, 1000 /*1s*/) || !http_req_instance) {
+        bool popped = false;
+        if (stealing_queue_) {
+            if (slot == WorkStealingQueue<std::shared_ptr<HttpReqInstance>>::kNoSlot) {
+                slot = stealing_queue_->acquire_slot();
+            }
+            popped = stealing_queue_->POP(slot, http_req_instance, 1000 /*1s*/);
+        } else {
+            popped = http_req_queue_->POP(http_req_instance, 1000 /*1s*/);
+        }
+
+        if (!popped || !http_req_instance) {
+            continue;
+        }
+
+        // 连接已经断开，响应也发送不出去了，不再执行
+        if (http_req_instance->full_socket_.expired()) {
+            expired_count_++;
             continue;
         }
 
@@ -101,6 +174,10 @@ void Executor::executor_service_run(roo::ThreadObjPtr ptr) {
         service_impl_->handle_http_request(http_req_instance);
     }
 
+    if (stealing_queue_) {
+        stealing_queue_->release_slot(slot);
+    }
+
     ptr->status_ = roo::ThreadStatus::kDead;
     roo::log_warning("io_service thread %#lx is about to terminate ... ", (long)pthread_self());
 
@@ -126,7 +203,7 @@ void Executor::executor_threads_adjust(const boost::system::error_code& ec) {
     // 进行检查，看是否需要伸缩线程池
     int expect_thread = conf.exec_thread_number_;
 
-    int queueSize = http_req_queue_.SIZE();
+    int queueSize = static_cast<int>(queue_size());
     if (queueSize > conf.exec_thread_step_queue_size_) {
         expect_thread += queueSize / conf.exec_thread_step_queue_size_;
     }
@@ -156,11 +233,16 @@ int Executor::module_status(std::string& module, std::string& key, std::string&
     ss << "\t" << "exec_thread_number: " << conf_.exec_thread_number_ << std::endl;
     ss << "\t" << "exec_thread_number_hard(maxium): " << conf_.exec_thread_number_hard_ << std::endl;
     ss << "\t" << "exec_thread_step_queue_size: " << conf_.exec_thread_step_queue_size_ << std::endl;
+    ss << "\t" << "exec_queue_timeout_ms: " << conf_.exec_queue_timeout_ms_ << std::endl;
+    ss << "\t" << "exec_queue_reject_policy: " << (drop_oldest_ ? "drop_oldest" : "reject_new") << std::endl;
 
     ss << "\t" << std::endl;
 
     ss << "\t" << "current_thread_number: " << executor_threads_.get_pool_size() << std::endl;
-    ss << "\t" << "current_queue_size: " << http_req_queue_.SIZE() << std::endl;
+    ss << "\t" << "work_stealing: " << (stealing_queue_ ? "true" : "false") << std::endl;
+    ss << "\t" << "current_queue_size: " << queue_size() << "/" << queue_capacity() << std::endl;
+    ss << "\t" << "rejected_count: " << rejected_count_ << std::endl;
+    ss << "\t" << "expired_count: " << expired_count_ << std::endl;
 
     std::string nullModule;
     std::string subKey;
@@ -186,6 +268,7 @@ int Executor::module_runtime(const libconfig::Config& conf) {
 
             std::lock_guard<std::mutex> lock(conf_lock_);
             conf_ = http_executor->get_executor_conf();
+            drop_oldest_ = (conf_.exec_queue_reject_policy_ == QueueRejectPolicy::kDropOldest);
         }
     }
     return ret;
@@ -11,10 +11,11 @@
 #include <xtra_rhel.h>
 
 #include <other/Log.h>
-#include <container/EQueue.h>
 #include <concurrency/ThreadPool.h>
 
 #include "ServiceIf.h"
+#include "MpmcQueue.h"
+#include "WorkStealingQueue.h"
 
 #include "Global.h"
 
@@ -23,10 +24,21 @@ namespace tzhttpd {
 // 简短的结构体，用来从HttpExecutor传递配置信息
 // 因为主机相关的信息是在HttpExecutor中解析的
 
+// 队列满了之后的处理方式
+enum class QueueRejectPolicy : uint8_t {
+    kRejectNew   = 1,   // 拒绝新到的请求
+    kDropOldest  = 2,   // 丢弃排队最久的请求，它的客户端最可能已经放弃了
+};
+
 struct ExecutorConf {
     int exec_thread_number_;
     int exec_thread_number_hard_;  // 允许最大的线程数目
     int exec_thread_step_queue_size_;
+    bool exec_work_stealing_;      // 每个线程本地队列+窃取，只在启动的时候生效
+
+    int exec_queue_size_;          // 队列容量，只在启动的时候生效，0使用默认值
+    int exec_queue_timeout_ms_;    // 排队时间预算，超过之后直接返回503，0表示不限制
+    QueueRejectPolicy exec_queue_reject_policy_;
 };
 
 class Executor : public ServiceIf,
@@ -37,24 +49,42 @@ public:
     explicit Executor(std::shared_ptr<ServiceIf> service_impl) :
         service_impl_(service_impl),
         http_req_queue_(),
+        stealing_queue_(),
+        drop_oldest_(false),
+        rejected_count_(0),
+        expired_count_(0),
         conf_lock_(),
         conf_({ }) {
     }
 
-    void handle_http_request(std::shared_ptr<HttpReqInstance> http_req_instance)override {
-        http_req_queue_.PUSH(http_req_instance);
+    void handle_http_request(std::shared_ptr<HttpReqInstance> http_req_instance)override;
+
+    bool handle_http_request_inline(std::shared_ptr<HttpReqInstance> http_req_instance)override {
+        return service_impl_->handle_http_request_inline(http_req_instance);
     }
 
     std::string instance_name()override {
         return service_impl_->instance_name();
     }
 
-    int add_get_handler(const std::string& uri_regex, const HttpGetHandler& handler, bool built_in)override {
-        return service_impl_->add_get_handler(uri_regex, handler, built_in);
+    int add_get_handler(const std::string& uri_regex, const HttpGetHandler& handler,
+                        bool built_in, bool run_inline)override {
+        return service_impl_->add_get_handler(uri_regex, handler, built_in, run_inline);
+    }
+
+    int add_post_handler(const std::string& uri_regex, const HttpPostHandler& handler,
+                         bool built_in, bool run_inline)override {
+        return service_impl_->add_post_handler(uri_regex, handler, built_in, run_inline);
+    }
+
+    int add_async_get_handler(const std::string& uri_regex, const HttpAsyncGetHandler& handler,
+                              bool built_in, bool run_inline)override {
+        return service_impl_->add_async_get_handler(uri_regex, handler, built_in, run_inline);
     }
 
-    int add_post_handler(const std::string& uri_regex, const HttpPostHandler& handler, bool built_in)override {
-        return service_impl_->add_post_handler(uri_regex, handler, built_in);
+    int add_async_post_handler(const std::string& uri_regex, const HttpAsyncPostHandler& handler,
+                               bool built_in, bool run_inline)override {
+        return service_impl_->add_async_post_handler(uri_regex, handler, built_in, run_inline);
     }
 
     bool exist_handler(const std::string& uri_regex, enum HTTP_METHOD method)override {
@@ -74,7 +104,37 @@ public:
 private:
     // point to HttpExecutor, forward some request
     std::shared_ptr<ServiceIf> service_impl_;
-    roo::EQueue<std::shared_ptr<HttpReqInstance>> http_req_queue_;
+
+    // 等待执行的请求，队列满了按照拒绝策略返回503
+    // 开启work stealing的时候使用每个线程的本地队列，否则使用共享的队列，只会创建其中一个
+    static const size_t kRequestQueueSize = 16 * 1024;
+    std::unique_ptr<MpmcQueue<std::shared_ptr<HttpReqInstance>>> http_req_queue_;
+    std::unique_ptr<WorkStealingQueue<std::shared_ptr<HttpReqInstance>>> stealing_queue_;
+
+    bool queue_push(const std::shared_ptr<HttpReqInstance>& http_req_instance) {
+        return stealing_queue_ ? stealing_queue_->PUSH(http_req_instance) : http_req_queue_->PUSH(http_req_instance);
+    }
+
+    bool queue_try_pop(std::shared_ptr<HttpReqInstance>& http_req_instance) {
+        return stealing_queue_ ?
+            stealing_queue_->try_pop(WorkStealingQueue<std::shared_ptr<HttpReqInstance>>::kNoSlot, http_req_instance) :
+            http_req_queue_->try_pop(http_req_instance);
+    }
+
+    size_t queue_size() const {
+        return stealing_queue_ ? stealing_queue_->SIZE() : http_req_queue_->SIZE();
+    }
+
+    size_t queue_capacity() const {
+        return stealing_queue_ ? stealing_queue_->capacity() : http_req_queue_->capacity();
+    }
+
+    // 拒绝策略可以动态更新，只在队列满的时候读取
+    std::atomic<bool> drop_oldest_;
+
+    // 过载保护的统计
+    std::atomic<uint64_t> rejected_count_;  // 队列满了被拒绝、丢弃的
+    std::atomic<uint64_t> expired_count_;   // 执行之前连接就已经断开的
 
 
 private:
@@ -0,0 +1,150 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+#include "FileMetaCache.h"
+
+namespace tzhttpd {
+
+FileMetaCache::FileMetaCache(size_t capacity, uint32_t ttl_ms, size_t max_fds) :
+    capacity_(capacity),
+    ttl_ms_(ttl_ms),
+    max_fds_(max_fds > 0 ? max_fds : default_max_fds(capacity)),
+    cached_fds_(0) {
+}
+
+int64_t FileMetaCache::now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 只使用进程fd上限的四分之一，剩下的留给连接、日志以及正在发送的文件
+size_t FileMetaCache::default_max_fds(size_t capacity) {
+
+    size_t limit = 1024;
+    struct rlimit rlim;
+    if (::getrlimit(RLIMIT_NOFILE, &rlim) == 0) {
+        limit = rlim.rlim_cur == RLIM_INFINITY ? capacity * 4 : static_cast<size_t>(rlim.rlim_cur);
+    }
+
+    return std::max<size_t>(std::min(capacity, limit / 4), 1);
+}
+
+FileMetaCache::ItemMap::iterator FileMetaCache::erase_item(Shard& shard, ItemMap::iterator iter) {
+
+    if (iter->second->file_) {
+        cached_fds_--;
+    }
+    return shard.items_.erase(iter);
+}
+
+std::shared_ptr<const FileMeta> FileMetaCache::find(const std::string& key) {
+
+    Shard& shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.lock_);
+
+    auto iter = shard.items_.find(key);
+    if (iter == shard.items_.end()) {
+        return std::shared_ptr<const FileMeta>();
+    }
+
+    if (iter->second->expire_ <= now_ms()) {
+        erase_item(shard, iter);
+        return std::shared_ptr<const FileMeta>();
+    }
+
+    return iter->second;
+}
+
+void FileMetaCache::insert(const std::string& key, std::shared_ptr<FileMeta> meta) {
+
+    if (!meta || meta->status_ == FileMetaStatus::kError) {
+        return;
+    }
+
+    int64_t now = now_ms();
+    meta->expire_ = now + ttl_ms_;
+
+    Shard& shard = shard_of(key);
+    size_t shard_capacity = std::max<size_t>(capacity_ / kShardCount, 1);
+
+    std::lock_guard<std::mutex> lock(shard.lock_);
+
+    auto exist = shard.items_.find(key);
+    if (exist != shard.items_.end()) {
+        erase_item(shard, exist);
+    }
+
+    // 满了先清理过期的条目，还是满的就随便淘汰一个，TTL很短所以不需要精确的LRU
+    if (shard.items_.size() >= shard_capacity) {
+        for (auto iter = shard.items_.begin(); iter != shard.items_.end();) {
+            if (iter->second->expire_ <= now) {
+                iter = erase_item(shard, iter);
+            } else {
+                ++iter;
+            }
+        }
+
+        if (shard.items_.size() >= shard_capacity) {
+            erase_item(shard, shard.items_.begin());
+        }
+    }
+
+    // 打开的文件太多了，只缓存路径解析的结果，本次请求仍然使用已经打开的文件
+    std::shared_ptr<const FileMeta> item = meta;
+    if (meta->file_) {
+        if (cached_fds_.fetch_add(1) >= max_fds_) {
+            cached_fds_--;
+            std::shared_ptr<FileMeta> path_only = std::make_shared<FileMeta>(*meta);
+            path_only->file_.reset();
+            item = path_only;
+        }
+    }
+
+    shard.items_[key] = item;
+}
+
+size_t FileMetaCache::sweep() {
+
+    int64_t now = now_ms();
+    size_t count = 0;
+
+    for (size_t i = 0; i < kShardCount; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].lock_);
+        for (auto iter = shards_[i].items_.begin(); iter != shards_[i].items_.end();) {
+            if (iter->second->expire_ <= now) {
+                iter = erase_item(shards_[i], iter);
+                ++count;
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    return count;
+}
+
+std::string FileMetaCache::status() {
+
+    size_t count = 0;
+    for (size_t i = 0; i < kShardCount; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].lock_);
+        count += shards_[i].items_.size();
+    }
+
+    std::stringstream ss;
+    ss << "items: " << count << "/" << capacity_ << ", ttl: " << ttl_ms_ << "ms"
+       << ", fds: " << cached_fds_.load() << "/" << max_fds_;
+    return ss.str();
+}
+
+} // end namespace tzhttpd
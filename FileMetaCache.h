@@ -0,0 +1,125 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __TZHTTPD_FILE_META_CACHE_H__
+#define __TZHTTPD_FILE_META_CACHE_H__
+
+#include <xtra_rhel.h>
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+namespace tzhttpd {
+
+struct FileBody;
+
+// 请求路径解析的结果
+enum class FileMetaStatus : uint8_t {
+    kFound      = 1,
+    kNotFound   = 2,    // 不存在、没有权限、目录下没有索引文件，也会被缓存
+    kError      = 3,    // 其他错误，不缓存
+};
+
+struct FileMeta {
+
+    FileMeta() :
+        status_(FileMetaStatus::kError),
+        file_path_(),
+        index_dir_(),
+        suffix_(),
+        file_(),
+        expire_(0) {
+    }
+
+    enum FileMetaStatus status_;
+    std::string file_path_;     // 最终的普通文件(可能是目录下的索引文件)
+    std::string index_dir_;     // 通过docu_index找到的时候，请求的目录
+    std::string suffix_;        // 小写的扩展名
+
+    // 已经打开的文件，所有的响应共享使用
+    // sendfile和pread都是指定偏移量的，不依赖文件的当前位置，所以可以并发使用
+    // 缓存中打开的文件数目达到上限之后只缓存路径解析的结果，此时为空，由请求自己打开
+    std::shared_ptr<FileBody> file_;
+
+    int64_t expire_;            // 单调时钟的毫秒数
+};
+
+
+// 虚拟主机下请求路径 -> 文件元数据(打开的fd、stat结果、索引文件或者不存在)的缓存
+// 没有内容缓存的时候，命中的请求也不需要access/stat/open等系统调用
+//
+// 按照键的哈希分片加锁，减少执行线程之间的竞争；条目只在很短的TTL内有效，
+// 所以文件的变化最多延迟TTL之后可见，不需要额外的失效机制
+//
+// 缓存的条目持有打开的fd，过期的条目需要调用sweep()定期清理，否则访问过一次的
+// 文件会一直占用fd(删除的文件也不会释放磁盘空间)；持有的fd总数限制在max_fds以内
+class FileMetaCache {
+
+    __noncopyable__(FileMetaCache)
+
+public:
+    // max_fds为0的时候根据RLIMIT_NOFILE自动选择
+    FileMetaCache(size_t capacity, uint32_t ttl_ms, size_t max_fds = 0);
+
+    std::shared_ptr<const FileMeta> find(const std::string& key);
+    void insert(const std::string& key, std::shared_ptr<FileMeta> meta);
+
+    // 清理所有过期的条目，返回清理的数目
+    size_t sweep();
+
+    size_t capacity() const {
+        return capacity_;
+    }
+    uint32_t ttl_ms() const {
+        return ttl_ms_;
+    }
+    size_t max_fds() const {
+        return max_fds_;
+    }
+
+    std::string status();
+
+private:
+
+    static const size_t kShardCount = 16;   // 必须是2的幂
+
+    typedef std::unordered_map<std::string, std::shared_ptr<const FileMeta>> ItemMap;
+
+    struct Shard {
+        Shard() : lock_(), items_() {
+        }
+
+        std::mutex lock_;
+        ItemMap items_;
+    };
+
+    static int64_t now_ms();
+    static size_t default_max_fds(size_t capacity);
+
+    // 删除条目，同时维护打开的文件计数，调用者持有分片的锁
+    ItemMap::iterator erase_item(Shard& shard, ItemMap::iterator iter);
+
+    Shard& shard_of(const std::string& key) {
+        return shards_[std::hash<std::string>()(key) & (kShardCount - 1)];
+    }
+
+    const size_t capacity_;
+    const uint32_t ttl_ms_;
+    const size_t max_fds_;
+
+    std::atomic<size_t> cached_fds_;
+
+    Shard shards_[kShardCount];
+};
+
+} // end namespace tzhttpd
+
+#endif // __TZHTTPD_FILE_META_CACHE_H__
@@ -51,6 +51,10 @@ class HttpConf {
     int32_t        backlog_size_;
     int32_t        io_thread_number_;
 
+    // 每个IO线程独占一个io_service和SO_REUSEPORT的acceptor，连接只在接受它的
+    // 线程上处理，不再需要strand，默认关闭(所有IO线程共享一个io_service)
+    bool           io_service_per_thread_;
+
 
 
     bool load_setting(std::shared_ptr<libconfig::Config> setting_ptr) {
@@ -103,6 +107,8 @@ class HttpConf {
             return false;
         }
 
+        setting.lookupValue("http.io_service_per_thread", io_service_per_thread_);
+
         // once init，可以保证只被调用一次
         std::string server_version;
         setting.lookupValue("http.version", server_version);
@@ -213,7 +219,8 @@ public:
         bind_addr_(),
         bind_port_(0),
         backlog_size_(0),
-        io_thread_number_(0) {
+        io_thread_number_(0),
+        io_service_per_thread_(false) {
     }
 
     ~HttpConf() = default;
@@ -0,0 +1,168 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <other/Log.h>
+
+#include "HttpReqInstance.h"
+#include "HttpCoroutine.h"
+
+namespace tzhttpd {
+
+static size_t page_size() {
+    static size_t size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+// 向上取整到页，另外加上guard page
+static size_t mapping_size(std::size_t size) {
+    size_t page = page_size();
+    return (size + page - 1) / page * page + page;
+}
+
+CoStackPool& CoStackPool::instance() {
+    static CoStackPool pool;
+    return pool;
+}
+
+void CoStackPool::allocate(boost::coroutines::stack_context& ctx, std::size_t size) {
+
+    size_t length = mapping_size(size);
+    void* base = NULL;
+
+    if (length == mapping_size(kStackSize)) {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (!free_stacks_.empty()) {
+            base = free_stacks_.back();
+            free_stacks_.pop_back();
+        }
+    }
+
+    if (!base) {
+        base = ::mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            roo::log_err("mmap coroutine stack with size %lu failed.", static_cast<unsigned long>(length));
+            throw std::bad_alloc();
+        }
+
+        if (::mprotect(base, page_size(), PROT_NONE) != 0) {
+            roo::log_err("mprotect coroutine stack guard page failed.");
+        }
+    }
+
+    ctx.size = length;
+    ctx.sp = static_cast<char*>(base) + length;
+}
+
+void CoStackPool::deallocate(boost::coroutines::stack_context& ctx) {
+
+    void* base = static_cast<char*>(ctx.sp) - ctx.size;
+
+    if (ctx.size == mapping_size(kStackSize)) {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (free_stacks_.size() < kMaxCachedStacks) {
+            free_stacks_.push_back(base);
+            return;
+        }
+    }
+
+    ::munmap(base, ctx.size);
+}
+
+
+HttpCoContext::HttpCoContext(boost::asio::io_service& io_service,
+                             const HttpCoHandler& handler, std::shared_ptr<HttpResponder> responder) :
+    io_service_(io_service),
+    strand_(io_service),
+    timer_(io_service),
+    handler_(handler),
+    responder_(responder),
+    coro_(),
+    sink_(NULL),
+    waiting_(false),
+    ec_(),
+    bytes_transferred_(0) {
+}
+
+// 挂起中的协程在析构的时候会展开自己的栈，responder如果还没有完成会自动回复500
+HttpCoContext::~HttpCoContext() {
+    coro_.reset();
+}
+
+void HttpCoContext::spawn(const HttpCoHandler& handler,
+                          const HttpParser& http_parser, std::shared_ptr<HttpResponder> responder) {
+
+    boost::asio::io_service* io_service = responder->http_req_instance_->io_service();
+    if (!io_service) {
+        roo::log_err("connection already released before, will not spawn coroutine.");
+        return;
+    }
+
+    std::shared_ptr<HttpCoContext> co_ctx = std::make_shared<HttpCoContext>(*io_service, handler, responder);
+    co_ctx->strand_.post(std::bind(&HttpCoContext::start, co_ctx));
+}
+
+void HttpCoContext::start() {
+
+    // 构造的时候就开始执行，直到第一次挂起或者结束才返回
+    // 在这之前其他的回调都排在strand中，不会看到还没有赋值的coro_
+    coro_.reset(new coroutine_type::pull_type(
+                    std::bind(&HttpCoContext::run, this, std::placeholders::_1),
+                    boost::coroutines::attributes(CoStackPool::kStackSize),
+                    CoStackAllocator()));
+}
+
+void HttpCoContext::run(coroutine_type::push_type& sink) {
+
+    sink_ = &sink;
+
+    std::string response_str;
+    std::string status_str;
+    std::vector<std::string> headers;
+
+    int code = handler_(*this, response_str, status_str, headers);
+    responder_->complete(code, response_str, status_str, headers);
+
+    // 尽早释放请求
+    responder_.reset();
+}
+
+void HttpCoContext::resume(const boost::system::error_code& ec, std::size_t bytes_transferred) {
+
+    if (!waiting_ || !coro_ || !*coro_) {
+        roo::log_err("coroutine is not waiting, drop this resume.");
+        return;
+    }
+
+    waiting_ = false;
+    ec_ = ec;
+    bytes_transferred_ = bytes_transferred;
+    (*coro_)();
+}
+
+boost::system::error_code HttpCoContext::co_wait(std::size_t* bytes_transferred) {
+
+    SAFE_ASSERT(sink_);
+
+    waiting_ = true;
+    (*sink_)();
+
+    if (bytes_transferred) {
+        *bytes_transferred = bytes_transferred_;
+    }
+    return ec_;
+}
+
+void HttpCoContext::co_sleep(uint64_t msec) {
+    timer_.expires_from_now(boost::chrono::milliseconds(msec));
+    timer_.async_wait(async_handler());
+    co_wait();
+}
+
+} // end namespace tzhttpd
@@ -0,0 +1,170 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __TZHTTPD_HTTP_COROUTINE_H__
+#define __TZHTTPD_HTTP_COROUTINE_H__
+
+#include <xtra_rhel.h>
+
+#include <mutex>
+#include <vector>
+
+#define BOOST_COROUTINES_NO_DEPRECATION_WARNING
+#include <boost/coroutine/asymmetric_coroutine.hpp>
+#include <boost/coroutine/stack_context.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "HttpHandler.h"
+
+namespace tzhttpd {
+
+// 有栈协程方式的handler
+//
+// 协程运行在连接所属的io_service上，等待后端、定时的时候挂起，不占用任何线程，
+// 处理代码仍然可以按照同步的方式顺序编写，少量的IO线程就可以支撑大量慢请求
+// 同一个协程的执行和恢复通过自己的strand串行化，共享io_service的时候可能在不同的线程上恢复，
+// 所以不能跨越挂起点持有RcuReadGuard、线程局部的状态或者锁
+
+class HttpCoContext;
+
+typedef std::function<int(HttpCoContext& co_ctx,
+                          std::string& response, std::string& status_line, std::vector<std::string>& add_header)> HttpCoHandler;
+
+
+// 协程栈的缓存池
+// 栈通过mmap分配，最低的一页设置为PROT_NONE作为guard page，溢出的时候直接SIGSEGV，
+// 而不会悄悄写坏相邻的内存；协程结束之后栈放回空闲链表复用，避免每个请求都mmap/munmap
+class CoStackPool {
+
+    __noncopyable__(CoStackPool)
+
+public:
+    static CoStackPool& instance();
+
+    // 返回的size包含guard page，sp是栈顶(高地址)
+    void allocate(boost::coroutines::stack_context& ctx, std::size_t size);
+    void deallocate(boost::coroutines::stack_context& ctx);
+
+    static const size_t kStackSize = 256 * 1024;
+
+private:
+    CoStackPool() :
+        lock_(),
+        free_stacks_() {
+    }
+
+    static const size_t kMaxCachedStacks = 512;
+
+    std::mutex lock_;
+    std::vector<void*> free_stacks_;    // 都是kStackSize大小的
+};
+
+// 满足Boost.Coroutine的StackAllocator概念，转发给CoStackPool
+struct CoStackAllocator {
+
+    void allocate(boost::coroutines::stack_context& ctx, std::size_t size = CoStackPool::kStackSize) {
+        CoStackPool::instance().allocate(ctx, size);
+    }
+
+    void deallocate(boost::coroutines::stack_context& ctx) {
+        CoStackPool::instance().deallocate(ctx);
+    }
+};
+
+
+class HttpCoContext : public std::enable_shared_from_this<HttpCoContext> {
+
+    __noncopyable__(HttpCoContext)
+
+public:
+
+    // 传给asio异步操作的完成回调，完成的时候在协程的strand中恢复co_wait()
+    class Resumer {
+    public:
+        explicit Resumer(std::shared_ptr<HttpCoContext> co_ctx) :
+            co_ctx_(co_ctx) {
+        }
+
+        void operator()(const boost::system::error_code& ec) {
+            (*this)(ec, 0);
+        }
+
+        void operator()(const boost::system::error_code& ec, std::size_t bytes_transferred) {
+            co_ctx_->strand_.dispatch(std::bind(&HttpCoContext::resume, co_ctx_, ec, bytes_transferred));
+        }
+
+    private:
+        std::shared_ptr<HttpCoContext> co_ctx_;
+    };
+
+    HttpCoContext(boost::asio::io_service& io_service,
+                  const HttpCoHandler& handler, std::shared_ptr<HttpResponder> responder);
+    ~HttpCoContext();
+
+    // 作为异步handler注册，在连接所属的io_service上启动协程
+    static void spawn(const HttpCoHandler& handler,
+                      const HttpParser& http_parser, std::shared_ptr<HttpResponder> responder);
+    static void spawn_post(const HttpCoHandler& handler, const HttpParser& http_parser,
+                           const std::string& post_data, std::shared_ptr<HttpResponder> responder) {
+        spawn(handler, http_parser, responder);
+    }
+
+    const HttpParser& http_parser() const {
+        return responder_->http_parser();
+    }
+
+    // 请求体在分发之前已经由连接读取完毕，这里直接返回，不会挂起
+    const std::string& co_read_body() const {
+        return responder_->post_data();
+    }
+
+    // 挂起协程msec毫秒
+    void co_sleep(uint64_t msec);
+
+    // 等待任意的asio异步操作，每次调用async_handler()之后必须紧跟一次co_wait():
+    //
+    //   socket.async_connect(endpoint, co_ctx.async_handler());
+    //   boost::system::error_code ec = co_ctx.co_wait();
+    Resumer async_handler() {
+        return Resumer(shared_from_this());
+    }
+
+    boost::system::error_code co_wait(std::size_t* bytes_transferred = NULL);
+
+    boost::asio::io_service& io_service() {
+        return io_service_;
+    }
+
+private:
+
+    typedef boost::coroutines::asymmetric_coroutine<void> coroutine_type;
+
+    void start();
+    void run(coroutine_type::push_type& sink);
+    void resume(const boost::system::error_code& ec, std::size_t bytes_transferred);
+
+    boost::asio::io_service& io_service_;
+    boost::asio::io_service::strand strand_;
+    boost::asio::steady_timer timer_;
+
+    HttpCoHandler handler_;
+    std::shared_ptr<HttpResponder> responder_;
+
+    std::unique_ptr<coroutine_type::pull_type> coro_;
+    coroutine_type::push_type* sink_;   // 只在协程内部使用，用来挂起
+
+    bool waiting_;
+    boost::system::error_code ec_;
+    std::size_t bytes_transferred_;
+};
+
+} // end namespace tzhttpd
+
+
+#endif // __TZHTTPD_HTTP_COROUTINE_H__
@@ -8,6 +8,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
 
 #include <fstream>
 #include <sstream>
@@ -18,6 +21,8 @@
 #include "HttpExecutor.h"
 #include "HttpReqInstance.h"
 #include "BasicAuth.h"
+#include "StaticCache.h"
+#include "FileMetaCache.h"
 
 #include "CgiHelper.h"
 #include "CgiWrapper.h"
@@ -36,188 +41,843 @@ std::string              http_server_version = "2.3.2";
 
 using namespace http_proto;
 
-// 默认静态的Handler，从文件系统读取文件病发送
-static bool check_and_sendfile(const HttpParser& http_parser, std::string regular_file_path,
-                               std::string& response, std::string& status_line) {
+// 需要压缩的时候才将文件内容读入内存，超过这个大小的文件不压缩，直接sendfile发送
+static const off_t kMaxCompressFileSize = 100 * 1024 * 1024; /*100M*/
+
+// 太小的文件压缩收益不大，压缩之后大于原大小这个百分比的也不使用压缩结果
+static const size_t kMinCompressFileSize = 256;
+static const size_t kMaxCompressRatio = 90;
+
+// 打开普通文件作为响应体，由网络层使用sendfile(2)发送，失败返回errno
+static int open_regular_file(const std::string& regular_file_path, std::shared_ptr<FileBody>& file) {
+
+    int fd = ::open(regular_file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+
+    std::shared_ptr<FileBody> opened = std::make_shared<FileBody>();
+    opened->fd_ = fd;    // 由FileBody负责关闭
 
-    // check dest is directory or regular?
     struct stat sb;
-    if (stat(regular_file_path.c_str(), &sb) == -1) {
-        roo::log_err("Stat file error: %s", regular_file_path.c_str());
-        response = http_proto::content_error;
-        status_line = generate_response_status_line(http_parser.get_version(),
-                                                    StatusCode::server_error_internal_server_error);
+    if (::fstat(fd, &sb) == -1) {
+        return errno;
+    }
+
+    if ((sb.st_mode & S_IFMT) != S_IFREG) {
+        return (sb.st_mode & S_IFMT) == S_IFDIR ? EISDIR : EINVAL;
+    }
+
+    opened->size_ = sb.st_size;
+    opened->mtime_ = sb.st_mtime;
+    opened->ino_ = sb.st_ino;
+    file.swap(opened);
+
+    return 0;
+}
+
+static bool is_not_found_errno(int err) {
+    return err == ENOENT || err == ENOTDIR || err == EACCES || err == ENAMETOOLONG || err == ELOOP;
+}
+
+// 请求路径对应的普通文件，目录则依次尝试docu_index中的索引文件
+static std::shared_ptr<FileMeta> resolve_file_meta(const std::string& docu_root,
+                                                   const std::vector<std::string>& indexes,
+                                                   const std::string& path_info) {
+
+    std::shared_ptr<FileMeta> meta = std::make_shared<FileMeta>();
+    std::string real_file_path = docu_root + "/" + path_info;
+
+    int ret = open_regular_file(real_file_path, meta->file_);
+    if (ret == 0) {
+        meta->file_path_ = real_file_path;
+    } else if (ret == EISDIR) {
+        for (std::vector<std::string>::const_iterator iter = indexes.cbegin();
+             iter != indexes.cend();
+             ++iter) {
+            std::string file_path = real_file_path + "/" + *iter;
+            roo::log_warning("Trying: %s", file_path.c_str());
+            if (open_regular_file(file_path, meta->file_) == 0) {
+                meta->file_path_ = file_path;
+                meta->index_dir_ = real_file_path;
+                break;
+            }
+        }
+
+        if (!meta->file_) {
+            roo::log_err("Index not found in: %s", real_file_path.c_str());
+            meta->status_ = FileMetaStatus::kNotFound;
+            return meta;
+        }
+    } else if (ret == EINVAL || is_not_found_errno(ret)) {
+        roo::log_err("File not found: %s, errno: %d", real_file_path.c_str(), ret);
+        meta->status_ = FileMetaStatus::kNotFound;
+        return meta;
+    } else {
+        roo::log_err("Open file error: %s, errno: %d", real_file_path.c_str(), ret);
+        meta->status_ = FileMetaStatus::kError;
+        return meta;
+    }
+
+    meta->status_ = FileMetaStatus::kFound;
+
+    // 取出扩展名
+    std::string lower_path = boost::to_lower_copy(meta->file_path_);
+    std::string::size_type pos = lower_path.rfind(".");
+    if (pos != std::string::npos && (lower_path.size() - pos) < 6) {
+        meta->suffix_ = lower_path.substr(pos);
+    }
+
+    return meta;
+}
+
+static bool read_file_body(const FileBody& file, std::string& content) {
+
+    size_t length = static_cast<size_t>(file.size_);
+    content.resize(length);
+
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = ::pread(file.fd_, &content[done], length - done, done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            roo::log_err("read file failed, expect %lu, got %lu",
+                         static_cast<unsigned long>(length), static_cast<unsigned long>(done));
+            content.clear();
+            return false;
+        }
+        done += n;
+    }
+
+    return true;
+}
+
+// 路径解析缓存中打开的文件是否仍然是当前的内容: 没有被删除或者被rename覆盖(链接数为0)，
+// 也没有被原地修改(大小和修改时间和打开时一样)
+static bool file_body_unchanged(const FileBody& file) {
+
+    struct stat sb;
+    if (::fstat(file.fd_, &sb) == -1) {
         return false;
     }
 
-    if (sb.st_size > 100 * 1024 * 1024 /*100M*/) {
-        roo::log_err("Too big file size: %ld", sb.st_size);
-        response = http_proto::content_bad_request;
-        status_line = generate_response_status_line(http_parser.get_version(),
-                                                    StatusCode::client_error_bad_request);
+    return sb.st_nlink > 0 && sb.st_size == file.size_ && sb.st_mtime == file.mtime_;
+}
+
+// 强校验的ETag，由inode、大小和修改时间构成
+static std::string make_file_etag(const FileBody& file) {
+
+    char buf[64]{};
+    ::snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"",
+               static_cast<unsigned long>(file.ino_),
+               static_cast<unsigned long>(file.size_),
+               static_cast<unsigned long>(file.mtime_));
+    return std::string(buf);
+}
+
+// 条件请求满足的时候，返回不带正文的304，头部和200的时候一样由调用者添加
+static bool static_not_modified(const HttpParser& http_parser, const std::string& etag, time_t mtime,
+                                std::string& status_line) {
+
+    if (!http_proto::check_not_modified(
+            http_parser.find_request_header(http_proto::header_options::if_none_match),
+            http_parser.find_request_header(http_proto::header_options::if_modified_since),
+            etag, mtime)) {
         return false;
     }
 
-    std::ifstream fin(regular_file_path);
-    fin.seekg(0);
-    std::stringstream buffer;
-    buffer << fin.rdbuf();
-    response = buffer.str();
     status_line = generate_response_status_line(http_parser.get_version(),
-                                                StatusCode::success_ok);
+                                                StatusCode::redirection_not_modified);
+    return true;
+}
+
+// 压缩之后的内容和文件本身不是逐字节相同的，ETag改为弱校验
+static void add_content_encoding(std::vector<std::string>& add_header, const std::string& encoding) {
+
+    for (auto iter = add_header.begin(); iter != add_header.end(); ++iter) {
+        if (iter->compare(0, 7, "ETag: \"") == 0) {
+            iter->insert(6, "W/");
+        }
+    }
+
+    add_header.push_back("Content-Encoding: " + encoding);
+}
+
+// Accept-Encoding中是否接受该编码，q=0表示明确拒绝，没有列出的时候参考"*"
+static bool encoding_accepted(const std::string& accept, const std::string& coding) {
+
+    bool wildcard = false;
+
+    std::vector<std::string> items{};
+    boost::split(items, accept, boost::is_any_of(","));
+    for (auto iter = items.cbegin(); iter != items.cend(); ++iter) {
+
+        std::vector<std::string> params{};
+        boost::split(params, *iter, boost::is_any_of(";"));
+
+        std::string token = boost::trim_copy(params[0]);
+        if (token.empty()) {
+            continue;
+        }
+
+        double qvalue = 1.0;
+        for (size_t i = 1; i < params.size(); ++i) {
+            std::string param = boost::trim_copy(params[i]);
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                qvalue = ::atof(param.c_str() + 2);
+            }
+        }
+
+        if (boost::iequals(token, coding)) {
+            return qvalue > 0;
+        }
+
+        if (token == "*") {
+            wildcard = qvalue > 0;
+        }
+    }
+
+    return wildcard;
+}
+
+static std::string find_add_header(const std::vector<std::string>& add_header, const std::string& name) {
+
+    for (auto iter = add_header.cbegin(); iter != add_header.cend(); ++iter) {
+        if (iter->size() > name.size() + 1 && (*iter)[name.size()] == ':' &&
+            boost::istarts_with(*iter, name)) {
+            return boost::trim_copy(iter->substr(name.size() + 1));
+        }
+    }
+
+    return "";
+}
+
+// 完整的200响应按照Range请求返回206，只引用文件或者缓存内容中请求的部分，不读取整个文件
+// 多个区间使用multipart/byteranges返回
+static void static_file_range(const HttpParser& http_parser, std::string& status_line,
+                              std::vector<std::string>& add_header, SendSegment& body,
+                              std::vector<SendSegment>& segments) {
+
+    // 压缩的内容不支持Range
+    if (status_line.find(" 200 ") == std::string::npos ||
+        !find_add_header(add_header, http_proto::header_options::content_encoding).empty()) {
+        segments.push_back(SendSegment());
+        segments.back().swap(body);
+        return;
+    }
+
+    add_header.push_back("Accept-Ranges: bytes");
+
+    const std::string& range = http_parser.find_request_header(http_proto::header_options::range);
+    const std::string& if_range = http_parser.find_request_header(http_proto::header_options::if_range);
+
+    bool whole = range.empty();
+    if (!whole && !if_range.empty()) {
+        // If-Range 只能使用强校验的ETag，或者完全相同的Last-Modified
+        std::string validator = boost::trim_copy(if_range);
+        if (validator[0] == '"') {
+            whole = validator != find_add_header(add_header, "ETag");
+        } else {
+            whole = validator != find_add_header(add_header, "Last-Modified");
+        }
+    }
+
+    off_t size = body.shared_ ? static_cast<off_t>(body.shared_->size()) : body.file_->size_;
+    std::vector<std::pair<off_t, off_t>> ranges{};
+    int ret = whole ? -1 : parse_byte_ranges(range, size, ranges);
+
+    if (ret < 0) {
+        segments.push_back(SendSegment());
+        segments.back().swap(body);
+        return;
+    }
+
+    if (ret == 0) {
+        roo::log_err("range not satisfiable: %s, size %ld", range.c_str(), static_cast<long>(size));
+        status_line = generate_response_status_line(http_parser.get_version(),
+                                                    StatusCode::client_error_range_not_satisfiable);
+        add_header.push_back("Content-Range: bytes */" + std::to_string(static_cast<long long>(size)));
+        return;
+    }
+
+    status_line = generate_response_status_line(http_parser.get_version(),
+                                                StatusCode::success_partial_content);
+
+    char buf[128]{};
+    if (ranges.size() == 1) {
+        ::snprintf(buf, sizeof(buf), "Content-Range: bytes %lld-%lld/%lld",
+                   static_cast<long long>(ranges[0].first), static_cast<long long>(ranges[0].second),
+                   static_cast<long long>(size));
+        add_header.push_back(buf);
+
+        segments.push_back(SendSegment());
+        segments.back().swap(body);
+        segments.back().offset_ = ranges[0].first;
+        segments.back().length_ = ranges[0].second - ranges[0].first + 1;
+        return;
+    }
+
+    // 每个部分带有原来的Content-Type
+    std::string part_type{};
+    for (auto iter = add_header.begin(); iter != add_header.end(); ++iter) {
+        if (boost::istarts_with(*iter, "Content-Type:")) {
+            part_type = *iter;
+            add_header.erase(iter);
+            break;
+        }
+    }
+
+    ::snprintf(buf, sizeof(buf), "tzhttpd%08lx%08lx",
+               static_cast<unsigned long>(::time(NULL)), static_cast<unsigned long>(::random()));
+    std::string boundary = buf;
+    add_header.push_back("Content-Type: multipart/byteranges; boundary=" + boundary);
+
+    segments.reserve(ranges.size() * 2 + 1);
+    for (auto iter = ranges.cbegin(); iter != ranges.cend(); ++iter) {
+
+        ::snprintf(buf, sizeof(buf), "Content-Range: bytes %lld-%lld/%lld",
+                   static_cast<long long>(iter->first), static_cast<long long>(iter->second),
+                   static_cast<long long>(size));
+
+        segments.push_back(SendSegment());
+        segments.back().data_ = "\r\n--" + boundary + "\r\n";
+        if (!part_type.empty()) {
+            segments.back().data_ += part_type + "\r\n";
+        }
+        segments.back().data_ += std::string(buf) + "\r\n\r\n";
+
+        segments.push_back(SendSegment());
+        segments.back().shared_ = body.shared_;
+        segments.back().file_ = body.file_;
+        segments.back().offset_ = iter->first;
+        segments.back().length_ = iter->second - iter->first + 1;
+    }
+
+    segments.push_back(SendSegment());
+    segments.back().data_ = "\r\n--" + boundary + "--\r\n";
+    body = SendSegment();
+}
+
+// 和文件同目录的预压缩文件(.gz)，比原文件旧的不使用
+static std::shared_ptr<FileBody> open_precompressed(const std::string& file_path, time_t mtime) {
+
+    std::string gz_path = file_path + ".gz";
+    int fd = ::open(gz_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::shared_ptr<FileBody>();
+    }
+
+    std::shared_ptr<FileBody> file = std::make_shared<FileBody>();
+    file->fd_ = fd;
+
+    struct stat sb;
+    if (::fstat(fd, &sb) == -1 || (sb.st_mode & S_IFMT) != S_IFREG || sb.st_mtime < mtime) {
+        return std::shared_ptr<FileBody>();
+    }
+
+    file->size_ = sb.st_size;
+    file->mtime_ = sb.st_mtime;
+    return file;
+}
+
+// 压缩之后没有明显变小的就不值得压缩了，返回false
+static bool compress_content(const std::string& encoding, const std::string& content, std::string& compressed) {
+
+    int ret = -1;
+    if (encoding == "deflate") {
+        ret = CryptoUtil::Deflator(content, compressed);
+    } else if (encoding == "gzip") {
+        ret = CryptoUtil::Gzip(content, compressed);
+    }
+
+    if (ret != 0) {
+        roo::log_err("cryptopp %s encoding failed.", encoding.c_str());
+        return false;
+    }
+
+    roo::log_info("compress %s size from %d to %d", encoding.c_str(),
+                  static_cast<int>(content.size()), static_cast<int>(compressed.size()));
+
+    if (compressed.size() * 100 > content.size() * kMaxCompressRatio) {
+        compressed.clear();
+        return false;
+    }
+
+    return true;
+}
+
+
+// static_cache_size单位为MB，没有配置或者为0的时候不启用静态文件缓存
+// 动态更新的时候如果根目录和大小都没有变化，就沿用之前的缓存
+static bool load_static_cache(const libconfig::Setting& setting, const std::string& docu_root,
+                              const std::shared_ptr<StaticCache>& previous,
+                              std::shared_ptr<StaticCache>& cache) {
+
+    int cache_size = 0;
+    setting.lookupValue("static_cache_size", cache_size);
+    if (cache_size <= 0 || docu_root.empty()) {
+        cache.reset();
+        return true;
+    }
+
+    size_t capacity = static_cast<size_t>(cache_size) * 1024 * 1024;
+    if (previous && previous->capacity() == capacity &&
+        previous->docu_root() == StaticCache::normalize_path(docu_root)) {
+        // 缓存项中的响应头部是按照之前的配置生成的
+        previous->invalidate_all();
+        cache = previous;
+        return true;
+    }
+
+    cache = std::make_shared<StaticCache>(docu_root, capacity);
+    if (!cache || !cache->init()) {
+        roo::log_err("init static cache for %s failed.", docu_root.c_str());
+        cache.reset();
+        return false;
+    }
 
     return true;
 }
 
+// 定期清理过期的条目，关闭其中的fd；缓存被替换之后定时器什么也不做
+static void sweep_meta_cache(std::weak_ptr<FileMetaCache> weak_cache, const boost::system::error_code& ec) {
+
+    std::shared_ptr<FileMetaCache> cache = weak_cache.lock();
+    if (cache) {
+        cache->sweep();
+    }
+}
+
+// file_meta_cache_ttl_ms为0的时候不启用路径解析缓存，file_meta_cache_size为最大条目数，
+// file_meta_cache_max_fds为缓存持有的最多fd数目，0表示根据RLIMIT_NOFILE自动选择
+static void load_meta_cache(const libconfig::Setting& setting,
+                            const std::shared_ptr<FileMetaCache>& previous,
+                            std::shared_ptr<FileMetaCache>& cache) {
+
+    int ttl_ms = 0;
+    int cache_size = 10000;
+    int max_fds = 0;
+    setting.lookupValue("file_meta_cache_ttl_ms", ttl_ms);
+    setting.lookupValue("file_meta_cache_size", cache_size);
+    setting.lookupValue("file_meta_cache_max_fds", max_fds);
+    if (ttl_ms <= 0 || cache_size <= 0) {
+        cache.reset();
+        return;
+    }
 
+    if (previous && previous->ttl_ms() == static_cast<uint32_t>(ttl_ms) &&
+        previous->capacity() == static_cast<size_t>(cache_size) &&
+        (max_fds <= 0 || previous->max_fds() == static_cast<size_t>(max_fds))) {
+        cache = previous;
+        return;
+    }
+
+    cache = std::make_shared<FileMetaCache>(cache_size, ttl_ms, max_fds > 0 ? max_fds : 0);
+
+    // 至少每秒一次，TTL更长的时候按照TTL的间隔清理
+    uint64_t interval = std::max<uint64_t>(ttl_ms, 1000);
+    if (!Global::instance().timer_ptr()->add_timer(
+            std::bind(sweep_meta_cache, std::weak_ptr<FileMetaCache>(cache), std::placeholders::_1),
+            interval, true)) {
+        roo::log_err("create file meta cache sweep timer failed, disable file meta cache.");
+        cache.reset();
+        return;
+    }
+
+    roo::log_warning("file meta cache enabled, size %d, ttl %dms, max_fds %lu",
+                     cache_size, ttl_ms, static_cast<unsigned long>(cache->max_fds()));
+}
+
+// 队列容量、满了之后的拒绝策略、虚拟主机和特定路由的排队时间预算
+static void load_queue_control(const libconfig::Setting& setting, ExecutorConf& conf,
+                               std::map<std::string, int>& queue_timeouts) {
+
+    setting.lookupValue("exec_queue_size", conf.exec_queue_size_);
+    setting.lookupValue("exec_queue_timeout_ms", conf.exec_queue_timeout_ms_);
+
+    std::string policy = "reject_new";
+    setting.lookupValue("exec_queue_reject_policy", policy);
+    if (policy == "drop_oldest") {
+        conf.exec_queue_reject_policy_ = QueueRejectPolicy::kDropOldest;
+    } else {
+        if (policy != "reject_new") {
+            roo::log_err("unknown exec_queue_reject_policy %s, using reject_new.", policy.c_str());
+        }
+        conf.exec_queue_reject_policy_ = QueueRejectPolicy::kRejectNew;
+    }
+
+    queue_timeouts.clear();
+    if (setting.exists("queue_timeout_control")) {
+        const libconfig::Setting& timeout_control = setting["queue_timeout_control"];
+        for (int i = 0; i < timeout_control.getLength(); ++i) {
+            const libconfig::Setting& ctrl_item = timeout_control[i];
+            std::string uri{};
+            int timeout_ms = 0;
+
+            ctrl_item.lookupValue("uri", uri);
+            ctrl_item.lookupValue("timeout_ms", timeout_ms);
+            if (uri.empty() || timeout_ms < 0) {
+                roo::log_err("skip err queue timeout ctrl configure item ...");
+                continue;
+            }
 
+            queue_timeouts[roo::StrUtil::pure_uri_path(uri)] = timeout_ms;
+        }
+    }
+}
+
+// 保持HttpGetHandler的接口，文件内容读入response返回
 int HttpExecutor::default_get_handler(const HttpParser& http_parser, std::string& response,
                                       std::string& status_line, std::vector<std::string>& add_header) {
 
+    SendSegment body;
+    int ret = static_file_handler(http_parser, response, status_line, add_header, body);
+    if (body.shared_) {
+        response = *body.shared_;
+    } else if (body.file_ && !read_file_body(*body.file_, response)) {
+        response = http_proto::content_error;
+        status_line = generate_response_status_line(http_parser.get_version(),
+                                                    StatusCode::server_error_internal_server_error);
+        add_header.clear();
+        return -1;
+    }
+
+    return ret;
+}
+
+// 返回的时候如果body不为空，则响应体是其中的文件或者缓存内容，否则响应体在response中
+int HttpExecutor::static_file_handler(const HttpParser& http_parser, std::string& response,
+                                      std::string& status_line, std::vector<std::string>& add_header,
+                                      SendSegment& body) {
+
     const UriParamContainer& params = http_parser.get_request_uri_params();
     if (!params.EMPTY()) {
         roo::log_err("Default handler just for static file transmit, we can not handler uri parameters...");
     }
 
-    std::shared_ptr<HttpExecutorConf> conf_ptr;
-    {
-        std::unique_lock<std::mutex> lock(conf_lock_);
-        conf_ptr = conf_ptr_;
+    // 文件IO和压缩可能很慢，不能在RCU临界区内进行，否则会推迟所有旧快照的回收，
+    // 这里持有配置快照的引用，后面使用的缓存对象也都是共享引用
+    std::shared_ptr<HttpExecutorConf> conf_ptr = conf_.load_shared();
+
+    const std::string& path_info = http_parser.find_request_header(http_proto::header_options::request_path_info);
+
+    // 命中缓存的时候不需要任何文件系统调用，响应头部也都是插入时预先生成的
+    std::shared_ptr<StaticCache> cache = conf_ptr->static_cache_;
+    uint64_t generation = 0;
+    if (cache) {
+        std::shared_ptr<const StaticCacheEntry> entry = cache->find(path_info);
+        if (entry) {
+            add_header.insert(add_header.end(), entry->headers_.begin(), entry->headers_.end());
+            if (static_not_modified(http_parser, entry->etag_, entry->mtime_, status_line)) {
+                return 0;
+            }
+
+            body.shared_ = entry->content_;
+            status_line = generate_response_status_line(http_parser.get_version(),
+                                                        StatusCode::success_ok);
+            if (!entry->compressible_) {
+                return 0;
+            }
+
+            return static_file_compress(http_parser, entry->file_path_, cache, path_info, entry,
+                                        response, status_line, add_header, body);
+        }
+
+        // 在访问文件之前取得，之后如果文件被修改了，本次读取的内容不会进入缓存
+        generation = cache->generation();
     }
 
-    std::string real_file_path = conf_ptr_->http_docu_root_ +
-        "/" + http_parser.find_request_header(http_proto::header_options::request_path_info);
+    // 路径解析的结果(打开的文件、索引文件或者不存在)可以在很短的时间内复用
+    std::shared_ptr<FileMetaCache> meta_cache = conf_ptr->meta_cache_;
+    std::shared_ptr<const FileMeta> meta;
+    bool fresh = false;
+    if (meta_cache) {
+        meta = meta_cache->find(path_info);
+    }
+    if (!meta) {
+        fresh = true;
+        std::shared_ptr<FileMeta> resolved = resolve_file_meta(conf_ptr->http_docu_root_,
+                                                               conf_ptr->http_docu_index_, path_info);
+        if (meta_cache) {
+            meta_cache->insert(path_info, resolved);
+        }
+        meta = resolved;
+    }
 
-    // check dest exist?
-    if (::access(real_file_path.c_str(), R_OK) != 0) {
-        roo::log_err("File not found: %s", real_file_path.c_str());
-        response = http_proto::content_not_found;
-        status_line = generate_response_status_line(http_parser.get_version(),
-                                                    StatusCode::client_error_not_found);
+    if (meta->status_ != FileMetaStatus::kFound) {
+        if (meta->status_ == FileMetaStatus::kNotFound) {
+            response = http_proto::content_not_found;
+            status_line = generate_response_status_line(http_parser.get_version(),
+                                                        StatusCode::client_error_not_found);
+        } else {
+            response = http_proto::content_error;
+            status_line = generate_response_status_line(http_parser.get_version(),
+                                                        StatusCode::server_error_internal_server_error);
+        }
         return -1;
     }
 
-    // check dest is directory or regular?
-    struct stat sb;
-    if (stat(real_file_path.c_str(), &sb) == -1) {
-        roo::log_err("Stat file error: %s", real_file_path.c_str());
+    // 缓存中只有路径解析结果的时候在这里打开文件
+    std::shared_ptr<FileBody> file = meta->file_;
+    if (!file) {
+        int ret = open_regular_file(meta->file_path_, file);
+        if (ret != 0) {
+            roo::log_err("Open file error: %s, errno: %d", meta->file_path_.c_str(), ret);
+            if (ret == EINVAL || ret == EISDIR || is_not_found_errno(ret)) {
+                response = http_proto::content_not_found;
+                status_line = generate_response_status_line(http_parser.get_version(),
+                                                            StatusCode::client_error_not_found);
+            } else {
+                response = http_proto::content_error;
+                status_line = generate_response_status_line(http_parser.get_version(),
+                                                            StatusCode::server_error_internal_server_error);
+            }
+            return -1;
+        }
+        fresh = true;
+    }
+
+    const std::string& did_file_full_path = meta->file_path_;
+    const std::string& index_dir = meta->index_dir_;
+    const std::string& suffix = meta->suffix_;
+    status_line = generate_response_status_line(http_parser.get_version(),
+                                                StatusCode::success_ok);
+
+    // 校验通过的时候不需要读取文件内容
+    std::string etag = make_file_etag(*file);
+    std::vector<std::string> file_headers{};
+    file_headers.push_back("ETag: " + etag);
+    file_headers.push_back("Last-Modified: " + http_proto::http_date_string(file->mtime_));
+    bool compressible = static_file_headers(*conf_ptr, suffix, file_headers);
+
+    add_header.insert(add_header.end(), file_headers.begin(), file_headers.end());
+    if (static_not_modified(http_parser, etag, file->mtime_, status_line)) {
+        return 0;
+    }
+
+    // 足够小的文件读入内存放入缓存，后续的请求直接共享发送
+    // 路径解析缓存中的文件可能在generation之前就已经被替换或者修改了，需要先确认仍然是
+    // 当前的内容；之后的变化由插入时的generation检查排除
+    std::shared_ptr<const StaticCacheEntry> cached;
+    if (cache && static_cast<size_t>(file->size_) <= cache->max_entry_size() &&
+        (fresh || file_body_unchanged(*file))) {
+
+        std::shared_ptr<std::string> content = std::make_shared<std::string>();
+        if (read_file_body(*file, *content)) {
+
+            std::shared_ptr<StaticCacheEntry> entry = std::make_shared<StaticCacheEntry>();
+            entry->file_path_ = StaticCache::normalize_path(did_file_full_path);
+            if (!index_dir.empty()) {
+                entry->index_dir_ = StaticCache::normalize_path(index_dir);
+            }
+            entry->content_ = content;
+            entry->etag_ = etag;
+            entry->headers_.swap(file_headers);
+            entry->compressible_ = compressible;
+            entry->mtime_ = file->mtime_;
+            entry->size_ = file->size_;
+            cache->insert(path_info, entry, generation);
+
+            body.shared_ = content;
+            file.reset();
+            cached = entry;
+        }
+    }
+
+    if (file) {
+        body.file_ = file;
+    }
+
+    if (!compressible) {
+        return 0;
+    }
+
+    return static_file_compress(http_parser, did_file_full_path, cache, path_info, cached,
+                                response, status_line, add_header, body);
+}
+
+// 根据扩展名生成缓存控制、内容类型的头部，需要按照Accept-Encoding压缩的时候返回true
+// 缓存的文件在插入的时候调用一次，结果保存在缓存项中
+bool HttpExecutor::static_file_headers(const HttpExecutorConf& conf, const std::string& suffix,
+                                       std::vector<std::string>& add_header) {
+
+    if (suffix.empty()) {
+        return false;
+    }
+
+    auto iter = conf.cache_controls_.find(suffix);
+    if (iter != conf.cache_controls_.end()) {
+        add_header.push_back(iter->second);
+    }
+
+    std::string content_type = http_proto::find_content_type(suffix);
+    if (!content_type.empty()) {
+        add_header.push_back(content_type);
+    }
+
+    if (conf.compress_controls_.find(suffix) == conf.compress_controls_.cend()) {
+        return false;
+    }
+
+    add_header.push_back("Vary: Accept-Encoding");
+    return true;
+}
+
+// 按照Accept-Encoding进行压缩
+// entry不为空的时候是缓存中的文件，压缩结果也保存到缓存中
+int HttpExecutor::static_file_compress(const HttpParser& http_parser, const std::string& file_path,
+                                       const std::shared_ptr<StaticCache>& cache, const std::string& cache_key,
+                                       const std::shared_ptr<const StaticCacheEntry>& entry,
+                                       std::string& response, std::string& status_line,
+                                       std::vector<std::string>& add_header, SendSegment& body) {
+
+    if (body.empty() && response.empty()) {
+        return 0;
+    }
+
+    std::string accept = http_parser.find_request_header(http_proto::header_options::accept_encoding);
+
+    // 优先使用gzip: 客户端普遍支持，也只有gzip可以直接使用预压缩的.gz文件，
+    // 而deflate(zlib封装)在部分客户端上的兼容性不好
+    std::string encoding{};
+    if (encoding_accepted(accept, "gzip")) {
+        encoding = "gzip";
+    } else if (encoding_accepted(accept, "deflate")) {
+        encoding = "deflate";
+    } else {
+        return 0;
+    }
+
+    size_t size = body.shared_ ? body.shared_->size() : (body.file_ ? static_cast<size_t>(body.file_->size_) : 0);
+    if (size < kMinCompressFileSize) {
+        return 0;
+    }
+
+    // 缓存的文件，压缩结果也缓存在同一个缓存项中，只在第一次请求的时候压缩
+    if (entry) {
+
+        std::shared_ptr<const std::string> variant;
+        if (!cache->find_variant(cache_key, entry, encoding, variant)) {
+
+            std::shared_ptr<std::string> compressed = std::make_shared<std::string>();
+            std::shared_ptr<FileBody> precompressed;
+            if (encoding == "gzip" && (precompressed = open_precompressed(entry->file_path_, entry->mtime_)) &&
+                read_file_body(*precompressed, *compressed)) {
+                roo::log_info("use precompressed %s.gz", entry->file_path_.c_str());
+                variant = compressed;
+            } else if (compress_content(encoding, *entry->content_, *compressed)) {
+                variant = compressed;
+            }
+
+            cache->insert_variant(cache_key, entry, encoding, variant);
+        }
+
+        if (variant) {
+            body = SendSegment();
+            body.shared_ = variant;
+            add_content_encoding(add_header, encoding);
+        }
+
+        return 0;
+    }
+
+    // 磁盘上有预先压缩好的文件，直接发送
+    if (encoding == "gzip" && body.file_) {
+        std::shared_ptr<FileBody> precompressed = open_precompressed(file_path, body.file_->mtime_);
+        if (precompressed) {
+            body = SendSegment();
+            body.file_ = precompressed;
+            add_content_encoding(add_header, "gzip");
+            return 0;
+        }
+    }
+
+    // 需要压缩的时候才将文件内容读入内存，压缩之后不再使用文件发送
+    if (body.file_ && body.file_->size_ > kMaxCompressFileSize) {
+        return 0;
+    }
+
+    std::string content{};
+    if (body.shared_) {
+        content = *body.shared_;
+    } else if (body.file_ && !read_file_body(*body.file_, content)) {
+        body = SendSegment();
+        add_header.clear();
         response = http_proto::content_error;
         status_line = generate_response_status_line(http_parser.get_version(),
                                                     StatusCode::server_error_internal_server_error);
         return -1;
     }
 
-    bool OK = false;
-    std::string did_file_full_path{};
+    std::string compressed{};
+    if (compress_content(encoding, content, compressed)) {
+        // 压缩之后的内容作为响应体
+        response.swap(compressed);
+        body = SendSegment();
+        add_content_encoding(add_header, encoding);
+    }
 
-    switch (sb.st_mode & S_IFMT) {
-        case S_IFREG:
-            if (check_and_sendfile(http_parser, real_file_path, response, status_line)) {
-                did_file_full_path = real_file_path;
-                OK = true;
-            }
-            break;
+    return 0;
+}
 
-        case S_IFDIR:
-            {
-                const std::vector<std::string>& indexes = conf_ptr->http_docu_index_;
-                for (std::vector<std::string>::const_iterator iter = indexes.cbegin();
-                     iter != indexes.cend();
-                     ++iter) {
-                    std::string file_path = real_file_path + "/" + *iter;
-                    roo::log_warning("Trying: %s", file_path.c_str());
-                    if (check_and_sendfile(http_parser, file_path, response, status_line)) {
-                        did_file_full_path = file_path;
-                        OK = true;
-                        break;
-                    }
-                }
 
-                if (!OK) {
-                    // default, 404
-                    response = http_proto::content_not_found;
-                    status_line = generate_response_status_line(http_parser.get_version(),
-                                                                StatusCode::client_error_not_found);
-                }
-            }
-            break;
+// 动态handler的条件请求
+// handler自己设置了ETag，或者uri配置在etag_control中的时候(对正文做快速哈希作为ETag)，
+// 如果和If-None-Match匹配就丢弃正文返回304
+void HttpExecutor::handler_conditional_get(const HttpParser& http_parser, const std::string& uri,
+                                           std::string& response, std::string& status_line,
+                                           std::vector<std::string>& add_header) {
 
-        default:
-            break;
+    if (status_line.find(" 200 ") == std::string::npos) {
+        return;
     }
 
-    // do handler helper
-    if (OK && !did_file_full_path.empty()) {
+    std::string etag{};
+    for (auto iter = add_header.cbegin(); iter != add_header.cend(); ++iter) {
+        if (boost::istarts_with(*iter, "ETag:")) {
+            etag = boost::trim_copy(iter->substr(5));
+            break;
+        }
+    }
 
-        boost::to_lower(did_file_full_path);
+    if (etag.empty()) {
 
-        // 取出扩展名
-        std::string::size_type pos = did_file_full_path.rfind(".");
-        std::string suffix{};
-        if (pos != std::string::npos && (did_file_full_path.size() - pos) < 6) {
-            suffix = did_file_full_path.substr(pos);
-        }
+        RcuReadGuard guard;
+        const HttpExecutorConf* conf_ptr = conf_.get();
 
-        if (suffix.empty()) {
-            return 0;
+        if (conf_ptr->etag_controls_.empty()) {
+            return;
         }
 
-        // handle with specified suffix, for cache and content_type
-        auto iter = conf_ptr->cache_controls_.find(suffix);
-        if (iter != conf_ptr->cache_controls_.end()) {
-            add_header.push_back(iter->second);
-            roo::log_info("Adding cache header for %s(%s) -> %s",
-                          did_file_full_path.c_str(), iter->first.c_str(), iter->second.c_str());
+        std::string pure_uri = roo::StrUtil::pure_uri_path(uri);
+        bool matched = false;
+        boost::smatch what;
+        for (auto iter = conf_ptr->etag_controls_.cbegin(); iter != conf_ptr->etag_controls_.cend(); ++iter) {
+            if (boost::regex_match(pure_uri, what, *iter)) {
+                matched = true;
+                break;
+            }
         }
 
-        std::string content_type = http_proto::find_content_type(suffix);
-        if (!content_type.empty()) {
-            add_header.push_back(content_type);
-            roo::log_info("Adding content_type header for %s(%s) -> %s",
-                          did_file_full_path.c_str(), suffix.c_str(), content_type.c_str());
+        if (!matched) {
+            return;
         }
 
-        // compress type
-        // content already in response, compress it if possible
-        const auto cz_iter = conf_ptr->compress_controls_.find(suffix);
-        if (cz_iter != conf_ptr->compress_controls_.cend()) {
-            std::string encoding = http_parser.find_request_header(http_proto::header_options::accept_encoding);
-            if (!encoding.empty()) {
-                roo::log_info("Accept Encoding: %s", encoding.c_str());
-                if (encoding.find("deflate") != std::string::npos) {
-
-                    std::string compressed{};
-
-                    if (CryptoUtil::Deflator(response, compressed) == 0) {
-                        roo::log_info("compress %s size from %d to %d", did_file_full_path.c_str(),
-                                      static_cast<int>(response.size()), static_cast<int>(compressed.size()));
-                        response.swap(compressed);
-                        add_header.push_back("Content-Encoding: deflate");
-                    } else {
-                        roo::log_err("cryptopp deflate encoding failed.");
-                    }
-
-                } else if (encoding.find("gzip") != std::string::npos) {
-
-                    std::string compressed{};
-
-                    if (CryptoUtil::Gzip(response, compressed) == 0) {
-                        roo::log_info("compress %s size from %d to %d", did_file_full_path.c_str(),
-                                      static_cast<int>(response.size()), static_cast<int>(compressed.size()));
-                        response.swap(compressed);
-                        add_header.push_back("Content-Encoding: gzip");
-                    } else {
-                        roo::log_err("cryptopp gzip encoding failed.");
-                    }
-
-                } else {
-                    roo::log_err("unregistered compress type: %s", encoding.c_str());
-                }
-            }
-        }
+        char buf[64]{};
+        ::snprintf(buf, sizeof(buf), "\"%lx-%lx\"",
+                   static_cast<unsigned long>(std::hash<std::string>()(response)),
+                   static_cast<unsigned long>(response.size()));
+        etag = buf;
+        add_header.push_back("ETag: " + etag);
     }
 
-    return 0;
+    if (http_proto::etag_match(http_parser.find_request_header(http_proto::header_options::if_none_match), etag)) {
+        response.clear();
+        status_line = generate_response_status_line(http_parser.get_version(),
+                                                    StatusCode::redirection_not_modified);
+    }
 }
 
 
@@ -339,7 +999,7 @@ bool HttpExecutor::load_http_cgis(const libconfig::Setting& setting) {
             continue;
         }
 
-        add_get_handler(iter->first, getter, false);
+        add_get_handler(iter->first, getter, false, false);
     }
 
     key = "cgi_post_handlers";
@@ -363,7 +1023,7 @@ bool HttpExecutor::load_http_cgis(const libconfig::Setting& setting) {
             continue;
         }
 
-        add_post_handler(iter->first, poster, false);
+        add_post_handler(iter->first, poster, false, false);
     }
 
     return true;
@@ -374,12 +1034,17 @@ bool HttpExecutor::handle_virtual_host_conf(const libconfig::Setting& setting) {
 
     std::unique_lock<std::mutex> lock(conf_lock_);
 
-    if (!conf_ptr_) {
-        conf_ptr_.reset(new HttpExecutorConf());
-        if (!conf_ptr_) {
-            roo::log_err("create HttpExecutorConf instance failed.");
-            return false;
-        }
+    // 在新的快照上面解析，完成之后整体发布
+    std::shared_ptr<HttpExecutorConf> conf_ptr;
+    std::shared_ptr<HttpExecutorConf> current = conf_.load_shared();
+    if (current) {
+        conf_ptr.reset(new HttpExecutorConf(*current));
+    } else {
+        conf_ptr.reset(new HttpExecutorConf());
+    }
+    if (!conf_ptr) {
+        roo::log_err("create HttpExecutorConf instance failed.");
+        return false;
     }
 
     std::string server_name;
@@ -392,14 +1057,16 @@ bool HttpExecutor::handle_virtual_host_conf(const libconfig::Setting& setting) {
     setting.lookupValue("docu_root", docu_root_str);
     setting.lookupValue("docu_index", docu_index_str);
 
-    setting.lookupValue("exec_thread_pool_size", conf_ptr_->executor_conf_.exec_thread_number_);
-    setting.lookupValue("exec_thread_pool_size_hard", conf_ptr_->executor_conf_.exec_thread_number_hard_);
-    setting.lookupValue("exec_thread_pool_step_queue_size", conf_ptr_->executor_conf_.exec_thread_step_queue_size_);
+    setting.lookupValue("exec_thread_pool_size", conf_ptr->executor_conf_.exec_thread_number_);
+    setting.lookupValue("exec_thread_pool_size_hard", conf_ptr->executor_conf_.exec_thread_number_hard_);
+    setting.lookupValue("exec_thread_pool_step_queue_size", conf_ptr->executor_conf_.exec_thread_step_queue_size_);
+    setting.lookupValue("exec_thread_pool_work_stealing", conf_ptr->executor_conf_.exec_work_stealing_);
+    load_queue_control(setting, conf_ptr->executor_conf_, conf_ptr->queue_timeouts_);
 
 
     if (!redirect_str.empty()) {
 
-        conf_ptr_->redirect_str_ = redirect_str;
+        conf_ptr->redirect_str_ = redirect_str;
 
         auto pos = redirect_str.find('~');
         if (pos == std::string::npos) {
@@ -415,8 +1082,8 @@ bool HttpExecutor::handle_virtual_host_conf(const libconfig::Setting& setting) {
             return false;
         }
 
-        conf_ptr_->redirect_code_ = code;
-        conf_ptr_->redirect_uri_ = uri;
+        conf_ptr->redirect_code_ = code;
+        conf_ptr->redirect_uri_ = uri;
 
         HttpGetHandler get_func =
             std::bind(&HttpExecutor::http_redirect_handler, this,
@@ -438,9 +1105,10 @@ bool HttpExecutor::handle_virtual_host_conf(const libconfig::Setting& setting) {
 
         // configured redirect, pass following configure
         roo::log_warning("redirect %s configure ok for host %s",
-                         conf_ptr_->redirect_str_.c_str(), hostname_.c_str());
+                         conf_ptr->redirect_str_.c_str(), hostname_.c_str());
 
-        // redirect 虚拟主机只需要这个配置就可以了
+        // redirect 虚拟主机只需要这个配置就可以了，但快照仍然需要发布
+        conf_.store(conf_ptr);
         return true;
 
 
@@ -464,11 +1132,11 @@ bool HttpExecutor::handle_virtual_host_conf(const libconfig::Setting& setting) {
         }
 
 
-        conf_ptr_->http_docu_root_ = docu_root_str;
-        conf_ptr_->http_docu_index_ = docu_index;
+        conf_ptr->http_docu_root_ = docu_root_str;
+        conf_ptr->http_docu_index_ = docu_index;
 
         roo::log_info("docu_root: %s, index items: %lu",
-                      conf_ptr_->http_docu_root_.c_str(), conf_ptr_->http_docu_index_.size());
+                      conf_ptr->http_docu_root_.c_str(), conf_ptr->http_docu_index_.size());
 
         // fall throught following configure
 
@@ -520,23 +1188,23 @@ bool HttpExecutor::handle_virtual_host_conf(const libconfig::Setting& setting) {
                     if (tmp.empty())
                         continue;
 
-                    conf_ptr_->cache_controls_[tmp] = ctrl_head;
+                    conf_ptr->cache_controls_[tmp] = ctrl_head;
                 }
             }
         }
 
         // total display
         roo::log_info("total %d cache ctrl for vhost %s",
-                      static_cast<int>(conf_ptr_->cache_controls_.size()), hostname_.c_str());
-        for (auto iter = conf_ptr_->cache_controls_.begin(); iter != conf_ptr_->cache_controls_.end(); ++iter) {
+                      static_cast<int>(conf_ptr->cache_controls_.size()), hostname_.c_str());
+        for (auto iter = conf_ptr->cache_controls_.begin(); iter != conf_ptr->cache_controls_.end(); ++iter) {
             roo::log_info("%s => %s", iter->first.c_str(), iter->second.c_str());
         }
     }
 
     // basic_auth
     if (setting.exists("basic_auth")) {
-        conf_ptr_->http_auth_.reset(new BasicAuth());
-        if (!conf_ptr_->http_auth_ || !conf_ptr_->http_auth_->init(setting, true)) {
+        conf_ptr->http_auth_.reset(new BasicAuth());
+        if (!conf_ptr->http_auth_ || !conf_ptr->http_auth_->init(setting, true)) {
             roo::log_err("init basic_auth for vhost %s failed.", hostname_.c_str());
             return false;
         }
@@ -554,41 +1222,65 @@ bool HttpExecutor::handle_virtual_host_conf(const libconfig::Setting& setting) {
             if (tmp.empty())
                 continue;
 
-            conf_ptr_->compress_controls_.insert(tmp);
+            conf_ptr->compress_controls_.insert(tmp);
         }
 
         roo::log_info("total %d compress ctrl for vhost %s",
-                      static_cast<int>(conf_ptr_->compress_controls_.size()), hostname_.c_str());
+                      static_cast<int>(conf_ptr->compress_controls_.size()), hostname_.c_str());
+    }
+
+    if (setting.exists("etag_control")) {
+
+        std::string uris{};
+        setting.lookupValue("etag_control", uris);
+
+        std::vector<std::string> vec{};
+        boost::split(vec, uris, boost::is_any_of(";"));
+        for (auto iter = vec.begin(); iter != vec.cend(); ++iter) {
+            std::string tmp = boost::trim_copy(*iter);
+            if (tmp.empty())
+                continue;
+
+            conf_ptr->etag_controls_.push_back(roo::UriRegex(roo::StrUtil::pure_uri_path(tmp)));
+        }
+
+        roo::log_info("total %d etag ctrl for vhost %s",
+                      static_cast<int>(conf_ptr->etag_controls_.size()), hostname_.c_str());
+    }
+
+    if (!load_static_cache(setting, conf_ptr->http_docu_root_,
+                           std::shared_ptr<StaticCache>(), conf_ptr->static_cache_)) {
+        roo::log_err("init static_cache for vhost %s failed.", hostname_.c_str());
+        return false;
     }
 
+    load_meta_cache(setting, std::shared_ptr<FileMetaCache>(), conf_ptr->meta_cache_);
+
+    conf_.store(conf_ptr);
     return true;
 }
 
 bool HttpExecutor::exist_handler(const std::string& uri_regex, enum HTTP_METHOD method) {
 
     std::string uri = roo::StrUtil::pure_uri_path(uri_regex);
-    boost::shared_lock<boost::shared_mutex> rlock(rwlock_);
-
-    std::vector<std::pair<roo::UriRegex, HttpHandlerObjectPtr>>::iterator it;
-    for (it = handlers_.begin(); it != handlers_.end(); ++it) {
+    RcuReadGuard guard;
 
-        if (it->first.str() == uri) {
-
-            if (method == HTTP_METHOD::GET && it->second->http_get_handler_) {
-                return true;
-            } else if (method == HTTP_METHOD::POST && it->second->http_post_handler_) {
-                return true;
-            } else if (method == HTTP_METHOD::ALL && (it->second->http_get_handler_ || it->second->http_post_handler_)) {
-                return true;
-            }
+    HttpHandlerObjectPtr handler = router_.get()->find(uri);
+    if (!handler) {
+        return false;
+    }
 
-            roo::log_err("Confused request: %s, handler method: GET %s, POST %s", uri_regex.c_str(),
-                         it->second->http_get_handler_ ? "YES" : "NO",
-                         it->second->http_post_handler_ ? "YES" : "NO");
-            return false;
-        }
+    if (method == HTTP_METHOD::GET && handler->has_get_handler()) {
+        return true;
+    } else if (method == HTTP_METHOD::POST && handler->has_post_handler()) {
+        return true;
+    } else if (method == HTTP_METHOD::ALL && (handler->has_get_handler() || handler->has_post_handler())) {
+        return true;
     }
 
+    roo::log_err("Confused request: %s, handler method: GET %s, POST %s", uri_regex.c_str(),
+                 handler->has_get_handler() ? "YES" : "NO",
+                 handler->has_post_handler() ? "YES" : "NO");
     return false;
 }
 
@@ -596,73 +1288,88 @@ bool HttpExecutor::exist_handler(const std::string& uri_regex, enum HTTP_METHOD
 int HttpExecutor::drop_handler(const std::string& uri_regex, enum HTTP_METHOD method) {
 
     std::string uri = roo::StrUtil::pure_uri_path(uri_regex);
-    boost::lock_guard<boost::shared_mutex> wlock(rwlock_);
-
-    std::vector<std::pair<roo::UriRegex, HttpHandlerObjectPtr>>::iterator it;
-    for (it = handlers_.begin(); it != handlers_.end(); ++it) {
-        if (it->first.str() == uri) {
-            if (it->second->built_in_) {
-                roo::log_err("can not drop built_in hander ");
-                return -1;
-            }
+    std::lock_guard<std::mutex> lock(router_lock_);
 
-            // 删除的时候先检测剩余的handler是否存在，如果存在就直接删除当前method的
-            // 否则就fall through删除整个object
-            if (method == HTTP_METHOD::GET) {
-                roo::log_warning("drop get handler for host %s, uri: %s", hostname_.c_str(),  uri.c_str());
-                if (it->second->http_post_handler_) {
-                    it->second->http_get_handler_ = HttpGetHandler();  // empty
-                    SAFE_ASSERT(it->second->http_get_handler_);
-                    return 0;
-                }
-            } else if (method == HTTP_METHOD::POST) {
-                roo::log_warning("drop post handler for host %s, uri: %s", hostname_.c_str(),  uri.c_str());
-                if (it->second->http_get_handler_) {
-                    it->second->http_post_handler_ = HttpPostHandler();  // empty
-                    SAFE_ASSERT(it->second->http_post_handler_);
-                    return 0;
-                }
-            }
+    std::shared_ptr<HttpRouter> router(new HttpRouter(*router_.load_shared()));
+    HttpHandlerObjectPtr handler = router->find(uri);
+    if (!handler) {
+        roo::log_warning("handler for host %s, uri: %s not found!", hostname_.c_str(),  uri.c_str());
+        return -1;
+    }
 
-            roo::log_warning("remove whole handler object for host %s, uri: %s!", hostname_.c_str(),  uri.c_str());
-            handlers_.erase(it);
+    if (handler->built_in_) {
+        roo::log_err("can not drop built_in hander ");
+        return -1;
+    }
 
+    // 删除的时候先检测剩余的handler是否存在，如果存在就直接删除当前method的
+    // 否则就fall through删除整个object
+    if (method == HTTP_METHOD::GET) {
+        roo::log_warning("drop get handler for host %s, uri: %s", hostname_.c_str(),  uri.c_str());
+        if (handler->has_post_handler()) {
+            auto updated = std::make_shared<HttpHandlerObject>(*handler);
+            updated->update_get_handler(HttpGetHandler());  // empty
+            SAFE_ASSERT(!updated->has_get_handler());
+            router->update(uri, updated);
+            store_router(router);
+            return 0;
+        }
+    } else if (method == HTTP_METHOD::POST) {
+        roo::log_warning("drop post handler for host %s, uri: %s", hostname_.c_str(),  uri.c_str());
+        if (handler->has_get_handler()) {
+            auto updated = std::make_shared<HttpHandlerObject>(*handler);
+            updated->update_post_handler(HttpPostHandler());  // empty
+            SAFE_ASSERT(!updated->has_post_handler());
+            router->update(uri, updated);
+            store_router(router);
             return 0;
         }
     }
 
-    roo::log_warning("handler for host %s, uri: %s not found!", hostname_.c_str(),  uri.c_str());
-    return -1;
+    roo::log_warning("remove whole handler object for host %s, uri: %s!", hostname_.c_str(),  uri.c_str());
+    router->remove(uri);
+    store_router(router);
+
+    return 0;
 }
 
 
 
-int HttpExecutor::add_get_handler(const std::string& uri_regex, const HttpGetHandler& handler, bool built_in) {
+int HttpExecutor::add_get_handler(const std::string& uri_regex, const HttpGetHandler& handler,
+                                  bool built_in, bool run_inline) {
 
     std::string uri = roo::StrUtil::pure_uri_path(uri_regex);
-    boost::lock_guard<boost::shared_mutex> wlock(rwlock_);
-
-    std::vector<std::pair<roo::UriRegex, HttpHandlerObjectPtr>>::iterator it;
-    for (it = handlers_.begin(); it != handlers_.end(); ++it) {
-        if (it->first.str() == uri) {
-            roo::log_info("hostname:%s GetHandler for %s(%s) already exists, update it!",
-                          hostname_.c_str(), uri.c_str(), uri_regex.c_str());
-            it->second->update_get_handler(handler);
-            return 0;
-        }
+    std::lock_guard<std::mutex> lock(router_lock_);
+
+    // 已经发布的路由表和handler对象都是只读的，修改的时候拷贝一份再整体替换
+    std::shared_ptr<HttpRouter> router(new HttpRouter(*router_.load_shared()));
+    HttpHandlerObjectPtr exist = router->find(uri);
+    if (exist) {
+        roo::log_info("hostname:%s GetHandler for %s(%s) already exists, update it!",
+                      hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+        auto updated = std::make_shared<HttpHandlerObject>(*exist);
+        updated->update_get_handler(handler, run_inline);
+        router->update(uri, updated);
+        store_router(router);
+        return 0;
     }
 
     roo::log_info("hostname:%s GetHandler for %s(%s) does not exists, create it!",
                   hostname_.c_str(), uri.c_str(), uri_regex.c_str());
-    roo::UriRegex rgx{uri};
     auto phandler_obj = std::make_shared<HttpHandlerObject>(uri, handler, built_in);
     if (!phandler_obj) {
         roo::log_err("hostname:%s Create Handler object for %s(%s) failed.",
                      hostname_.c_str(), uri.c_str(), uri_regex.c_str());
         return -1;
     }
+    phandler_obj->http_get_inline_ = run_inline;
 
-    handlers_.push_back({ rgx, phandler_obj });
+    if (!router->add(uri, phandler_obj)) {
+        roo::log_err("hostname:%s add route for %s(%s) failed.",
+                     hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+        return -1;
+    }
+    store_router(router);
 
     roo::log_warning("hostname:%s register_http_get_handler for %s(%s) OK!",
                      hostname_.c_str(), uri.c_str(), uri_regex.c_str());
@@ -670,45 +1377,143 @@ int HttpExecutor::add_get_handler(const std::string& uri_regex, const HttpGetHan
 }
 
 
-int HttpExecutor::add_post_handler(const std::string& uri_regex, const HttpPostHandler& handler, bool built_in) {
+int HttpExecutor::add_post_handler(const std::string& uri_regex, const HttpPostHandler& handler,
+                                   bool built_in, bool run_inline) {
 
     std::string uri = roo::StrUtil::pure_uri_path(uri_regex);
-    boost::lock_guard<boost::shared_mutex> wlock(rwlock_);
-
-    std::vector<std::pair<roo::UriRegex, HttpHandlerObjectPtr>>::iterator it;
-    for (it = handlers_.begin(); it != handlers_.end(); ++it) {
-        if (it->first.str() == uri) {
-            roo::log_info("hostname:%s PostHandler for %s(%s) already exists, update it!",
-                          hostname_.c_str(), uri.c_str(), uri_regex.c_str());
-            it->second->update_post_handler(handler);
-            return 0;
-        }
+    std::lock_guard<std::mutex> lock(router_lock_);
+
+    // 已经发布的路由表和handler对象都是只读的，修改的时候拷贝一份再整体替换
+    std::shared_ptr<HttpRouter> router(new HttpRouter(*router_.load_shared()));
+    HttpHandlerObjectPtr exist = router->find(uri);
+    if (exist) {
+        roo::log_info("hostname:%s PostHandler for %s(%s) already exists, update it!",
+                      hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+        auto updated = std::make_shared<HttpHandlerObject>(*exist);
+        updated->update_post_handler(handler, run_inline);
+        router->update(uri, updated);
+        store_router(router);
+        return 0;
     }
 
     roo::log_info("hostname:%s PostHandler for %s(%s) does not exists, create it!",
                   hostname_.c_str(), uri.c_str(), uri_regex.c_str());
-    roo::UriRegex rgx{uri};
     auto phandler_obj = std::make_shared<HttpHandlerObject>(uri, handler, built_in);
     if (!phandler_obj) {
         roo::log_err("hostname:%s Create Handler object for %s(%s) failed.",
                      hostname_.c_str(), uri.c_str(), uri_regex.c_str());
         return -1;
     }
+    phandler_obj->http_post_inline_ = run_inline;
 
-    handlers_.push_back({ rgx, phandler_obj });
+    if (!router->add(uri, phandler_obj)) {
+        roo::log_err("hostname:%s add route for %s(%s) failed.",
+                     hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+        return -1;
+    }
+    store_router(router);
 
     roo::log_warning("hostname:%s register_http_post_handler for %s(%s) OK!",
                      hostname_.c_str(), uri.c_str(), uri_regex.c_str());
     return 0;
 }
 
-bool HttpExecutor::pass_basic_auth(const std::string& uri, const std::string auth_str) {
+int HttpExecutor::add_async_get_handler(const std::string& uri_regex, const HttpAsyncGetHandler& handler,
+                                        bool built_in, bool run_inline) {
 
-    std::shared_ptr<HttpExecutorConf> conf_ptr;
-    {
-        std::unique_lock<std::mutex> lock(conf_lock_);
-        conf_ptr = conf_ptr_;
+    std::string uri = roo::StrUtil::pure_uri_path(uri_regex);
+    std::lock_guard<std::mutex> lock(router_lock_);
+
+    std::shared_ptr<HttpRouter> router(new HttpRouter(*router_.load_shared()));
+    HttpHandlerObjectPtr exist = router->find(uri);
+    if (exist) {
+        roo::log_info("hostname:%s AsyncGetHandler for %s(%s) already exists, update it!",
+                      hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+        auto updated = std::make_shared<HttpHandlerObject>(*exist);
+        updated->update_async_get_handler(handler, run_inline);
+        router->update(uri, updated);
+        store_router(router);
+        return 0;
+    }
+
+    auto phandler_obj = std::make_shared<HttpHandlerObject>(uri, HttpGetHandler(), built_in);
+    if (!phandler_obj) {
+        roo::log_err("hostname:%s Create Handler object for %s(%s) failed.",
+                     hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+        return -1;
+    }
+    phandler_obj->update_async_get_handler(handler, run_inline);
+
+    if (!router->add(uri, phandler_obj)) {
+        roo::log_err("hostname:%s add route for %s(%s) failed.",
+                     hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+        return -1;
+    }
+    store_router(router);
+
+    roo::log_warning("hostname:%s register_http_async_get_handler for %s(%s) OK!",
+                     hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+    return 0;
+}
+
+int HttpExecutor::add_async_post_handler(const std::string& uri_regex, const HttpAsyncPostHandler& handler,
+                                         bool built_in, bool run_inline) {
+
+    std::string uri = roo::StrUtil::pure_uri_path(uri_regex);
+    std::lock_guard<std::mutex> lock(router_lock_);
+
+    std::shared_ptr<HttpRouter> router(new HttpRouter(*router_.load_shared()));
+    HttpHandlerObjectPtr exist = router->find(uri);
+    if (exist) {
+        roo::log_info("hostname:%s AsyncPostHandler for %s(%s) already exists, update it!",
+                      hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+        auto updated = std::make_shared<HttpHandlerObject>(*exist);
+        updated->update_async_post_handler(handler, run_inline);
+        router->update(uri, updated);
+        store_router(router);
+        return 0;
+    }
+
+    auto phandler_obj = std::make_shared<HttpHandlerObject>(uri, HttpPostHandler(), built_in);
+    if (!phandler_obj) {
+        roo::log_err("hostname:%s Create Handler object for %s(%s) failed.",
+                     hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+        return -1;
+    }
+    phandler_obj->update_async_post_handler(handler, run_inline);
+
+    if (!router->add(uri, phandler_obj)) {
+        roo::log_err("hostname:%s add route for %s(%s) failed.",
+                     hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+        return -1;
     }
+    store_router(router);
+
+    roo::log_warning("hostname:%s register_http_async_post_handler for %s(%s) OK!",
+                     hostname_.c_str(), uri.c_str(), uri_regex.c_str());
+    return 0;
+}
+
+// 调用者持有router_lock_
+void HttpExecutor::store_router(const std::shared_ptr<HttpRouter>& router) {
+
+    bool has_inline = false;
+    const std::vector<HttpRouter::Route>& routes = router->routes();
+    for (auto iter = routes.begin(); iter != routes.end(); ++iter) {
+        if (iter->handler_->http_get_inline_ || iter->handler_->http_post_inline_) {
+            has_inline = true;
+            break;
+        }
+    }
+
+    router_.store(router);
+    has_inline_handler_.store(has_inline);
+}
+
+bool HttpExecutor::pass_basic_auth(const std::string& uri, const std::string auth_str) {
+
+    RcuReadGuard guard;
+    const HttpExecutorConf* conf_ptr = conf_.get();
 
     if (!conf_ptr->http_auth_) {
         return true;
@@ -720,40 +1525,35 @@ bool HttpExecutor::pass_basic_auth(const std::string& uri, const std::string aut
 
 int HttpExecutor::do_find_handler(const enum HTTP_METHOD& method,
                                   const std::string& uri,
-                                  HttpHandlerObjectPtr& handler) {
+                                  HttpHandlerObject*& handler,
+                                  PathParamContainer* params) {
 
     if (redirect_handler_) {
         roo::log_info("redirect handler found, will do redirect.");
-        handler = redirect_handler_;
+        handler = redirect_handler_.get();
         return 0;
     }
 
-    std::string n_uri = roo::StrUtil::pure_uri_path(uri);
+    HttpHandlerObject* matched = router_.get()->match(uri, params);
 
-    boost::shared_lock<boost::shared_mutex> rlock(rwlock_);
-
-    std::vector<std::pair<roo::UriRegex, HttpHandlerObjectPtr>>::const_iterator it;
-    boost::smatch what;
-    for (it = handlers_.cbegin(); it != handlers_.cend(); ++it) {
-        if (boost::regex_match(uri, what, it->first)) {
-            if (method == HTTP_METHOD::GET && it->second->http_get_handler_) {
-                handler = it->second;
-                return 0;
-            } else if (method == HTTP_METHOD::POST && it->second->http_post_handler_) {
-                handler = it->second;
-                return 0;
-            } else {
-                roo::log_err("uri: %s matched, but no suitable handler for method: %s",
-                             uri.c_str(), HTTP_METHOD_STRING(method).c_str());
-                return -1;
-            }
+    if (matched) {
+        if (method == HTTP_METHOD::GET && matched->has_get_handler()) {
+            handler = matched;
+            return 0;
+        } else if (method == HTTP_METHOD::POST && matched->has_post_handler()) {
+            handler = matched;
+            return 0;
+        } else {
+            roo::log_err("uri: %s matched, but no suitable handler for method: %s",
+                         uri.c_str(), HTTP_METHOD_STRING(method).c_str());
+            return -1;
         }
     }
 
     if (method == HTTP_METHOD::GET) {
         roo::log_info("[hostname:%s] http get default handler (filesystem) for %s ",
                       hostname_.c_str(), uri.c_str());
-        handler = default_get_handler_;
+        handler = default_get_handler_.get();
         return 0;
     }
 
@@ -765,11 +1565,8 @@ int HttpExecutor::http_redirect_handler(
     std::string& response,
     std::string& status_line, std::vector<std::string>& add_header) {
 
-    std::shared_ptr<HttpExecutorConf> conf_ptr;
-    {
-        std::unique_lock<std::mutex> lock(conf_lock_);
-        conf_ptr = conf_ptr_;
-    }
+    RcuReadGuard guard;
+    const HttpExecutorConf* conf_ptr = conf_.get();
 
     if (conf_ptr->redirect_code_ == "301") {
         status_line = generate_response_status_line(http_parser.get_version(),
@@ -799,17 +1596,92 @@ void HttpExecutor::handle_http_request(std::shared_ptr<HttpReqInstance> http_req
         return;
     }
 
-    HttpHandlerObjectPtr handler_object{};
-    if (do_find_handler(http_req_instance->method_,  http_req_instance->uri_, handler_object) != 0) {
-        roo::log_err("find handler for %s, %s failed.",
-                     HTTP_METHOD_STRING(http_req_instance->method_).c_str(),
-                     http_req_instance->uri_.c_str());
-        http_req_instance->http_std_response(http_proto::StatusCode::client_error_not_found);
-        return;
+    // 工作线程上的handler可能执行很久，而RCU的回收要等待最早的活跃读者，
+    // 所以只在路由查找期间处于临界区，之后持有handler对象的引用执行
+    HttpHandlerObjectPtr handler_ptr;
+    PathParamContainer path_params;
+    int timeout_ms = 0;
+
+    {
+        RcuReadGuard guard;
+
+        HttpHandlerObject* handler_object = NULL;
+        if (do_find_handler(http_req_instance->method_,  http_req_instance->uri_, handler_object, &path_params) != 0) {
+            roo::log_err("find handler for %s, %s failed.",
+                         HTTP_METHOD_STRING(http_req_instance->method_).c_str(),
+                         http_req_instance->uri_.c_str());
+            http_req_instance->http_std_response(http_proto::StatusCode::client_error_not_found);
+            return;
+        }
+        handler_ptr = handler_object->shared_from_this();
+
+        const HttpExecutorConf* conf_ptr = conf_.get();
+        timeout_ms = conf_ptr->executor_conf_.exec_queue_timeout_ms_;
+        if (!conf_ptr->queue_timeouts_.empty()) {
+            auto iter = conf_ptr->queue_timeouts_.find(handler_object->path_);
+            if (iter != conf_ptr->queue_timeouts_.end()) {
+                timeout_ms = iter->second;
+            }
+        }
+    }
+
+    // 排队超过预算的请求，客户端很可能已经放弃了，不再执行而是快速返回503
+    if (timeout_ms > 0) {
+        uint64_t waited_ns = HttpReqInstance::monotonic_ns() - http_req_instance->enqueue_ns_;
+        if (waited_ns > static_cast<uint64_t>(timeout_ms) * 1000 * 1000) {
+            queue_timeout_count_++;
+            roo::log_err("request %s waited %lums in queue, exceed budget %dms, reject it.",
+                         http_req_instance->uri_.c_str(),
+                         static_cast<unsigned long>(waited_ns / (1000 * 1000)), timeout_ms);
+            http_req_instance->http_std_response(http_proto::StatusCode::server_error_service_unavailable);
+            return;
+        }
+    }
+
+    do_handle_http_request(http_req_instance, handler_ptr.get(), path_params);
+}
+
+// OPTIONS以及路由到内联handler的请求直接在IO线程中处理完成，其他的交给工作线程
+// 重定向的时候所有请求都由redirect_handler_处理，不内联
+bool HttpExecutor::handle_http_request_inline(std::shared_ptr<HttpReqInstance> http_req_instance) {
+
+    if (http_req_instance->method_ == HTTP_METHOD::OPTIONS) {
+        http_req_instance->http_std_response(http_proto::StatusCode::success_no_content);
+        return true;
+    }
+
+    if (!has_inline_handler_.load(std::memory_order_relaxed) || redirect_handler_) {
+        return false;
     }
 
+    RcuReadGuard guard;
+
+    PathParamContainer path_params;
+    HttpHandlerObject* handler_object = router_.get()->match(http_req_instance->uri_, &path_params);
+    if (!handler_object) {
+        return false;
+    }
+
+    if (!(http_req_instance->method_ == HTTP_METHOD::GET && handler_object->http_get_inline_) &&
+        !(http_req_instance->method_ == HTTP_METHOD::POST && handler_object->http_post_inline_)) {
+        return false;
+    }
+
+    do_handle_http_request(http_req_instance, handler_object, path_params);
+    return true;
+}
+
+// 调用者需要保证handler_object有效: 处于RcuReadGuard的保护下，或者持有它的引用
+void HttpExecutor::do_handle_http_request(std::shared_ptr<HttpReqInstance> http_req_instance,
+                                          HttpHandlerObject* handler_object, PathParamContainer& path_params) {
+
     SAFE_ASSERT(handler_object);
 
+    // uri就是解析出来的path_info，捕获参数的偏移可以直接用在HttpParser上
+    if (!path_params.empty()) {
+        http_req_instance->http_parser_->set_request_path_params(path_params);
+    }
+
     // AUTH CHECK
     if (!pass_basic_auth(http_req_instance->uri_,
                          http_req_instance->http_parser_->find_request_header(http_proto::header_options::auth))) {
@@ -820,7 +1692,15 @@ void HttpExecutor::handle_http_request(std::shared_ptr<HttpReqInstance> http_req
 
     if (http_req_instance->method_ == HTTP_METHOD::GET) {
 
-        HttpGetHandler handler = handler_object->http_get_handler_;
+        // 异步handler返回之后就不再关心，由其持有的responder完成响应
+        if (handler_object->http_async_get_handler_) {
+            std::shared_ptr<HttpResponder> responder = std::make_shared<HttpResponder>(http_req_instance);
+            handler_object->http_async_get_handler_(*http_req_instance->http_parser_, responder);
+            handler_object->success_count_++;
+            return;
+        }
+
+        const HttpGetHandler& handler = handler_object->http_get_handler_;
         if (!handler) {
             http_req_instance->http_std_response(http_proto::StatusCode::server_error_internal_server_error);
             return;
@@ -829,10 +1709,21 @@ void HttpExecutor::handle_http_request(std::shared_ptr<HttpReqInstance> http_req
         std::string response_str;
         std::string status_str;
         std::vector<std::string> headers;
+        SendSegment body;
         int code = 0;
 
         {
-            code = handler(*http_req_instance->http_parser_, response_str, status_str, headers);
+            // 默认的静态文件handler直接返回文件或者缓存的内容，不拷贝
+            if (handler_object == default_get_handler_.get()) {
+                code = static_file_handler(*http_req_instance->http_parser_, response_str, status_str, headers, body);
+            } else {
+                code = handler(*http_req_instance->http_parser_, response_str, status_str, headers);
+                if (code == 0) {
+                    handler_conditional_get(*http_req_instance->http_parser_, http_req_instance->uri_,
+                                            response_str, status_str, headers);
+                }
+            }
+
             if (code == 0) {
                 handler_object->success_count_++;
             } else {
@@ -840,6 +1731,14 @@ void HttpExecutor::handle_http_request(std::shared_ptr<HttpReqInstance> http_req
             }
         }
 
+        if (!body.empty()) {
+            SAFE_ASSERT(!status_str.empty());
+            std::vector<SendSegment> segments;
+            static_file_range(*http_req_instance->http_parser_, status_str, headers, body, segments);
+            http_req_instance->http_body_response(segments, status_str, headers);
+            return;
+        }
+
         {
             // status_line 为必须返回参数，如果没有就按照调用结果返回标准内容
             if (status_str.empty()) {
@@ -860,7 +1759,15 @@ void HttpExecutor::handle_http_request(std::shared_ptr<HttpReqInstance> http_req
 
     } else if (http_req_instance->method_ == HTTP_METHOD::POST) {
 
-        HttpPostHandler handler = handler_object->http_post_handler_;
+        if (handler_object->http_async_post_handler_) {
+            std::shared_ptr<HttpResponder> responder = std::make_shared<HttpResponder>(http_req_instance);
+            handler_object->http_async_post_handler_(*http_req_instance->http_parser_, http_req_instance->data_,
+                                                     responder);
+            handler_object->success_count_++;
+            return;
+        }
+
+        const HttpPostHandler& handler = handler_object->http_post_handler_;
         if (!handler) {
             http_req_instance->http_std_response(http_proto::StatusCode::server_error_internal_server_error);
             return;
@@ -915,11 +1822,8 @@ void HttpExecutor::handle_http_request(std::shared_ptr<HttpReqInstance> http_req
 
 int HttpExecutor::module_status(std::string& module, std::string& key, std::string& value) {
 
-    std::shared_ptr<HttpExecutorConf> conf_ptr;
-    {
-        std::unique_lock<std::mutex> lock(conf_lock_);
-        conf_ptr = conf_ptr_;
-    }
+    RcuReadGuard guard;
+    const HttpExecutorConf* conf_ptr = conf_.get();
 
     std::stringstream ss;
 
@@ -939,11 +1843,18 @@ int HttpExecutor::module_status(std::string& module, std::string& key, std::stri
     ss << std::endl;
 
     ss << "\t" << "register_handler: " << std::endl;
-    for (auto iter = handlers_.begin(); iter != handlers_.end(); ++iter) {
-        auto handlerObj = iter->second;
-        ss << "\t\t" << "path: " << handlerObj->path_;
-        ss         << ", method: " << (handlerObj->http_get_handler_ ? "GET " : "");
-        ss                       << (handlerObj->http_post_handler_ ? "POST " : "");
+    const std::vector<HttpRouter::Route>& routes = router_.get()->routes();
+    for (auto iter = routes.begin(); iter != routes.end(); ++iter) {
+        auto handlerObj = iter->handler_;
+        ss << "\t\t" << "path: " << handlerObj->path_ << ", method: ";
+        if (handlerObj->has_get_handler()) {
+            ss << "GET" << (handlerObj->http_async_get_handler_ ? "(async)" : "")
+               << (handlerObj->http_get_inline_ ? "(inline)" : "") << " ";
+        }
+        if (handlerObj->has_post_handler()) {
+            ss << "POST" << (handlerObj->http_async_post_handler_ ? "(async)" : "")
+               << (handlerObj->http_post_inline_ ? "(inline)" : "") << " ";
+        }
         ss << std::endl;
     }
 
@@ -963,6 +1874,30 @@ int HttpExecutor::module_status(std::string& module, std::string& key, std::stri
         ss << std::endl;
     }
 
+    if (!conf_ptr->etag_controls_.empty()) {
+        ss << "\t" << "etag_control: ";
+        for (auto iter = conf_ptr->etag_controls_.begin(); iter != conf_ptr->etag_controls_.end(); ++iter) {
+            ss << iter->str() << ", ";
+        }
+        ss << std::endl;
+    }
+
+    if (conf_ptr->static_cache_) {
+        ss << "\t" << "static_cache: " << conf_ptr->static_cache_->status() << std::endl;
+    }
+
+    if (conf_ptr->meta_cache_) {
+        ss << "\t" << "file_meta_cache: " << conf_ptr->meta_cache_->status() << std::endl;
+    }
+
+    if (!conf_ptr->queue_timeouts_.empty()) {
+        ss << "\t" << "queue_timeout_control: " << std::endl;
+        for (auto iter = conf_ptr->queue_timeouts_.begin(); iter != conf_ptr->queue_timeouts_.end(); ++iter) {
+            ss << "\t\t" << iter->first << " : " << iter->second << "ms" << std::endl;
+        }
+    }
+    ss << "\t" << "queue_timeout_count: " << queue_timeout_count_ << std::endl;
+
     value = ss.str();
     return 0;
 }
@@ -974,6 +1909,10 @@ int HttpExecutor::module_status(std::string& module, std::string& key, std::stri
 // 3. basic_auth
 // 4. compress_control
 // 5. cache_control
+// 6. static_cache
+// 7. etag_control
+// 8. file_meta_cache
+// 9. queue_timeout_control
 
 int HttpExecutor::handle_virtual_host_runtime_conf(const libconfig::Setting& setting) {
 
@@ -994,6 +1933,8 @@ int HttpExecutor::handle_virtual_host_runtime_conf(const libconfig::Setting& set
     setting.lookupValue("exec_thread_pool_size", conf_ptr->executor_conf_.exec_thread_number_);
     setting.lookupValue("exec_thread_pool_size_hard", conf_ptr->executor_conf_.exec_thread_number_hard_);
     setting.lookupValue("exec_thread_pool_step_queue_size", conf_ptr->executor_conf_.exec_thread_step_queue_size_);
+    setting.lookupValue("exec_thread_pool_work_stealing", conf_ptr->executor_conf_.exec_work_stealing_);
+    load_queue_control(setting, conf_ptr->executor_conf_, conf_ptr->queue_timeouts_);
 
     // 检查ExecutorConf参数合法性
     if (conf_ptr->executor_conf_.exec_thread_number_hard_ < conf_ptr->executor_conf_.exec_thread_number_) {
@@ -1044,7 +1985,7 @@ int HttpExecutor::handle_virtual_host_runtime_conf(const libconfig::Setting& set
         {
             // do swap here
             std::unique_lock<std::mutex> lock(conf_lock_);
-            conf_ptr_.swap(conf_ptr);
+            conf_.store(conf_ptr);
         }
 
         // redirect 虚拟主机只需要这个配置就可以了
@@ -1154,10 +2095,54 @@ int HttpExecutor::handle_virtual_host_runtime_conf(const libconfig::Setting& set
                       static_cast<int>(conf_ptr->compress_controls_.size()), hostname_.c_str());
     }
 
+    if (setting.exists("etag_control")) {
+
+        std::string uris{};
+        setting.lookupValue("etag_control", uris);
+
+        std::vector<std::string> vec{};
+        boost::split(vec, uris, boost::is_any_of(";"));
+        for (auto iter = vec.begin(); iter != vec.cend(); ++iter) {
+            std::string tmp = boost::trim_copy(*iter);
+            if (tmp.empty())
+                continue;
+
+            conf_ptr->etag_controls_.push_back(roo::UriRegex(roo::StrUtil::pure_uri_path(tmp)));
+        }
+
+        roo::log_info("total %d etag ctrl for vhost %s",
+                      static_cast<int>(conf_ptr->etag_controls_.size()), hostname_.c_str());
+    }
+
+    {
+        std::shared_ptr<StaticCache> previous;
+        std::shared_ptr<FileMetaCache> previous_meta;
+        std::string previous_root;
+        {
+            std::shared_ptr<HttpExecutorConf> current = conf_.load_shared();
+            if (current) {
+                previous = current->static_cache_;
+                previous_meta = current->meta_cache_;
+                previous_root = current->http_docu_root_;
+            }
+        }
+
+        // 缓存创建失败不影响服务，只是退化为直接读取文件
+        if (!load_static_cache(setting, conf_ptr->http_docu_root_, previous, conf_ptr->static_cache_)) {
+            roo::log_err("update static_cache for vhost %s failed.", hostname_.c_str());
+        }
+
+        // 根目录变化了，之前解析的路径都不能再用
+        if (previous_meta && conf_ptr->http_docu_root_ != previous_root) {
+            previous_meta.reset();
+        }
+        load_meta_cache(setting, previous_meta, conf_ptr->meta_cache_);
+    }
+
     {
         // do swap here
         std::unique_lock<std::mutex> lock(conf_lock_);
-        conf_ptr_.swap(conf_ptr);
+        conf_.store(conf_ptr);
     }
 
     return 0;
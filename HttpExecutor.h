@@ -20,11 +20,17 @@
 #include "HttpProto.h"
 #include "ServiceIf.h"
 #include "HttpHandler.h"
+#include "HttpRouter.h"
+#include "Rcu.h"
 
 
 namespace tzhttpd {
 
 class BasicAuth;
+class StaticCache;
+class FileMetaCache;
+struct StaticCacheEntry;
+struct SendSegment;
 
 class HttpExecutor : public ServiceIf {
 
@@ -34,30 +40,41 @@ public:
         hostname_(hostname),
         EMPTY_STRING(),
         conf_lock_(),
-        conf_ptr_(),
+        conf_(),
         default_get_handler_(),
         redirect_handler_(),
-        rwlock_(),
-        handlers_() {
+        router_lock_(),
+        router_(),
+        has_inline_handler_(false),
+        queue_timeout_count_(0) {
+        router_.store(std::make_shared<HttpRouter>());
     }
 
 
     bool init();
 
     void handle_http_request(std::shared_ptr<HttpReqInstance> http_req_instance)override;
+    bool handle_http_request_inline(std::shared_ptr<HttpReqInstance> http_req_instance)override;
 
     std::string instance_name()override {
         return hostname_;
     }
 
     ExecutorConf get_executor_conf() {
-        return conf_ptr_->executor_conf_;
+        RcuReadGuard guard;
+        return conf_.get()->executor_conf_;
     }
 
 
     // override
-    int add_get_handler(const std::string& uri_regex, const HttpGetHandler& handler, bool built_in)override;
-    int add_post_handler(const std::string& uri_regex, const HttpPostHandler& handler, bool built_in)override;
+    int add_get_handler(const std::string& uri_regex, const HttpGetHandler& handler,
+                        bool built_in, bool run_inline)override;
+    int add_post_handler(const std::string& uri_regex, const HttpPostHandler& handler,
+                         bool built_in, bool run_inline)override;
+    int add_async_get_handler(const std::string& uri_regex, const HttpAsyncGetHandler& handler,
+                              bool built_in, bool run_inline)override;
+    int add_async_post_handler(const std::string& uri_regex, const HttpAsyncPostHandler& handler,
+                               bool built_in, bool run_inline)override;
 
     bool exist_handler(const std::string& uri_regex, enum HTTP_METHOD method)override;
 
@@ -87,10 +104,16 @@ private:
     int handle_virtual_host_runtime_conf(const libconfig::Setting& setting);
 
 
-    // 路由选择算法
+    // 路由选择算法，必须在RcuReadGuard的保护下调用并使用返回的handler
+    // params返回路由中捕获的路径参数
     int do_find_handler(const enum HTTP_METHOD& method,
                         const std::string& uri,
-                        HttpHandlerObjectPtr& handler);
+                        HttpHandlerObject*& handler,
+                        PathParamContainer* params = NULL);
+
+    // 路由确定之后的处理：认证检查、调用handler并写回响应
+    void do_handle_http_request(std::shared_ptr<HttpReqInstance> http_req_instance,
+                                HttpHandlerObject* handler_object, PathParamContainer& path_params);
 
 private:
 
@@ -115,12 +138,25 @@ private:
         // 压缩控制
         std::set<std::string> compress_controls_;
 
+        // 对这些uri的GET响应计算ETag，支持条件请求
+        std::vector<roo::UriRegex> etag_controls_;
+
+        // 静态文件缓存，没有配置static_cache_size的时候为空
+        std::shared_ptr<StaticCache> static_cache_;
+
+        // 路径解析缓存，没有配置file_meta_cache_ttl_ms的时候为空
+        std::shared_ptr<FileMetaCache> meta_cache_;
+
         // 认证支持
-        std::unique_ptr<BasicAuth> http_auth_;
+        std::shared_ptr<BasicAuth> http_auth_;
+
+        // 特定路由的排队时间预算(毫秒)，键和路由表中的模式一致，覆盖exec_queue_timeout_ms
+        std::map<std::string, int> queue_timeouts_;
     };
 
+    // 请求路径上只读取发布的快照，conf_lock_串行化配置的更新
     std::mutex conf_lock_;
-    std::shared_ptr<HttpExecutorConf> conf_ptr_;
+    RcuPtr<HttpExecutorConf> conf_;
 
     bool pass_basic_auth(const std::string& uri, const std::string auth_str);
 
@@ -128,6 +164,20 @@ private:
     HttpHandlerObjectPtr default_get_handler_;
     int default_get_handler(const HttpParser& http_parser, std::string& response,
                             std::string& status_line, std::vector<std::string>& add_header);
+    int static_file_handler(const HttpParser& http_parser, std::string& response,
+                            std::string& status_line, std::vector<std::string>& add_header,
+                            SendSegment& body);
+    static bool static_file_headers(const HttpExecutorConf& conf, const std::string& suffix,
+                                    std::vector<std::string>& add_header);
+    int static_file_compress(const HttpParser& http_parser, const std::string& file_path,
+                             const std::shared_ptr<StaticCache>& cache, const std::string& cache_key,
+                             const std::shared_ptr<const StaticCacheEntry>& entry,
+                             std::string& response, std::string& status_line,
+                             std::vector<std::string>& add_header, SendSegment& body);
+
+    void handler_conditional_get(const HttpParser& http_parser, const std::string& uri,
+                                 std::string& response, std::string& status_line,
+                                 std::vector<std::string>& add_header);
 
     // 30x 重定向使用
     // http redirect part
@@ -137,9 +187,17 @@ private:
                               std::string& status_line, std::vector<std::string>& add_header);
 
 
-    // 使用vector保存handler，保证是先注册handler具有高优先级
-    boost::shared_mutex rwlock_;
-    std::vector<std::pair<roo::UriRegex, HttpHandlerObjectPtr>> handlers_;
+    // 路由表保证是先注册handler具有高优先级
+    // 请求路径上只读取发布的快照，修改的时候在router_lock_下拷贝修改之后整体替换
+    std::mutex router_lock_;
+    RcuPtr<HttpRouter> router_;
+
+    // 发布的路由表中是否有内联的handler，没有的时候IO线程不需要做任何路由匹配
+    std::atomic<bool> has_inline_handler_;
+
+    // 排队超过时间预算被直接拒绝的请求
+    std::atomic<uint64_t> queue_timeout_count_;
+    void store_router(const std::shared_ptr<HttpRouter>& router);
 
 };
 
@@ -16,6 +16,7 @@
 
 
 #include "HttpProto.h"
+#include "HttpResponder.h"
 
 namespace tzhttpd {
 
@@ -29,7 +30,16 @@ typedef std::function<int(const HttpParser& http_parser,\
 typedef std::function<int(const HttpParser& http_parser, const std::string& post_data,\
                               std::string& response, std::string& status_line, std::vector<std::string>& add_header)> HttpPostHandler;
 
-struct HttpHandlerObject {
+// 异步handler，不需要在返回之前完成响应，而是在之后(任何线程中)通过responder完成，
+// http_parser、post_data在持有responder期间一直有效
+typedef std::function<void(const HttpParser& http_parser,
+                           std::shared_ptr<HttpResponder> responder)> HttpAsyncGetHandler;
+typedef std::function<void(const HttpParser& http_parser, const std::string& post_data,
+                           std::shared_ptr<HttpResponder> responder)> HttpAsyncPostHandler;
+
+// 路由表中的handler对象，工作线程执行耗时的handler之前通过shared_from_this()持有引用，
+// 这样可以提前退出RCU临界区
+struct HttpHandlerObject : public std::enable_shared_from_this<HttpHandlerObject> {
 
     const std::string   path_;
 
@@ -38,16 +48,25 @@ struct HttpHandlerObject {
 
     bool                built_in_;       // built_in handler,无法被卸载更新
 
+    // 内联执行的handler直接在IO线程中运行并写回响应，不经过Executor的队列，
+    // 只适用于不会阻塞、微秒级别就能完成的处理
+    bool                http_get_inline_;
+    bool                http_post_inline_;
 
     HttpGetHandler      http_get_handler_;
     HttpPostHandler     http_post_handler_;
 
+    // 同一个方法同步和异步的handler只会有一个
+    HttpAsyncGetHandler  http_async_get_handler_;
+    HttpAsyncPostHandler http_async_post_handler_;
+
     HttpHandlerObject(const std::string& path,
                       const HttpGetHandler& get_handler,
                       bool built_in = false) :
         path_(path),
         success_count_(0), fail_count_(0),
         built_in_(built_in),
+        http_get_inline_(false), http_post_inline_(false),
         http_get_handler_(get_handler) {
     }
 
@@ -57,6 +76,7 @@ struct HttpHandlerObject {
         path_(path),
         success_count_(0), fail_count_(0),
         built_in_(built_in),
+        http_get_inline_(false), http_post_inline_(false),
         http_post_handler_(post_handler) {
     }
 
@@ -67,16 +87,41 @@ struct HttpHandlerObject {
         path_(path),
         success_count_(0), fail_count_(0),
         built_in_(built_in),
+        http_get_inline_(false), http_post_inline_(false),
         http_get_handler_(get_handler),
         http_post_handler_(post_handler) {
     }
 
-    void update_get_handler(const HttpGetHandler& get_handler) {
+    void update_get_handler(const HttpGetHandler& get_handler, bool run_inline = false) {
         http_get_handler_ = get_handler;
+        http_async_get_handler_ = HttpAsyncGetHandler();
+        http_get_inline_ = run_inline;
     }
 
-    void update_post_handler(const HttpPostHandler& post_handler) {
+    void update_post_handler(const HttpPostHandler& post_handler, bool run_inline = false) {
         http_post_handler_ = post_handler;
+        http_async_post_handler_ = HttpAsyncPostHandler();
+        http_post_inline_ = run_inline;
+    }
+
+    void update_async_get_handler(const HttpAsyncGetHandler& get_handler, bool run_inline = false) {
+        http_get_handler_ = HttpGetHandler();
+        http_async_get_handler_ = get_handler;
+        http_get_inline_ = run_inline;
+    }
+
+    void update_async_post_handler(const HttpAsyncPostHandler& post_handler, bool run_inline = false) {
+        http_post_handler_ = HttpPostHandler();
+        http_async_post_handler_ = post_handler;
+        http_post_inline_ = run_inline;
+    }
+
+    bool has_get_handler() const {
+        return http_get_handler_ || http_async_get_handler_;
+    }
+
+    bool has_post_handler() const {
+        return http_post_handler_ || http_async_post_handler_;
     }
 };
 
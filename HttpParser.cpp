@@ -12,10 +12,6 @@
 
 #include <boost/algorithm/string.hpp>
 
-// The GNU C++ standard library supports <regex>, but not until version 4.9.0.
-// (The headers were present in earlier versions, but were unusable.)
-#include <boost/regex.hpp>
-
 #include <container/PairVec.h>
 #include <other/Log.h>
 
@@ -23,25 +19,187 @@
 #include "HttpProto.h"
 
 #include "HttpParser.h"
+#include "HttpScanner.h"
 
 namespace tzhttpd {
 
+// 常用头部的完美哈希表
+// hash = (长度 + 7 * 首字符 + 尾字符) & 31，首尾字符忽略大小写，下面的参数保证
+// 这些头部互不冲突，哈希值直接作为槽位，查找的时候只需要一次比较确认。
+// 增加新的常用头部需要重新挑选参数，保证仍然没有冲突
+static const char* const kKnownHeaders[32] = {
+    "Cookie",               //  0
+    "Accept",               //  1
+    "Authorization",        //  2
+    NULL,                   //  3
+    "Transfer-Encoding",    //  4
+    NULL,                   //  5
+    "Content-Type",         //  6
+    "Content-Range",        //  7
+    "Range",                //  8
+    NULL,                   //  9
+    NULL,                   // 10
+    "Content-Length",       // 11
+    "Content-Encoding",     // 12
+    "Connection",           // 13
+    "Proxy-Connection",     // 14
+    NULL,                   // 15
+    "Host",                 // 16
+    "User-Agent",           // 17
+    NULL,                   // 18
+    NULL,                   // 19
+    "If-None-Match",        // 20
+    "If-Modified-Since",    // 21
+    NULL,                   // 22
+    "Referer",              // 23
+    NULL,                   // 24
+    NULL,                   // 25
+    NULL,                   // 26
+    NULL,                   // 27
+    NULL,                   // 28
+    "Accept-Encoding",      // 29
+    NULL,                   // 30
+    NULL,                   // 31
+};
+
+int HttpParser::known_header_slot(const char* name, size_t len) {
+
+    if (len == 0) {
+        return -1;
+    }
+
+    size_t slot = (len + 7 * (name[0] | 0x20) + (name[len - 1] | 0x20)) & (kKnownHeaderSlots - 1);
+    const char* known = kKnownHeaders[slot];
+    if (known && ::strlen(known) == len && ::strncasecmp(known, name, len) == 0) {
+        return static_cast<int>(slot);
+    }
+
+    return -1;
+}
+
+// 忽略大小写的FNV-1a
+uint32_t HttpParser::header_name_hash(const char* name, size_t len) {
+
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<uint8_t>(::tolower(static_cast<unsigned char>(name[i])));
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// 同名的头部只索引第一个，和原先顺序查找的结果保持一致
+void HttpParser::index_header(const char* base, uint8_t idx) {
+
+    const HttpHeaderView& header = headers_[idx];
+    const char* name = base + header.name_.offset_;
+    size_t len = header.name_.length_;
+
+    int slot = known_header_slot(name, len);
+    if (slot >= 0) {
+        if (known_index_[slot] == 0) {
+            known_index_[slot] = idx + 1;
+        }
+        return;
+    }
+
+    size_t pos = header_name_hash(name, len) & (kOtherHeaderSlots - 1);
+    while (other_index_[pos] != 0) {
+        const HttpHeaderView& exist = headers_[other_index_[pos] - 1];
+        if (exist.name_.length_ == len &&
+            ::strncasecmp(base + exist.name_.offset_, name, len) == 0) {
+            return;
+        }
+        pos = (pos + 1) & (kOtherHeaderSlots - 1);
+    }
+
+    other_index_[pos] = idx + 1;
+}
+
+const HttpHeaderView* HttpParser::lookup_header(const char* name, size_t len) const {
+
+    int slot = known_header_slot(name, len);
+    if (slot >= 0) {
+        return known_index_[slot] ? &headers_[known_index_[slot] - 1] : NULL;
+    }
+
+    size_t pos = header_name_hash(name, len) & (kOtherHeaderSlots - 1);
+    while (other_index_[pos] != 0) {
+        const HttpHeaderView& exist = headers_[other_index_[pos] - 1];
+        if (exist.name_.length_ == len &&
+            ::strncasecmp(raw_.data() + exist.name_.offset_, name, len) == 0) {
+            return &exist;
+        }
+        pos = (pos + 1) & (kOtherHeaderSlots - 1);
+    }
 
+    return NULL;
+}
 
 std::string HttpParser::find_request_header(std::string option_name) const {
 
     if (option_name.empty())
         return "";
 
-    std::map<std::string, std::string>::const_iterator it;
-    for (it = request_headers_.cbegin(); it != request_headers_.cend(); ++it) {
-        if (boost::iequals(option_name, it->first))
-            return it->second;
+    // 内部使用的伪头部，都是以'_'结尾的，正常的头部不需要逐个比较
+    if (option_name[option_name.size() - 1] == '_') {
+        if (option_name == http_proto::header_options::request_method) {
+            return boost::to_upper_copy(view_string(method_str_));
+        } else if (option_name == http_proto::header_options::request_uri) {
+            return view_string(uri_str_);
+        } else if (option_name == http_proto::header_options::request_path_info) {
+            return path_info_;
+        } else if (option_name == http_proto::header_options::request_query_str) {
+            return query_str_;
+        } else if (option_name == http_proto::header_options::http_version) {
+            return view_string(version_str_);
+        }
+    }
+
+    const HttpHeaderView* header = lookup_header(option_name.c_str(), option_name.size());
+    if (header) {
+        return view_string(header->value_);
     }
 
     return "";
 }
 
+bool HttpParser::get_request_path_param(const std::string& key, boost::string_ref& value) const {
+
+    for (auto iter = path_params_.cbegin(); iter != path_params_.cend(); ++iter) {
+        if (iter->first == key) {
+            const HttpStrView& view = iter->second;
+            if (view.offset_ + view.length_ > path_info_.size()) {
+                return false;
+            }
+            value = boost::string_ref(path_info_.data() + view.offset_, view.length_);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool HttpParser::get_request_path_param(const std::string& key, int64_t& value) const {
+
+    boost::string_ref str;
+    if (!get_request_path_param(key, str) || str.empty() || str.size() > 18) {
+        return false;
+    }
+
+    int64_t result = 0;
+    for (size_t i = 0; i < str.size(); ++i) {
+        if (str[i] < '0' || str[i] > '9') {
+            return false;
+        }
+        result = result * 10 + (str[i] - '0');
+    }
+
+    value = result;
+    return true;
+}
+
 bool HttpParser::parse_request_uri() {
 
     // clear it first!
@@ -56,21 +214,18 @@ bool HttpParser::parse_request_uri() {
     std::string::size_type item_idx = 0;
     item_idx = uri.find_first_of("?");
     if (item_idx == std::string::npos) {
-        request_headers_.insert(std::make_pair(http_proto::header_options::request_path_info,
-                                               CryptoUtil::url_decode(uri)));
+        path_info_ = CryptoUtil::url_decode(uri);
         return true;
     }
 
-    request_headers_.insert(std::make_pair(http_proto::header_options::request_path_info,
-                                           CryptoUtil::url_decode(uri.substr(0, item_idx))));
-    request_headers_.insert(std::make_pair(http_proto::header_options::request_query_str,
-                                           uri.substr(item_idx + 1)));
+    path_info_ = CryptoUtil::url_decode(uri.substr(0, item_idx));
+    query_str_ = uri.substr(item_idx + 1);
 
     // do query string parse, from cgicc
     std::string name, value;
     std::string::size_type pos;
     std::string::size_type oldPos = 0;
-    std::string query_str = find_request_header(http_proto::header_options::request_query_str);
+    const std::string& query_str = query_str_;
 
     while (true) {
 
@@ -127,93 +282,181 @@ bool HttpParser::parse_request_uri() {
     return true;
 }
 
-std::string HttpParser::normalize_request_uri(const std::string& uri) {
+// 因为Linux文件系统是大小写敏感的，所以这里不会进行uri大小写的规则化
+// 只是合并连续的'/'，规则化之后只会变短，所以直接在raw_中原地进行
+void HttpParser::normalize_request_uri() {
 
-    // 因为Linux文件系统是大小写敏感的，所以这里不会进行uri大小写的规则化
-    const std::string src = boost::algorithm::trim_copy(uri);
-    std::string result;
-    result.reserve(src.size());
+    if (uri_str_.length_ == 0) {
+        return;
+    }
 
-    for (std::string::const_iterator iter = src.begin(); iter != src.end(); ++iter) {
-        if (*iter == '/') {
-            while (std::distance(iter, src.end()) >= 1 && *(iter + 1) == '/')
-                ++iter;
+    char* uri = &raw_[uri_str_.offset_];
+    uint32_t w = 0;
+    for (uint32_t r = 0; r < uri_str_.length_; ++r) {
+        if (uri[r] == '/' && w > 0 && uri[w - 1] == '/') {
+            continue;
         }
+        uri[w++] = uri[r];
+    }
 
-        result.append(1, *iter); //store it!
+    uri_str_.length_ = w;
+}
+
+static inline bool is_http_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static inline HttpStrView make_view(size_t begin, size_t end) {
+    HttpStrView view;
+    view.offset_ = static_cast<uint32_t>(begin);
+    view.length_ = static_cast<uint32_t>(end - begin);
+    return view;
+}
+
+// METHOD SP URI [SP VERSION]
+bool HttpParser::parse_request_line(const char* data, size_t start, size_t end) {
+
+    size_t pos = start;
+
+    // method
+    while (pos < end && isalpha(static_cast<unsigned char>(data[pos]))) {
+        ++pos;
+    }
+    if (pos == start || pos == end || !is_http_space(data[pos])) {
+        return false;
+    }
+    method_str_ = make_view(start, pos);
+
+    const char* method = data + start;
+    size_t method_len = pos - start;
+    if (method_len == 3 && ::strncasecmp(method, "GET", 3) == 0) {
+        method_ = HTTP_METHOD::GET;
+    } else if (method_len == 4 && ::strncasecmp(method, "POST", 4) == 0) {
+        method_ = HTTP_METHOD::POST;
+    } else if (method_len == 7 && ::strncasecmp(method, "OPTIONS", 7) == 0) {
+        method_ = HTTP_METHOD::OPTIONS;
+    } else {
+        method_ = HTTP_METHOD::UNDETECTED;
+    }
+
+    // uri
+    while (pos < end && is_http_space(data[pos])) {
+        ++pos;
+    }
+    size_t uri_start = pos;
+    pos = http_scanner::find_first_of(data + pos, data + end, " \t", 2) - data;
+    if (pos == uri_start) {
+        return false;
+    }
+    uri_str_ = make_view(uri_start, pos);
+
+    // version，可能不存在
+    while (pos < end && is_http_space(data[pos])) {
+        ++pos;
+    }
+    size_t ver_end = end;
+    while (ver_end > pos && is_http_space(data[ver_end - 1])) {
+        --ver_end;
     }
+    version_str_ = make_view(pos, ver_end);
 
-    return result;
+    return true;
 }
 
-bool HttpParser::do_parse_request(const std::string& header) {
-
-    request_headers_.clear();
-    request_headers_.insert(std::make_pair(http_proto::header_options::request_body,
-                                           header.substr(header.find("\r\n\r\n") + 4)));
-    std::string header_part = header.substr(0, header.find("\r\n\r\n") + 4);
-
-    std::istringstream resp(header_part);
-    std::string item;
-    std::string::size_type index;
-
-    while (std::getline(resp, item) && item != "\r") {
-
-        // 重新编写，支持url中带有特殊字符
-        if (boost::istarts_with(item, "GET ") ||
-            boost::istarts_with(item, "HEAD ") ||
-            boost::istarts_with(item, "POST ") ||
-            boost::istarts_with(item, "PUT ") ||
-            boost::istarts_with(item, "DELETE ") ||
-            boost::istarts_with(item, "CONNECT ") ||
-            boost::istarts_with(item, "OPTIONS ") ||
-            boost::istarts_with(item, "TRACE ") ||
-            boost::istarts_with(item, "MOVE ") ||
-            boost::istarts_with(item, "COPY ") ||
-            boost::istarts_with(item, "LINK ") ||
-            boost::istarts_with(item, "UNLINK ") ||
-            boost::istarts_with(item, "WRAPPED ") ||
-            boost::istarts_with(item, "Extension-method ")
-           ) {
-            // HTTP 标准头
-            boost::smatch what;
-            if (boost::regex_match(item, what,
-                                   boost::regex("([a-zA-Z]+)[ ]+([^ ]+)([ ]+(.*))?"))) {
-                request_headers_.insert(std::make_pair(http_proto::header_options::request_method,
-                                                       boost::algorithm::trim_copy(
-                                                           boost::to_upper_copy(std::string(what[1])))));
-
-                // HTTP Method
-                if (boost::iequals(find_request_header(http_proto::header_options::request_method), "GET")) {
-                    method_ = HTTP_METHOD::GET;
-                } else if (boost::iequals(find_request_header(http_proto::header_options::request_method), "POST")) {
-                    method_ = HTTP_METHOD::POST;
-                } else if (boost::iequals(find_request_header(http_proto::header_options::request_method), "OPTIONS")) {
-                    method_ = HTTP_METHOD::OPTIONS;
-                } else {
-                    method_ = HTTP_METHOD::UNDETECTED;
-                }
+// NAME ":" OWS VALUE OWS
+bool HttpParser::parse_header_line(const char* data, size_t start, size_t end) {
 
-                uri_ = normalize_request_uri(std::string(what[2]));
-                request_headers_.insert(std::make_pair(http_proto::header_options::request_uri, uri_));
-                request_headers_.insert(std::make_pair(http_proto::header_options::http_version,
-                                                       boost::algorithm::trim_copy(std::string(what[3]))));
+    const char* colon = http_scanner::find_char(data + start, data + end, ':');
+    if (colon == data + end) {
+        roo::log_err("unabled to handle line: %.*s", static_cast<int>(end - start), data + start);
+        return true;   // 忽略这一行
+    }
 
-                version_ = boost::algorithm::trim_copy(std::string(what[3]));
-            }
-        } else {
-            index = item.find(':', 0);
-            if (index != std::string::npos) { // 直接Key-Value
-                request_headers_.insert(std::make_pair(
-                                            boost::algorithm::trim_copy(item.substr(0, index)),
-                                            boost::algorithm::trim_copy(item.substr(index + 1))));
-            } else {
-                roo::log_err("unabled to handle line: %s", item.c_str());
+    size_t name_end = colon - data;
+    size_t name_start = start;
+    while (name_start < name_end && is_http_space(data[name_start])) {
+        ++name_start;
+    }
+    while (name_end > name_start && is_http_space(data[name_end - 1])) {
+        --name_end;
+    }
+
+    size_t value_start = colon - data + 1;
+    size_t value_end = end;
+    while (value_start < value_end && is_http_space(data[value_start])) {
+        ++value_start;
+    }
+    while (value_end > value_start && is_http_space(data[value_end - 1])) {
+        --value_end;
+    }
+
+    if (header_count_ >= kMaxHeaderCount) {
+        roo::log_err("too many request headers, limit %d", static_cast<int>(kMaxHeaderCount));
+        return false;
+    }
+
+    HttpHeaderView& header = headers_[header_count_];
+    header.name_  = make_view(name_start, name_end);
+    header.value_ = make_view(value_start, value_end);
+    index_header(data, static_cast<uint8_t>(header_count_));
+    ++header_count_;
+
+    return true;
+}
+
+enum HttpParseStatus HttpParser::parse_request_header(const char* data, size_t len) {
+
+    if (state_ == ParseState::kDone) {
+        return HttpParseStatus::kComplete;
+    }
+
+    while (scan_pos_ < len) {
+
+        const char* lf = http_scanner::find_char(data + scan_pos_, data + len, '\n');
+        if (lf == data + len) {
+            // 当前行还不完整，记录扫描位置等待更多的数据
+            scan_pos_ = len;
+            return HttpParseStatus::kIncomplete;
+        }
+
+        size_t line_end = lf - data;        // '\n'的位置
+        size_t next_line = line_end + 1;
+        if (line_end > line_start_ && data[line_end - 1] == '\r') {
+            --line_end;
+        }
+
+        if (state_ == ParseState::kRequestLine) {
+
+            // 忽略请求行之前的空行
+            if (line_end != line_start_) {
+                if (!parse_request_line(data, line_start_, line_end)) {
+                    roo::log_err("invalid request line: %.*s",
+                                 static_cast<int>(line_end - line_start_), data + line_start_);
+                    return HttpParseStatus::kError;
+                }
+                state_ = ParseState::kHeaderLine;
             }
+
+        } else if (line_end == line_start_) {
+
+            // 空行，头部结束
+            header_length_ = next_line;
+            state_ = ParseState::kDone;
+
+            // 只在头部完整的时候拷贝一次，此后的view都相对于raw_
+            raw_.assign(data, header_length_);
+            normalize_request_uri();
+
+            return HttpParseStatus::kComplete;
+
+        } else if (!parse_header_line(data, line_start_, line_end)) {
+            return HttpParseStatus::kError;
         }
+
+        line_start_ = scan_pos_ = next_line;
     }
 
-    return true;
+    return HttpParseStatus::kIncomplete;
 }
 
 } // end namespace tzhttpd
@@ -15,6 +15,7 @@
 #include <xtra_rhel.h>
 
 #include <boost/asio.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include <container/PairVec.h>
 #include <other/Log.h>
@@ -26,15 +27,53 @@ namespace tzhttpd {
 
 typedef roo::PairVec<std::string, std::string> UriParamContainer;
 
+enum class HttpParseStatus : uint8_t {
+    kIncomplete = 1,    // 头部还没有接收完整，需要更多的数据
+    kComplete   = 2,
+    kError      = 3,
+};
+
+// 原始头部数据中的一段，只记录偏移和长度，不持有数据
+struct HttpStrView {
+    uint32_t offset_;
+    uint32_t length_;
+};
+
+struct HttpHeaderView {
+    HttpStrView name_;
+    HttpStrView value_;
+};
+
+// 路由中{name}捕获的路径参数，偏移相对于请求的path_info
+typedef std::vector<std::pair<std::string, HttpStrView>> PathParamContainer;
+
 class HttpParser {
 
     __noncopyable__(HttpParser)
 
 public:
+
+    // 单个请求允许的最大头部数目
+    static const size_t kMaxHeaderCount = 64;
+
     HttpParser() :
-        request_headers_(),
         request_uri_params_(),
-        method_(HTTP_METHOD::UNDETECTED) {
+        method_(HTTP_METHOD::UNDETECTED),
+        state_(ParseState::kRequestLine),
+        line_start_(0),
+        scan_pos_(0),
+        header_length_(0),
+        method_str_({ 0, 0 }),
+        uri_str_({ 0, 0 }),
+        version_str_({ 0, 0 }),
+        header_count_(0),
+        raw_(),
+        path_info_(),
+        query_str_(),
+        path_params_(),
+        pipeline_seq_(0) {
+        ::memset(known_index_, 0, sizeof(known_index_));
+        ::memset(other_index_, 0, sizeof(other_index_));
     }
 
     enum HTTP_METHOD get_method() const {
@@ -42,11 +81,29 @@ public:
     }
 
     std::string get_uri() const {
-        return uri_;
+        return view_string(uri_str_);
+    }
+
+    // 解码之后不包含查询字符串的路径，路由匹配使用的就是这个
+    const std::string& get_request_path_info() const {
+        return path_info_;
     }
 
     std::string get_version() const {
-        return version_;
+        return view_string(version_str_);
+    }
+
+    // 增量解析接口
+    // data指向连接接收缓冲区中当前请求的起始位置，len为目前已经接收到的数据长度，
+    // 每次有新数据到达的时候使用同样的起始位置和更新后的长度再次调用，已经解析
+    // 过的行不会被重复扫描。解析的过程中只记录偏移和长度，不产生任何内存分配，
+    // 头部完整之后才将头部的原始数据拷贝一份自己持有(之后连接缓冲区可以被复用)
+    enum HttpParseStatus parse_request_header(const char* data, size_t len);
+
+    // 头部完整之后有效，表示请求头部(包括结尾的空行)的长度，后面的数据属于请求体
+    // 或者后续的请求
+    size_t get_header_length() const {
+        return header_length_;
     }
 
     bool parse_request_header(const char* header_ptr) {
@@ -55,11 +112,11 @@ public:
             return false;
         }
 
-        return do_parse_request(std::string(header_ptr));
+        return parse_request_header(header_ptr, strlen(header_ptr)) == HttpParseStatus::kComplete;
     }
 
     bool parse_request_header(const std::string& header) {
-        return do_parse_request(header);
+        return parse_request_header(header.c_str(), header.size()) == HttpParseStatus::kComplete;
     }
 
     std::string find_request_header(std::string option_name) const;
@@ -77,6 +134,19 @@ public:
         return request_uri_params_.FIND(key, value);
     }
 
+    // 路由匹配的时候捕获的路径参数，返回的值直接引用path_info，不拷贝，
+    // 在HttpParser的生命周期内有效
+    void set_request_path_params(PathParamContainer& params) {
+        path_params_.swap(params);
+    }
+
+    size_t get_request_path_param_count() const {
+        return path_params_.size();
+    }
+
+    bool get_request_path_param(const std::string& key, boost::string_ref& value) const;
+    bool get_request_path_param(const std::string& key, int64_t& value) const;
+
     std::string char_to_hex(char c) const {
 
         std::string result;
@@ -103,20 +173,67 @@ public:
 
 
 private:
-    std::string normalize_request_uri(const std::string& uri);
-    bool do_parse_request(const std::string& header);
+
+    enum class ParseState : uint8_t {
+        kRequestLine = 1,
+        kHeaderLine  = 2,
+        kDone        = 3,
+    };
+
+    bool parse_request_line(const char* data, size_t start, size_t end);
+    bool parse_header_line(const char* data, size_t start, size_t end);
+    void normalize_request_uri();
+
+    // 头部索引: 常用头部通过完美哈希直接定位到固定槽位，其他头部存放在
+    // 忽略大小写的开放寻址表中，两者保存的都是headers_的下标+1，0表示空
+    static const size_t kKnownHeaderSlots = 32;
+    static const size_t kOtherHeaderSlots = 128;    // 至少是kMaxHeaderCount的两倍
+
+    static int known_header_slot(const char* name, size_t len);
+    static uint32_t header_name_hash(const char* name, size_t len);
+    void index_header(const char* base, uint8_t idx);
+    const HttpHeaderView* lookup_header(const char* name, size_t len) const;
+
+    std::string view_string(const HttpStrView& view) const {
+        if (view.length_ == 0 || view.offset_ + view.length_ > raw_.size()) {
+            return "";
+        }
+        return std::string(raw_.data() + view.offset_, view.length_);
+    }
 
 private:
 
-    std::map<std::string, std::string> request_headers_;
     UriParamContainer request_uri_params_;
 
     enum HTTP_METHOD method_;
-    std::string version_;
-    std::string uri_;
+
+    // 增量解析的状态
+    enum ParseState state_;
+    size_t line_start_;     // 当前未完成行的起始位置
+    size_t scan_pos_;       // 当前行已经扫描过的位置，再次调用从这里继续查找行尾
+    size_t header_length_;
+
+    HttpStrView method_str_;
+    HttpStrView uri_str_;
+    HttpStrView version_str_;
+
+    HttpHeaderView headers_[kMaxHeaderCount];
+    size_t header_count_;
+
+    uint8_t known_index_[kKnownHeaderSlots];
+    uint8_t other_index_[kOtherHeaderSlots];
+
+    // 头部完整之后的原始数据，上面的view都是相对于这里的偏移
+    std::string raw_;
+
+    std::string path_info_;
+    std::string query_str_;
+
+    PathParamContainer path_params_;
 
 public:
     boost::asio::ip::tcp::endpoint remote_;
+    uint64_t pipeline_seq_;     // 在连接流水线中的序号，响应按照该序号依次发送
 };
 
 } // end namespace tzhttpd
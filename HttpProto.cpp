@@ -7,7 +7,10 @@
 
 
 #include <ctime>
+#include <cstring>
+#include <cstdlib>
 #include <boost/chrono.hpp>
+#include <boost/algorithm/string.hpp>
 
 #include <sstream>
 #include "HttpProto.h"
@@ -28,10 +31,10 @@ struct header {
 
 
 /**
- * 由于最终的底层都是调用c_str()发送的，所以这里不添加额外的字符
+ * 只生成状态行和头部(包含结尾的空行)，正文由调用者单独持有并发送
  */
-string http_response_generate(const string& content, const string& stat_str,
-                              bool keepalive, const std::vector<std::string>& additional_header) {
+string http_response_header_generate(size_t content_length, const string& stat_str,
+                                     bool keepalive, const std::vector<std::string>& additional_header) {
 
     std::vector<header> headers(5);
 
@@ -48,8 +51,11 @@ string http_response_generate(const string& content, const string& stat_str,
 //    headers[1].value = time_str.erase(time_str.find('\n')); // ctime 会在末尾增加一个 \n
 //    headers[1].value = to_simple_string(second_clock::universal_time()) + " GMT";
 
-    headers[2].name = "Content-Length";
-    headers[2].value = std::to_string(static_cast<long long unsigned>(content.size()));
+    // 304响应没有正文，其Content-Length应该是完整响应的长度，所以干脆不发送
+    if (stat_str.find(" 304 ") == std::string::npos) {
+        headers[2].name = "Content-Length";
+        headers[2].value = std::to_string(static_cast<long long unsigned>(content_length));
+    }
 
     headers[3].name = "Connection";
     if (keepalive) {
@@ -64,6 +70,9 @@ string http_response_generate(const string& content, const string& stat_str,
     string str = stat_str;
     str += header_crlf_str;
     for (size_t i = 0; i < headers.size(); ++i) {
+        if (headers[i].name.empty()) {
+            continue;
+        }
         str += headers[i].name;
         str += header_name_value_separator_str;
         str += headers[i].value;
@@ -76,6 +85,17 @@ string http_response_generate(const string& content, const string& stat_str,
     }
 
     str += header_crlf_str;
+
+    return str;
+}
+
+/**
+ * 由于最终的底层都是调用c_str()发送的，所以这里不添加额外的字符
+ */
+string http_response_generate(const string& content, const string& stat_str,
+                              bool keepalive, const std::vector<std::string>& additional_header) {
+
+    string str = http_response_header_generate(content.size(), stat_str, keepalive, additional_header);
     str += content;
 
     return str;
@@ -133,6 +153,81 @@ string http_std_response_generate(const std::string& http_ver, const std::string
 }
 
 
+std::string http_date_string(time_t tm) {
+
+    struct tm gmt;
+    ::gmtime_r(&tm, &gmt);
+
+    char mbstr[64]{};
+    std::strftime(mbstr, sizeof(mbstr), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    return std::string(mbstr);
+}
+
+time_t http_date_parse(const std::string& str) {
+
+    struct tm gmt;
+    ::memset(&gmt, 0, sizeof(gmt));
+    const char* end = ::strptime(str.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    if (!end) {
+        return -1;
+    }
+
+    return ::timegm(&gmt);
+}
+
+bool etag_match(const std::string& if_none_match, const std::string& etag) {
+
+    if (etag.empty()) {
+        return false;
+    }
+
+    // 弱比较，忽略 W/ 前缀
+    std::string opaque = etag;
+    if (opaque.compare(0, 2, "W/") == 0) {
+        opaque = opaque.substr(2);
+    }
+
+    size_t pos = 0;
+    while (pos < if_none_match.size()) {
+
+        size_t end = if_none_match.find(',', pos);
+        if (end == std::string::npos) {
+            end = if_none_match.size();
+        }
+
+        std::string item = boost::algorithm::trim_copy(if_none_match.substr(pos, end - pos));
+        if (item == "*") {
+            return true;
+        }
+        if (item.compare(0, 2, "W/") == 0) {
+            item = item.substr(2);
+        }
+        if (item == opaque) {
+            return true;
+        }
+
+        pos = end + 1;
+    }
+
+    return false;
+}
+
+bool check_not_modified(const std::string& if_none_match, const std::string& if_modified_since,
+                        const std::string& etag, time_t mtime) {
+
+    if (!if_none_match.empty()) {
+        return etag_match(if_none_match, etag);
+    }
+
+    if (!if_modified_since.empty() && mtime >= 0) {
+        time_t since = http_date_parse(if_modified_since);
+        return since >= 0 && mtime <= since;
+    }
+
+    return false;
+}
+
+
 static const std::map<std::string, std::string> content_types = {
     { ".avi", "Content-Type: video/x-msvideo" },
     { ".bin", "Content-Type: application/octet-stream" },
@@ -202,6 +297,89 @@ std::string find_content_type(const std::string& suffix) {
     return "";
 }
 
+
+// 单个请求允许的最多Range数目，超过的按照完整响应处理
+static const size_t kMaxByteRanges = 16;
+
+static bool parse_range_offset(const std::string& str, off_t& offset) {
+
+    if (str.empty() || str.size() > 18 ||
+        str.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+
+    offset = static_cast<off_t>(::strtoll(str.c_str(), NULL, 10));
+    return true;
+}
+
+int parse_byte_ranges(const std::string& range, off_t size,
+                      std::vector<std::pair<off_t, off_t>>& ranges) {
+
+    std::string spec = boost::trim_copy(range);
+    if (!boost::istarts_with(spec, "bytes=")) {
+        return -1;
+    }
+
+    std::vector<std::string> items{};
+    boost::split(items, spec.substr(6), boost::is_any_of(","));
+    if (items.size() > kMaxByteRanges) {
+        return -1;
+    }
+
+    off_t total = 0;
+    for (auto iter = items.begin(); iter != items.end(); ++iter) {
+
+        std::string item = boost::trim_copy(*iter);
+        std::string::size_type pos = item.find('-');
+        if (pos == std::string::npos) {
+            return -1;
+        }
+
+        std::string first = item.substr(0, pos);
+        std::string last = item.substr(pos + 1);
+        off_t start = 0;
+        off_t end = size - 1;
+
+        if (first.empty()) {
+            // 最后的n个字节
+            off_t suffix = 0;
+            if (!parse_range_offset(last, suffix)) {
+                return -1;
+            }
+            if (suffix == 0 || size == 0) {
+                continue;
+            }
+            start = suffix < size ? size - suffix : 0;
+        } else {
+            if (!parse_range_offset(first, start)) {
+                return -1;
+            }
+            if (!last.empty()) {
+                if (!parse_range_offset(last, end) || end < start) {
+                    return -1;
+                }
+            }
+            if (start >= size) {
+                continue;
+            }
+            if (end > size - 1) {
+                end = size - 1;
+            }
+        }
+
+        ranges.push_back(std::make_pair(start, end));
+        total += end - start + 1;
+    }
+
+    // 大量重叠的区间会放大响应，直接返回完整内容
+    if (total > size) {
+        ranges.clear();
+        return -1;
+    }
+
+    return ranges.empty() ? 0 : 1;
+}
+
 }  // end namespace http_proto
 }  // end namespace tzhttpd
 
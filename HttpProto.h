@@ -8,6 +8,8 @@
 #ifndef __TZHTTPD_HTTP_PROTO_H__
 #define __TZHTTPD_HTTP_PROTO_H__
 
+#include <sys/types.h>
+
 #include <map>
 #include <vector>
 #include <string>
@@ -123,6 +125,9 @@ static const std::string proxy_connection("Proxy-Connection");
 static const std::string accept_encoding("Accept-Encoding");
 static const std::string transfer_encoding("Transfer-Encoding");
 static const std::string content_encoding("Content-Encoding");
+static const std::string if_none_match("If-None-Match");
+static const std::string if_modified_since("If-Modified-Since");
+static const std::string if_range("If-Range");
 
 } // namespace header_options
 
@@ -283,6 +288,12 @@ static string header_crlfcrlf_str = "\r\n\r\n";
 
 std::string find_content_type(const std::string& suffix);
 
+/**
+ * 只生成状态行和头部(包含结尾的空行)，正文由调用者单独持有并发送
+ */
+string http_response_header_generate(size_t content_length, const std::string& stat_str,
+                                     bool keepalive, const std::vector<std::string>& additional_header);
+
 /**
  * 由于最终的底层都是调用c_str()发送的，所以这里不添加额外的字符
  */
@@ -294,6 +305,25 @@ string http_response_generate(const char* data, size_t len, const string& stat_s
 string http_std_response_generate(const std::string& http_ver, const std::string& stat_str,
                                   enum StatusCode code, bool keepalive);
 
+// 条件请求相关
+// RFC 7231 的 IMF-fixdate 格式: Sun, 06 Nov 1994 08:49:37 GMT
+std::string http_date_string(time_t tm);
+// 无法解析的时候返回-1
+time_t http_date_parse(const std::string& str);
+
+// If-None-Match 的取值(可以是列表或者*)是否和etag匹配，使用弱比较
+bool etag_match(const std::string& if_none_match, const std::string& etag);
+
+// 根据 If-None-Match / If-Modified-Since 判断能否返回304，有If-None-Match的时候忽略后者
+// mtime小于0表示没有最后修改时间
+bool check_not_modified(const std::string& if_none_match, const std::string& if_modified_since,
+                        const std::string& etag, time_t mtime);
+
+// 解析 Range: bytes=0-99,200-,-500 为闭区间
+// 返回-1表示无法处理(忽略Range按照完整响应处理)，0表示都不能满足(416)，1表示成功
+int parse_byte_ranges(const std::string& range, off_t size,
+                      std::vector<std::pair<off_t, off_t>>& ranges);
+
 } // end namespace http_proto
 
 } // end namespace tzhttpd
@@ -8,6 +8,8 @@
 #ifndef __TZHTTPD_HTTP_REQ_INSTANCE_H__
 #define __TZHTTPD_HTTP_REQ_INSTANCE_H__
 
+#include <time.h>
+
 #include <memory>
 
 #include "TcpConnAsync.h"
@@ -28,9 +30,16 @@ struct HttpReqInstance {
         http_parser_(http_parser),
         data_(data),
         start_(::time(NULL)),
+        enqueue_ns_(monotonic_ns()),
         full_socket_(socket) {
     }
 
+    static uint64_t monotonic_ns() {
+        struct timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
     const HTTP_METHOD method_;
     const std::string hostname_;
     const std::string uri_;
@@ -38,9 +47,18 @@ struct HttpReqInstance {
     std::string data_;        // post data, 如果有的话
 
     time_t start_;            // 请求创建的时间
+    uint64_t enqueue_ns_;     // 请求完整读取、开始派发的单调时间，用来计算排队时间
     std::weak_ptr<TcpConnAsync> full_socket_; // 可能socket提前在网络层已经释放了
 
 
+    // 连接所属的io_service，连接已经释放的时候返回NULL
+    boost::asio::io_service* io_service() {
+        if (auto sock = full_socket_.lock()) {
+            return &sock->io_service_;
+        }
+        return NULL;
+    }
+
     std::string str() {
         std::stringstream ss;
 
@@ -57,7 +75,7 @@ struct HttpReqInstance {
 
         if (auto sock = full_socket_.lock()) {
             sock->fill_std_http_for_send(http_parser_, code);
-            sock->do_write(http_parser_);
+            sock->post_write_pending();
             return;
         }
 
@@ -67,10 +85,32 @@ struct HttpReqInstance {
     void http_response(const std::string& response_str,
                        const std::string& status_str,
                        const std::vector<std::string>& headers) {
+        std::string response_copy = response_str;
+        http_response(response_copy, status_str, headers);
+    }
+
+    // 非const的版本，response_str的内容会被swap取走直接用于发送，避免拷贝
+    void http_response(std::string& response_str,
+                       const std::string& status_str,
+                       const std::vector<std::string>& headers) {
 
         if (auto sock = full_socket_.lock()) {
             sock->fill_http_for_send(http_parser_, response_str, status_str, headers);
-            sock->do_write(http_parser_);
+            sock->post_write_pending();
+            return;
+        }
+
+        roo::log_err("connection already released before.");
+    }
+
+    // 以文件、缓存的共享内容的分段作为响应体，文件在头部之后使用sendfile发送
+    void http_body_response(std::vector<SendSegment>& body,
+                            const std::string& status_str,
+                            const std::vector<std::string>& headers) {
+
+        if (auto sock = full_socket_.lock()) {
+            sock->fill_body_for_send(http_parser_, body, status_str, headers);
+            sock->post_write_pending();
             return;
         }
 
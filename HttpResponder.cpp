@@ -0,0 +1,69 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <other/Log.h>
+
+#include "HttpParser.h"
+#include "HttpReqInstance.h"
+
+#include "HttpResponder.h"
+
+namespace tzhttpd {
+
+HttpResponder::HttpResponder(std::shared_ptr<HttpReqInstance> http_req_instance) :
+    http_req_instance_(http_req_instance),
+    completed_(false) {
+}
+
+HttpResponder::~HttpResponder() {
+
+    if (try_complete()) {
+        roo::log_err("async handler for %s released without response, reply 500.",
+                     http_req_instance_->uri_.c_str());
+        http_req_instance_->http_std_response(http_proto::StatusCode::server_error_internal_server_error);
+    }
+}
+
+const HttpParser& HttpResponder::http_parser() const {
+    return *http_req_instance_->http_parser_;
+}
+
+const std::string& HttpResponder::post_data() const {
+    return http_req_instance_->data_;
+}
+
+bool HttpResponder::complete(int code, std::string& response,
+                             const std::string& status_line, const std::vector<std::string>& add_header) {
+
+    if (!try_complete()) {
+        roo::log_err("response for %s already completed.", http_req_instance_->uri_.c_str());
+        return false;
+    }
+
+    if (status_line.empty()) {
+        http_req_instance_->http_std_response(code == 0 ?
+                                              http_proto::StatusCode::success_ok :
+                                              http_proto::StatusCode::server_error_internal_server_error);
+    } else {
+        http_req_instance_->http_response(response, status_line, add_header);
+    }
+
+    return true;
+}
+
+bool HttpResponder::complete(enum http_proto::StatusCode code) {
+
+    if (!try_complete()) {
+        roo::log_err("response for %s already completed.", http_req_instance_->uri_.c_str());
+        return false;
+    }
+
+    http_req_instance_->http_std_response(code);
+    return true;
+}
+
+} // end namespace tzhttpd
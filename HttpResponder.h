@@ -0,0 +1,71 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __TZHTTPD_HTTP_RESPONDER_H__
+#define __TZHTTPD_HTTP_RESPONDER_H__
+
+#include <xtra_rhel.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "HttpProto.h"
+
+namespace tzhttpd {
+
+class HttpParser;
+class HttpCoContext;
+struct HttpReqInstance;
+
+// 异步handler的响应完成对象
+//
+// handler拿到之后可以立即返回，在任何线程中稍后调用complete()写回响应，
+// 持有期间请求(包括HttpParser和post数据)都是有效的
+// 只有第一次complete()生效，如果最后一个引用释放的时候还没有完成，自动回复500，
+// 避免同一连接上流水线中后面的响应一直等待
+
+class HttpResponder {
+
+    __noncopyable__(HttpResponder)
+    friend class HttpCoContext;
+
+public:
+    explicit HttpResponder(std::shared_ptr<HttpReqInstance> http_req_instance);
+    ~HttpResponder();
+
+    const HttpParser& http_parser() const;
+    const std::string& post_data() const;
+
+    // 和同步handler的返回约定一致: status_line为空的时候根据code回复标准的200/500，
+    // 否则发送response的内容，response会被swap取走
+    bool complete(int code, std::string& response,
+                  const std::string& status_line, const std::vector<std::string>& add_header);
+
+    // 回复标准内容
+    bool complete(enum http_proto::StatusCode code);
+
+    bool completed() const {
+        return completed_.load();
+    }
+
+private:
+
+    bool try_complete() {
+        bool expect = false;
+        return completed_.compare_exchange_strong(expect, true);
+    }
+
+    std::shared_ptr<HttpReqInstance> http_req_instance_;
+    std::atomic<bool> completed_;
+};
+
+} // end namespace tzhttpd
+
+
+#endif // __TZHTTPD_HTTP_RESPONDER_H__
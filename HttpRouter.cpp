@@ -0,0 +1,379 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <cctype>
+#include <cstring>
+
+#include <other/Log.h>
+
+#include "HttpRouter.h"
+
+namespace tzhttpd {
+
+const size_t HttpRouter::kNoRoute;
+const size_t HttpRouter::kMaxParams;
+const int HttpRouter::kAnyChar;
+const int HttpRouter::kParamStr;
+const int HttpRouter::kParamInt;
+
+static bool is_name_char(char c, bool first) {
+    return c == '_' || ::isalpha(static_cast<unsigned char>(c)) ||
+           (!first && ::isdigit(static_cast<unsigned char>(c)));
+}
+
+HttpRouter::RouteKind HttpRouter::classify(const std::string& pattern, std::vector<int>& tokens,
+                                           std::vector<std::string>& params) {
+
+    tokens.clear();
+    params.clear();
+
+    size_t begin = 0;
+    size_t end = pattern.size();
+
+    // regex_match本身就是整体匹配，首尾的锚点可有可无
+    if (begin < end && pattern[begin] == '^') {
+        ++begin;
+    }
+    if (end > begin && pattern[end - 1] == '$' &&
+        (end - begin < 2 || pattern[end - 2] != '\\')) {
+        --end;
+    }
+
+    RouteKind kind = RouteKind::kExact;
+    if (end - begin >= 2 && pattern.compare(end - 2, 2, ".*") == 0 &&
+        (end - begin < 3 || pattern[end - 3] != '\\')) {
+        kind = RouteKind::kPrefix;
+        end -= 2;
+    }
+
+    for (size_t i = begin; i < end; ++i) {
+
+        char c = pattern[i];
+
+        // {name} {name:int} {name:str}，以字母开头的才是路径参数，{3}这类是正则的量词
+        if (c == '{' && i + 1 < end && is_name_char(pattern[i + 1], true)) {
+
+            size_t close = pattern.find('}', i);
+            if (close == std::string::npos || close >= end || params.size() >= kMaxParams) {
+                return RouteKind::kInvalid;
+            }
+
+            // 紧跟在参数或者通配'.'后面的参数没有确定的分界，匹配的时候需要尝试所有的切分，
+            // 代价随参数数目指数增长，直接拒绝
+            if (!tokens.empty() &&
+                (tokens.back() == kParamStr || tokens.back() == kParamInt || tokens.back() == kAnyChar)) {
+                return RouteKind::kInvalid;
+            }
+
+            std::string name = pattern.substr(i + 1, close - i - 1);
+            std::string type;
+            size_t colon = name.find(':');
+            if (colon != std::string::npos) {
+                type = name.substr(colon + 1);
+                name.erase(colon);
+            }
+
+            for (size_t j = 0; j < name.size(); ++j) {
+                if (!is_name_char(name[j], j == 0)) {
+                    return RouteKind::kInvalid;
+                }
+            }
+
+            if (type.empty() || type == "str") {
+                tokens.push_back(kParamStr);
+            } else if (type == "int") {
+                tokens.push_back(kParamInt);
+            } else {
+                return RouteKind::kInvalid;
+            }
+
+            params.push_back(name);
+            i = close;
+            continue;
+        }
+
+        if (c == '\\') {
+            if (i + 1 >= end || ::isalnum(static_cast<unsigned char>(pattern[i + 1]))) {
+                // \d \w 等字符类
+                return params.empty() ? RouteKind::kRegex : RouteKind::kInvalid;
+            }
+            tokens.push_back(static_cast<unsigned char>(pattern[++i]));
+            continue;
+        }
+
+        if (c == '.') {
+            // .{name}是紧跟在通配后面的参数，交给上面的参数分支拒绝，而不是当作量词
+            if (i + 1 < end && ::strchr("*+?{", pattern[i + 1]) &&
+                !(pattern[i + 1] == '{' && i + 2 < end && is_name_char(pattern[i + 2], true))) {
+                return params.empty() ? RouteKind::kRegex : RouteKind::kInvalid;
+            }
+            tokens.push_back(kAnyChar);
+            continue;
+        }
+
+        if (::strchr("[](){}*+?|^$", c)) {
+            return params.empty() ? RouteKind::kRegex : RouteKind::kInvalid;
+        }
+
+        tokens.push_back(static_cast<unsigned char>(c));
+    }
+
+    return kind;
+}
+
+uint32_t HttpRouter::trie_insert(const std::vector<int>& tokens) {
+
+    uint32_t node = 0;
+    for (auto iter = tokens.cbegin(); iter != tokens.cend(); ++iter) {
+
+        uint32_t next = 0;
+        if (*iter == kAnyChar) {
+            next = nodes_[node].any_;
+        } else if (*iter == kParamStr) {
+            next = nodes_[node].param_str_;
+        } else if (*iter == kParamInt) {
+            next = nodes_[node].param_int_;
+        } else {
+            const std::vector<std::pair<char, uint32_t>>& children = nodes_[node].children_;
+            for (size_t i = 0; i < children.size(); ++i) {
+                if (children[i].first == static_cast<char>(*iter)) {
+                    next = children[i].second;
+                    break;
+                }
+            }
+        }
+
+        if (next == 0) {
+            next = static_cast<uint32_t>(nodes_.size());
+            nodes_.push_back(TrieNode());
+            if (*iter == kAnyChar) {
+                nodes_[node].any_ = next;
+            } else if (*iter == kParamStr) {
+                nodes_[node].param_str_ = next;
+            } else if (*iter == kParamInt) {
+                nodes_[node].param_int_ = next;
+            } else {
+                nodes_[node].children_.push_back(std::make_pair(static_cast<char>(*iter), next));
+            }
+        }
+
+        node = next;
+    }
+
+    return node;
+}
+
+bool HttpRouter::rebuild() {
+
+    exact_.clear();
+    nodes_.clear();
+    nodes_.push_back(TrieNode());
+    regex_routes_.clear();
+
+    std::vector<int> tokens;
+    std::vector<std::string> regex_patterns;
+    size_t trie_routes = 0;
+
+    for (size_t idx = 0; idx < routes_.size(); ++idx) {
+
+        RouteKind kind = classify(routes_[idx].pattern_, tokens, routes_[idx].params_);
+
+        if (kind == RouteKind::kInvalid) {
+            roo::log_err("invalid path parameter in route: %s", routes_[idx].pattern_.c_str());
+            return false;
+        }
+
+        if (kind == RouteKind::kRegex) {
+            regex_routes_.push_back(idx);
+            regex_patterns.push_back(routes_[idx].pattern_);
+            continue;
+        }
+
+        bool literal = true;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (tokens[i] < 0) {
+                literal = false;
+                break;
+            }
+        }
+
+        // 同样的路径先注册的优先，后面的不会被匹配到
+        if (kind == RouteKind::kExact && literal) {
+            exact_.insert(std::make_pair(std::string(tokens.begin(), tokens.end()), idx));
+            continue;
+        }
+
+        ++trie_routes;
+        uint32_t node = trie_insert(tokens);
+        size_t& slot = (kind == RouteKind::kExact) ? nodes_[node].exact_route_ : nodes_[node].prefix_route_;
+        if (slot == kNoRoute) {
+            slot = idx;
+        }
+    }
+
+    if (!regex_set_.assign(regex_patterns)) {
+        return false;
+    }
+
+    roo::log_info("router rebuild, exact: %lu, prefix/wildcard/param: %lu, regex: %lu, trie nodes: %lu",
+                  static_cast<unsigned long>(exact_.size()),
+                  static_cast<unsigned long>(trie_routes),
+                  static_cast<unsigned long>(regex_routes_.size()),
+                  static_cast<unsigned long>(nodes_.size()));
+    return true;
+}
+
+HttpHandlerObjectPtr HttpRouter::find(const std::string& pattern) const {
+
+    for (auto iter = routes_.cbegin(); iter != routes_.cend(); ++iter) {
+        if (iter->pattern_ == pattern) {
+            return iter->handler_;
+        }
+    }
+
+    return HttpHandlerObjectPtr();
+}
+
+bool HttpRouter::add(const std::string& pattern, const HttpHandlerObjectPtr& handler) {
+
+    routes_.push_back(Route(pattern, handler));
+    if (!rebuild()) {
+        roo::log_err("invalid route pattern: %s", pattern.c_str());
+        routes_.pop_back();
+        rebuild();
+        return false;
+    }
+
+    return true;
+}
+
+bool HttpRouter::remove(const std::string& pattern) {
+
+    for (auto iter = routes_.begin(); iter != routes_.end(); ++iter) {
+        if (iter->pattern_ == pattern) {
+            routes_.erase(iter);
+            rebuild();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool HttpRouter::update(const std::string& pattern, const HttpHandlerObjectPtr& handler) {
+
+    for (auto iter = routes_.begin(); iter != routes_.end(); ++iter) {
+        if (iter->pattern_ == pattern) {
+            iter->handler_ = handler;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// 字面边直接迭代前进，只在通配边和参数边上递归，递归深度和路由表达式中
+// 通配的数目相关，而和uri的长度无关
+void HttpRouter::trie_match(const std::string& uri, uint32_t node, size_t pos,
+                            std::vector<HttpStrView>& captures,
+                            size_t& best, std::vector<HttpStrView>& best_captures) const {
+
+    while (true) {
+
+        const TrieNode& current = nodes_[node];
+        if (current.prefix_route_ < best) {
+            best = current.prefix_route_;
+            best_captures = captures;
+        }
+
+        if (pos == uri.size()) {
+            if (current.exact_route_ < best) {
+                best = current.exact_route_;
+                best_captures = captures;
+            }
+            return;
+        }
+
+        if (current.any_) {
+            trie_match(uri, current.any_, pos + 1, captures, best, best_captures);
+        }
+
+        // 参数至少一个字符，不跨越'/'，每一种长度都需要尝试
+        HttpStrView view;
+        view.offset_ = static_cast<uint32_t>(pos);
+        if (current.param_str_) {
+            for (size_t end = pos; end < uri.size() && uri[end] != '/'; ++end) {
+                view.length_ = static_cast<uint32_t>(end + 1 - pos);
+                captures.push_back(view);
+                trie_match(uri, current.param_str_, end + 1, captures, best, best_captures);
+                captures.pop_back();
+            }
+        }
+        if (current.param_int_) {
+            for (size_t end = pos; end < uri.size() && ::isdigit(static_cast<unsigned char>(uri[end])); ++end) {
+                view.length_ = static_cast<uint32_t>(end + 1 - pos);
+                captures.push_back(view);
+                trie_match(uri, current.param_int_, end + 1, captures, best, best_captures);
+                captures.pop_back();
+            }
+        }
+
+        uint32_t next = 0;
+        for (size_t i = 0; i < current.children_.size(); ++i) {
+            if (current.children_[i].first == uri[pos]) {
+                next = current.children_[i].second;
+                break;
+            }
+        }
+
+        if (!next) {
+            return;
+        }
+
+        node = next;
+        ++pos;
+    }
+}
+
+HttpHandlerObject* HttpRouter::match(const std::string& uri, PathParamContainer* params) const {
+
+    size_t best = kNoRoute;
+
+    auto exact = exact_.find(uri);
+    if (exact != exact_.end()) {
+        best = exact->second;
+    }
+
+    std::vector<HttpStrView> captures;
+    std::vector<HttpStrView> best_captures;
+    trie_match(uri, 0, 0, captures, best, best_captures);
+
+    // 只有优先级更高的正则路由才可能改变结果
+    if (!regex_routes_.empty() && regex_routes_.front() < best) {
+        int idx = regex_set_.match(uri);
+        if (idx >= 0 && regex_routes_[idx] < best) {
+            best = regex_routes_[idx];
+            best_captures.clear();
+        }
+    }
+
+    if (best == kNoRoute) {
+        return NULL;
+    }
+
+    if (params) {
+        params->clear();
+        const std::vector<std::string>& names = routes_[best].params_;
+        for (size_t i = 0; i < names.size() && i < best_captures.size(); ++i) {
+            params->push_back(std::make_pair(names[i], best_captures[i]));
+        }
+    }
+
+    return routes_[best].handler_.get();
+}
+
+} // end namespace tzhttpd
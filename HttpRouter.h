@@ -0,0 +1,137 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __TZHTTPD_HTTP_ROUTER_H__
+#define __TZHTTPD_HTTP_ROUTER_H__
+
+#include <xtra_rhel.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "HttpHandler.h"
+#include "HttpParser.h"
+#include "RegexSet.h"
+
+namespace tzhttpd {
+
+// 路由表，保持注册顺序决定优先级(先注册的优先)的语义
+//
+// 注册的时候对表达式进行分类:
+//   精确匹配  ^/cgi-bin/getdemo\.cgi$           哈希表
+//   字面前缀  ^/static/.*                       字符trie
+//   路径参数  /users/{id:int}/orders/{oid}      字符trie
+//   正则      其他                              合并成一个RegexSet
+// 没有转义的'.'(后面不跟量词)本身就是匹配任意单个字符，在trie中作为通配边处理，
+// 所以 ^/cgi-bin/getdemo.cgi$ 这样的常见写法也走trie，匹配语义和正则完全一致
+// {name}匹配一个或多个非'/'字符，{name:int}匹配一个或多个数字，捕获的结果以相对于
+// uri的偏移返回，路径参数不能和其他正则语法混用，也不能紧跟在另一个参数或者通配的'.'后面
+//
+// 查找的时候通过哈希表和trie得到优先级最高的候选，所有的正则路由一次整体匹配，
+// 取两者中先注册的那个，请求的代价和路径长度相关，而和路由数目无关
+// 路由的增删很少，每次修改都整体重建索引
+
+class HttpRouter {
+
+public:
+
+    struct Route {
+        Route(const std::string& pattern, const HttpHandlerObjectPtr& handler) :
+            pattern_(pattern),
+            handler_(handler),
+            params_() {
+        }
+
+        std::string pattern_;
+        HttpHandlerObjectPtr handler_;
+        std::vector<std::string> params_;   // 路径参数的名字，按照出现的顺序
+    };
+
+    HttpRouter() :
+        routes_(),
+        exact_(),
+        nodes_(1),
+        regex_routes_(),
+        regex_set_() {
+    }
+
+    // 按照表达式本身查找，用于注册、删除时判断是否已经存在
+    HttpHandlerObjectPtr find(const std::string& pattern) const;
+
+    // 表达式非法的时候返回false
+    bool add(const std::string& pattern, const HttpHandlerObjectPtr& handler);
+    bool remove(const std::string& pattern);
+
+    // 替换已有路由的handler，优先级不变
+    bool update(const std::string& pattern, const HttpHandlerObjectPtr& handler);
+
+    // 返回第一个注册的匹配uri的路由，指针在路由表的生命周期内有效
+    // params不为空的时候返回该路由捕获的路径参数
+    HttpHandlerObject* match(const std::string& uri, PathParamContainer* params = NULL) const;
+
+    const std::vector<Route>& routes() const {
+        return routes_;
+    }
+
+private:
+
+    static const size_t kNoRoute = static_cast<size_t>(-1);
+    static const size_t kMaxParams = 16;
+    static const int kAnyChar  = -1;
+    static const int kParamStr = -2;
+    static const int kParamInt = -3;
+
+    enum class RouteKind : uint8_t {
+        kExact   = 1,
+        kPrefix  = 2,
+        kRegex   = 3,
+        kInvalid = 4,
+    };
+
+    // 解析出字面字符序列(kAnyChar表示通配的'.'，kParamXXX表示路径参数)，
+    // 无法处理的返回kRegex
+    static RouteKind classify(const std::string& pattern, std::vector<int>& tokens,
+                              std::vector<std::string>& params);
+
+    struct TrieNode {
+        TrieNode() :
+            children_(),
+            any_(0),
+            param_str_(0),
+            param_int_(0),
+            exact_route_(kNoRoute),
+            prefix_route_(kNoRoute) {
+        }
+
+        std::vector<std::pair<char, uint32_t>> children_;
+        uint32_t any_;              // 通配边，0表示没有(根节点不会作为子节点)
+        uint32_t param_str_;        // {name}
+        uint32_t param_int_;        // {name:int}
+        size_t exact_route_;        // 在此结束的精确匹配路由
+        size_t prefix_route_;       // 以此为前缀的路由
+    };
+
+    bool rebuild();
+    uint32_t trie_insert(const std::vector<int>& tokens);
+
+    // 在trie上从node开始匹配uri[pos:]，找到比best优先级更高的路由的时候记录捕获的参数
+    void trie_match(const std::string& uri, uint32_t node, size_t pos,
+                    std::vector<HttpStrView>& captures,
+                    size_t& best, std::vector<HttpStrView>& best_captures) const;
+
+    std::vector<Route> routes_;
+
+    std::unordered_map<std::string, size_t> exact_;
+    std::vector<TrieNode> nodes_;
+    std::vector<size_t> regex_routes_;      // 升序
+    RegexSet regex_set_;                    // 和regex_routes_一一对应
+};
+
+} // end namespace tzhttpd
+
+#endif // __TZHTTPD_HTTP_ROUTER_H__
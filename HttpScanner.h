@@ -0,0 +1,108 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __TZHTTPD_HTTP_SCANNER_H__
+#define __TZHTTPD_HTTP_SCANNER_H__
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+// HTTP头部解析使用的分隔符查找，一次比较16~32个字节
+//
+// 编译的时候使用了 -march=native，所以直接根据编译器预定义的宏选择实现:
+//   AVX2    : 32字节一组，逐个分隔符比较后 movemask 得到位置
+//   SSE4.2  : 16字节一组，pcmpestri (EQUAL_ANY) 一条指令完成集合查找
+//   其他    : 逐字节比较
+// 不足一组的尾部数据统一按字节处理，所以不会越界读取
+
+namespace tzhttpd {
+
+namespace http_scanner {
+
+// 单次查找支持的最大分隔符数目
+static const size_t kMaxDelims = 4;
+
+static inline const char* find_first_of_scalar(const char* begin, const char* end,
+                                               const char* delims, size_t count) {
+    for (; begin < end; ++begin) {
+        for (size_t i = 0; i < count; ++i) {
+            if (*begin == delims[i]) {
+                return begin;
+            }
+        }
+    }
+
+    return end;
+}
+
+// 在 [begin, end) 中查找第一个属于 delims 的字符，找不到返回 end
+static inline const char* find_first_of(const char* begin, const char* end,
+                                        const char* delims, size_t count) {
+
+    if (count == 0 || count > kMaxDelims) {
+        return end;
+    }
+
+#if defined(__AVX2__)
+
+    __m256i needle[kMaxDelims];
+    for (size_t i = 0; i < count; ++i) {
+        needle[i] = _mm256_set1_epi8(delims[i]);
+    }
+
+    while (end - begin >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        __m256i hit = _mm256_cmpeq_epi8(chunk, needle[0]);
+        for (size_t i = 1; i < count; ++i) {
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(chunk, needle[i]));
+        }
+
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask) {
+            return begin + __builtin_ctz(mask);
+        }
+        begin += 32;
+    }
+
+#elif defined(__SSE4_2__)
+
+    char set[16] = { 0 };
+    for (size_t i = 0; i < count; ++i) {
+        set[i] = delims[i];
+    }
+    __m128i needle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(set));
+
+    while (end - begin >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        int idx = _mm_cmpestri(needle, static_cast<int>(count), chunk, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16) {
+            return begin + idx;
+        }
+        begin += 16;
+    }
+
+#endif
+
+    return find_first_of_scalar(begin, end, delims, count);
+}
+
+static inline const char* find_char(const char* begin, const char* end, char c) {
+    return find_first_of(begin, end, &c, 1);
+}
+
+} // end namespace http_scanner
+
+} // end namespace tzhttpd
+
+#endif // __TZHTTPD_HTTP_SCANNER_H__
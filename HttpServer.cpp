@@ -10,6 +10,7 @@
 #include <signal.h>
 #include <iostream>
 #include <sstream>
+#include <atomic>
 #include <thread>
 #include <functional>
 
@@ -23,6 +24,7 @@
 #include <concurrency/ThreadPool.h>
 
 #include "TcpConnAsync.h"
+#include "TimerWheel.h"
 
 #include "HttpProto.h"
 #include "HttpParser.h"
@@ -63,6 +65,36 @@ static size_t bucket_hash_index_call(const std::shared_ptr<ConnType>& ptr) {
 }
 
 
+// SO_REUSEPORT，多个acceptor侦听同一个地址，由内核在它们之间分配新连接
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+
+// 一个io_service及其上的acceptor和连接超时使用的时间轮
+// 默认模式下只有一个，所有的IO线程共享，按照IO线程数目分成多个加锁的时间轮，
+// 新连接轮流分配，避免所有连接的每次读写都竞争同一把锁；
+// io_service_per_thread模式下每个IO线程一个，时间轮只会在一个线程上访问，不需要加锁
+struct IoServiceContext {
+
+    IoServiceContext(io_service& io, bool shared, size_t wheel_count) :
+        io_service_(io),
+        acceptor_(),
+        timer_wheels_(),
+        next_wheel_(0) {
+
+        for (size_t i = 0; i < std::max<size_t>(wheel_count, 1); ++i) {
+            timer_wheels_.push_back(std::make_shared<TimerWheel>(io, shared));
+        }
+    }
+
+    TimerWheel& pick_timer_wheel() {
+        return *timer_wheels_[next_wheel_++ % timer_wheels_.size()];
+    }
+
+    io_service& io_service_;
+    std::unique_ptr<ip::tcp::acceptor> acceptor_;
+    std::vector<std::shared_ptr<TimerWheel>> timer_wheels_;
+    std::atomic<uint32_t> next_wheel_;
+};
+
 //////
 class HttpServerImpl {
 
@@ -94,13 +126,19 @@ private:
     // boost::asio
     io_service io_service_;
     ip::tcp::endpoint ep_; // 侦听地址信息
-    std::unique_ptr<ip::tcp::acceptor> acceptor_;
+
+    // io_service_per_thread模式下除io_service_之外其余IO线程私有的io_service
+    std::vector<std::shared_ptr<io_service>> private_io_services_;
+    std::vector<std::shared_ptr<IoServiceContext>> io_contexts_;
+    std::atomic<uint32_t> io_thread_index_;
 
     const std::string cfgfile_;
     std::shared_ptr<HttpConf> conf_ptr_;
 
-    void do_accept();
-    void accept_handler(const boost::system::error_code& ec,
+    bool create_acceptor(std::shared_ptr<IoServiceContext> context, bool reuse_port);
+    void do_accept(std::shared_ptr<IoServiceContext> context);
+    void accept_handler(std::shared_ptr<IoServiceContext> context,
+                        const boost::system::error_code& ec,
                         std::shared_ptr<boost::asio::ip::tcp::socket> ptr);
 
 public:
@@ -120,7 +158,9 @@ HttpServerImpl::HttpServerImpl(const std::string& cfgfile, const std::string& in
     super_server_(server),
     io_service_(),
     ep_(),
-    acceptor_(),
+    private_io_services_(),
+    io_contexts_(),
+    io_thread_index_(0),
     cfgfile_(cfgfile),
     conf_ptr_(std::make_shared<HttpConf>()) {
 
@@ -176,6 +216,20 @@ bool HttpServerImpl::init() {
                   conf_ptr_->service_enabled_ ? "true" : "false",
                   conf_ptr_->service_speed_);
 
+    // 第一个IO线程总是使用io_service_，限流定时器等也运行在上面
+    bool shared = !conf_ptr_->io_service_per_thread_;
+    size_t wheel_count = shared ? static_cast<size_t>(conf_ptr_->io_thread_number_) : 1;
+    io_contexts_.push_back(std::make_shared<IoServiceContext>(io_service_, shared, wheel_count));
+    if (conf_ptr_->io_service_per_thread_) {
+        for (int32_t i = 1; i < conf_ptr_->io_thread_number_; ++i) {
+            auto io = std::make_shared<io_service>();
+            private_io_services_.push_back(io);
+            io_contexts_.push_back(std::make_shared<IoServiceContext>(*io, shared, wheel_count));
+        }
+        roo::log_warning("io_service_per_thread enabled, totally %d io_service with SO_REUSEPORT acceptor.",
+                         static_cast<int>(io_contexts_.size()));
+    }
+
     if (!io_service_threads_.init_threads(
             std::bind(&HttpServerImpl::io_service_run, this, std::placeholders::_1),
             conf_ptr_->io_thread_number_)) {
@@ -215,7 +269,12 @@ bool HttpServerImpl::init() {
 // main task loop
 void HttpServerImpl::io_service_run(roo::ThreadObjPtr ptr) {
 
-    roo::log_warning("HttpServerImpl IoService %#lx work... ", (long)pthread_self());
+    // 共享模式下所有线程都运行io_service_，否则每个线程取一个私有的io_service
+    uint32_t index = io_thread_index_++ % io_contexts_.size();
+    io_service& io = io_contexts_[index]->io_service_;
+
+    roo::log_warning("HttpServerImpl IoService %#lx work on io_service %u ... ",
+                     (long)pthread_self(), index);
 
     while (true) {
 
@@ -231,7 +290,7 @@ void HttpServerImpl::io_service_run(roo::ThreadObjPtr ptr) {
         }
 
         boost::system::error_code ec;
-        io_service_.run(ec);
+        io.run(ec);
 
         if (ec) {
             roo::log_err("HttpServerImpl io_service %#lx stopped...", (long)pthread_self());
@@ -245,18 +304,59 @@ void HttpServerImpl::io_service_run(roo::ThreadObjPtr ptr) {
     return;
 }
 
-int HttpServerImpl::service_start() {
+bool HttpServerImpl::create_acceptor(std::shared_ptr<IoServiceContext> context, bool reuse) {
 
-    io_service_threads_.start_threads();
+    boost::system::error_code ec;
+
+    context->acceptor_.reset(new ip::tcp::acceptor(context->io_service_));
+    context->acceptor_->open(ep_.protocol(), ec);
+    if (ec) {
+        roo::log_err("open acceptor failed: %s", ec.message().c_str());
+        return false;
+    }
+
+    context->acceptor_->set_option(ip::tcp::acceptor::reuse_address(true));
+    if (reuse) {
+        context->acceptor_->set_option(reuse_port(true), ec);
+        if (ec) {
+            roo::log_err("set SO_REUSEPORT failed: %s", ec.message().c_str());
+            return false;
+        }
+    }
+
+    context->acceptor_->bind(ep_, ec);
+    if (ec) {
+        roo::log_err("bind acceptor failed: %s", ec.message().c_str());
+        return false;
+    }
+
+    context->acceptor_->listen(conf_ptr_->backlog_size_ > 0 ? conf_ptr_->backlog_size_ : socket_base::max_connections, ec);
+    if (ec) {
+        roo::log_err("listen acceptor failed: %s", ec.message().c_str());
+        return false;
+    }
+
+    return true;
+}
 
-    acceptor_.reset(new ip::tcp::acceptor(io_service_));
-    acceptor_->open(ep_.protocol());
+int HttpServerImpl::service_start() {
 
-    acceptor_->set_option(ip::tcp::acceptor::reuse_address(true));
-    acceptor_->bind(ep_);
-    acceptor_->listen(conf_ptr_->backlog_size_ > 0 ? conf_ptr_->backlog_size_ : socket_base::max_connections);
+    // 私有的io_service必须先有acceptor的异步操作，否则线程中的run()会立即返回
+    bool reuse = conf_ptr_->io_service_per_thread_;
+    for (auto iter = io_contexts_.begin(); iter != io_contexts_.end(); ++iter) {
+        if (!create_acceptor(*iter, reuse)) {
+            roo::log_err("create acceptor for %s:%d failed.",
+                         conf_ptr_->bind_addr_.c_str(), conf_ptr_->bind_port_);
+            return -1;
+        }
 
-    do_accept();
+        for (size_t i = 0; i < (*iter)->timer_wheels_.size(); ++i) {
+            (*iter)->timer_wheels_[i]->start();
+        }
+        do_accept(*iter);
+    }
+
+    io_service_threads_.start_threads();
 
     return 0;
 }
@@ -265,7 +365,9 @@ int HttpServerImpl::service_stop_graceful() {
 
     roo::log_err("about to stop io_service... ");
 
-    io_service_.stop();
+    for (auto iter = io_contexts_.begin(); iter != io_contexts_.end(); ++iter) {
+        (*iter)->io_service_.stop();
+    }
     io_service_threads_.graceful_stop_threads();
     return 0;
 }
@@ -275,25 +377,34 @@ int HttpServerImpl::service_join() {
     roo::log_err("about to join io_service... ");
 
     io_service_threads_.join_threads();
+
+    // 时间轮在io_service_per_thread模式下没有锁保护，只能由自己的IO线程操作，
+    // 所以要等所有的IO线程都退出之后再清理上面的节点
+    for (auto iter = io_contexts_.begin(); iter != io_contexts_.end(); ++iter) {
+        for (size_t i = 0; i < (*iter)->timer_wheels_.size(); ++i) {
+            (*iter)->timer_wheels_[i]->stop();
+        }
+    }
     return 0;
 }
 
 
 
-void HttpServerImpl::do_accept() {
+void HttpServerImpl::do_accept(std::shared_ptr<IoServiceContext> context) {
 
-    auto sock_ptr = std::make_shared<ip::tcp::socket>(io_service_);
+    auto sock_ptr = std::make_shared<ip::tcp::socket>(context->io_service_);
     if (!sock_ptr) {
         roo::log_err("create new socket for acceptor failed!");
         return;
     }
 
-    acceptor_->async_accept(*sock_ptr,
-                            std::bind(&HttpServerImpl::accept_handler, this,
-                                      std::placeholders::_1, sock_ptr));
+    context->acceptor_->async_accept(*sock_ptr,
+                                     std::bind(&HttpServerImpl::accept_handler, this, context,
+                                               std::placeholders::_1, sock_ptr));
 }
 
-void HttpServerImpl::accept_handler(const boost::system::error_code& ec,
+void HttpServerImpl::accept_handler(std::shared_ptr<IoServiceContext> context,
+                                    const boost::system::error_code& ec,
                                     std::shared_ptr<boost::asio::ip::tcp::socket> sock_ptr) {
 
     do {
@@ -340,14 +451,15 @@ void HttpServerImpl::accept_handler(const boost::system::error_code& ec,
             break;
         }
 
-        std::shared_ptr<ConnType> new_conn = std::make_shared<ConnType>(sock_ptr, super_server_);
+        // 连接使用接受它的io_service，io_service_per_thread模式下就一直在这个线程上处理
+        std::shared_ptr<ConnType> new_conn = std::make_shared<ConnType>(sock_ptr, super_server_, context->pick_timer_wheel());
 
         new_conn->start();
 
     } while (0);
 
     // 再次启动接收异步请求
-    do_accept();
+    do_accept(context);
 }
 
 
@@ -362,6 +474,7 @@ int HttpServerImpl::module_status(std::string& module, std::string& key, std::st
     ss << "\t" << "service_addr: " << conf_ptr_->bind_addr_ << "@" << conf_ptr_->bind_port_ << std::endl;
     ss << "\t" << "backlog_size: " << conf_ptr_->backlog_size_ << std::endl;
     ss << "\t" << "io_thread_pool_size: " << conf_ptr_->io_thread_number_ << std::endl;
+    ss << "\t" << "io_service_per_thread: " << (conf_ptr_->io_service_per_thread_ ? "true" : "false") << std::endl;
     ss << "\t" << "safe_ips: ";
 
     {
@@ -496,13 +609,39 @@ int HttpServer::add_http_vhost(const std::string& hostname) {
 }
 
 int HttpServer::add_http_get_handler(const std::string& uri_regex, const HttpGetHandler& handler,
-                                     bool built_in, const std::string hostname) {
-    return Dispatcher::instance().add_http_get_handler(hostname, uri_regex, handler, built_in);
+                                     bool built_in, const std::string hostname, bool run_inline) {
+    return Dispatcher::instance().add_http_get_handler(hostname, uri_regex, handler, built_in, run_inline);
 }
 
 int HttpServer::add_http_post_handler(const std::string& uri_regex, const HttpPostHandler& handler,
-                                      bool built_in, const std::string hostname) {
-    return Dispatcher::instance().add_http_post_handler(hostname, uri_regex, handler, built_in);
+                                      bool built_in, const std::string hostname, bool run_inline) {
+    return Dispatcher::instance().add_http_post_handler(hostname, uri_regex, handler, built_in, run_inline);
+}
+
+int HttpServer::add_http_async_get_handler(const std::string& uri_regex, const HttpAsyncGetHandler& handler,
+                                           bool built_in, const std::string hostname, bool run_inline) {
+    return Dispatcher::instance().add_http_async_get_handler(hostname, uri_regex, handler, built_in, run_inline);
+}
+
+int HttpServer::add_http_async_post_handler(const std::string& uri_regex, const HttpAsyncPostHandler& handler,
+                                            bool built_in, const std::string hostname, bool run_inline) {
+    return Dispatcher::instance().add_http_async_post_handler(hostname, uri_regex, handler, built_in, run_inline);
+}
+
+// 协程handler包装成内联的异步handler，在IO线程中只是启动协程，本身不会阻塞
+int HttpServer::add_http_co_get_handler(const std::string& uri_regex, const HttpCoHandler& handler,
+                                        bool built_in, const std::string hostname) {
+    HttpAsyncGetHandler async_handler =
+        std::bind(&HttpCoContext::spawn, handler, std::placeholders::_1, std::placeholders::_2);
+    return Dispatcher::instance().add_http_async_get_handler(hostname, uri_regex, async_handler, built_in, true);
+}
+
+int HttpServer::add_http_co_post_handler(const std::string& uri_regex, const HttpCoHandler& handler,
+                                         bool built_in, const std::string hostname) {
+    HttpAsyncPostHandler async_handler =
+        std::bind(&HttpCoContext::spawn_post, handler,
+                  std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+    return Dispatcher::instance().add_http_async_post_handler(hostname, uri_regex, async_handler, built_in, true);
 }
 
 int HttpServer::register_http_status_callback(const std::string& name, roo::StatusCallable func) {
@@ -527,6 +666,10 @@ boost::asio::io_service& HttpServer::io_service() const {
     return impl_->io_service_;
 }
 
+bool HttpServer::io_service_per_thread() const {
+    return impl_->conf_ptr_->io_service_per_thread_;
+}
+
 int HttpServer::module_runtime(const libconfig::Config& setting) {
     return impl_->module_runtime(setting);
 }
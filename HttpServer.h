@@ -12,6 +12,7 @@
 #include <scaffold/Setting.h>
 
 #include "HttpHandler.h"
+#include "HttpCoroutine.h"
 
 
 
@@ -50,11 +51,31 @@ public:
     // Proxy to Dispatcher ...
     int add_http_vhost(
         const std::string& hostname);
+    // run_inline的handler在IO线程中直接执行并写回响应，不经过工作线程，
+    // 只能用于不会阻塞的快速处理(比如健康检查)
     int add_http_get_handler(
         const std::string& uri_regex, const HttpGetHandler& handler,
-        bool built_in = false, const std::string hostname = "");
+        bool built_in = false, const std::string hostname = "", bool run_inline = false);
     int add_http_post_handler(
         const std::string& uri_regex, const HttpPostHandler& handler,
+        bool built_in = false, const std::string hostname = "", bool run_inline = false);
+
+    // 异步handler可以立即返回，之后在任何线程中通过HttpResponder完成响应，
+    // 等待后端的时候不占用工作线程
+    int add_http_async_get_handler(
+        const std::string& uri_regex, const HttpAsyncGetHandler& handler,
+        bool built_in = false, const std::string hostname = "", bool run_inline = false);
+    int add_http_async_post_handler(
+        const std::string& uri_regex, const HttpAsyncPostHandler& handler,
+        bool built_in = false, const std::string hostname = "", bool run_inline = false);
+
+    // 协程handler在连接所属的IO线程上以有栈协程的方式运行，可以通过HttpCoContext
+    // 挂起等待(co_sleep、异步socket操作)而不阻塞线程
+    int add_http_co_get_handler(
+        const std::string& uri_regex, const HttpCoHandler& handler,
+        bool built_in = false, const std::string hostname = "");
+    int add_http_co_post_handler(
+        const std::string& uri_regex, const HttpCoHandler& handler,
         bool built_in = false, const std::string hostname = "");
 
     // Proxy to Global ...
@@ -67,6 +88,7 @@ public:
     int ops_cancel_time_out() const;
     int session_cancel_time_out() const;
     boost::asio::io_service& io_service() const;
+    bool io_service_per_thread() const;
 
     int module_runtime(const libconfig::Config& setting);
     int module_status(std::string& module, std::string& key, std::string& value);
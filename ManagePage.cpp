@@ -29,7 +29,8 @@ static int system_drop_handler(const HttpParser& http_parser,
 
 bool system_manage_page_init() {
 
-    if (Dispatcher::instance().add_http_get_handler("", "^/internal/status$", system_status_handler, true) != 0) {
+    // 只收集状态信息，直接在IO线程中处理
+    if (Dispatcher::instance().add_http_get_handler("", "^/internal/status$", system_status_handler, true, true) != 0) {
         roo::log_err("register system status module failed, treat as fatal.");
         return false;
     }
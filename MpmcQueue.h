@@ -0,0 +1,231 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __TZHTTPD_MPMC_QUEUE_H__
+#define __TZHTTPD_MPMC_QUEUE_H__
+
+#include <xtra_rhel.h>
+
+#include <sched.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+
+namespace tzhttpd {
+
+// 有界的多生产者多消费者无锁环形队列(Dmitry Vyukov的实现)
+//
+// 每个槽位带一个序号，生产者和消费者各自通过CAS抢占位置，然后根据序号判断
+// 槽位是否可写、可读，入队出队的快速路径上只有一次CAS，没有锁和系统调用
+//
+// 消费者取不到数据的时候先自旋，再让出CPU，最后才在条件变量上休眠，
+// 生产者只有在确实有消费者休眠的时候才需要加锁唤醒，负载高的时候交接不会进入内核
+// 接口和roo::EQueue保持一致，可以直接替换
+
+template<typename T>
+class MpmcQueue {
+
+    __noncopyable__(MpmcQueue)
+
+public:
+
+    // capacity会向上取整到2的幂
+    explicit MpmcQueue(size_t capacity) :
+        mask_(round_up(capacity) - 1),
+        cells_(mask_ + 1),
+        enqueue_pos_(0),
+        dequeue_pos_(0),
+        sleepers_(0),
+        lock_(),
+        item_notify_() {
+
+        for (size_t i = 0; i < cells_.size(); ++i) {
+            cells_[i].sequence_.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // 队列满的时候返回false
+    bool PUSH(const T& t) {
+
+        if (!try_push(t)) {
+            return false;
+        }
+
+        // 和消费者登记休眠之后的再次检查配对，保证不会丢失唤醒
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(lock_);
+            item_notify_.notify_one();
+        }
+
+        return true;
+    }
+
+    // 等待最多msec毫秒，超时返回false
+    bool POP(T& t, uint64_t msec) {
+
+        if (try_pop(t)) {
+            return true;
+        }
+
+        for (int i = 0; i < kSpinCount; ++i) {
+            cpu_relax();
+            if (try_pop(t)) {
+                return true;
+            }
+        }
+
+        for (int i = 0; i < kYieldCount; ++i) {
+            ::sched_yield();
+            if (try_pop(t)) {
+                return true;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(lock_);
+
+        sleepers_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool ret = try_pop(t);
+        if (!ret) {
+            item_notify_.wait_for(lock, std::chrono::milliseconds(msec));
+            ret = try_pop(t);
+        }
+
+        sleepers_.fetch_sub(1);
+        return ret;
+    }
+
+    // 近似值，只读取两个位置，不会和入队出队竞争
+    size_t SIZE() const {
+        size_t enqueue = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t dequeue = dequeue_pos_.load(std::memory_order_relaxed);
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+
+    bool EMPTY() const {
+        return SIZE() == 0;
+    }
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    // 不等待的版本，满了或者空了直接返回false，也不会唤醒休眠的消费者
+    bool try_push(const T& t) {
+
+        Cell* cell = NULL;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence_.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;   // 满了
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data_ = t;
+        cell->sequence_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& t) {
+
+        Cell* cell = NULL;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence_.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;   // 空的
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        // 取走之后槽位中不再持有对象的引用
+        std::swap(t, cell->data_);
+        cell->data_ = T();
+        cell->sequence_.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+
+    static const int kSpinCount  = 200;
+    static const int kYieldCount = 10;
+
+    static size_t round_up(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __asm__ __volatile__("pause" ::: "memory");
+#else
+        __asm__ __volatile__("" ::: "memory");
+#endif
+    }
+
+    struct Cell {
+        Cell() :
+            sequence_(0),
+            data_() {
+        }
+
+        // vector构造的时候需要，之后不会再拷贝
+        Cell(const Cell& other) :
+            sequence_(other.sequence_.load(std::memory_order_relaxed)),
+            data_(other.data_) {
+        }
+
+        std::atomic<size_t> sequence_;
+        T data_;
+    };
+
+    typedef char CacheLinePad[64];
+
+    size_t mask_;
+    std::vector<Cell> cells_;
+
+    CacheLinePad pad0_;
+    std::atomic<size_t> enqueue_pos_;
+    CacheLinePad pad1_;
+    std::atomic<size_t> dequeue_pos_;
+    CacheLinePad pad2_;
+
+    // 休眠的消费者
+    std::atomic<int> sleepers_;
+    std::mutex lock_;
+    std::condition_variable item_notify_;
+};
+
+} // end namespace tzhttpd
+
+#endif // __TZHTTPD_MPMC_QUEUE_H__
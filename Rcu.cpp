@@ -0,0 +1,150 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <pthread.h>
+
+#include <mutex>
+#include <vector>
+#include <limits>
+
+#include "Rcu.h"
+
+namespace tzhttpd {
+
+struct Rcu::Record {
+
+    Record() :
+        epoch_(0),
+        nesting_(0),
+        in_use_(false) {
+    }
+
+    std::atomic<uint64_t> epoch_;   // 0表示不在临界区
+    uint32_t nesting_;              // 只有所属线程访问
+    bool in_use_;                   // 受lock_保护，线程退出之后可以被复用
+
+    char padding_[64];              // 避免不同线程的槽位共享cache line
+};
+
+struct Retired {
+    uint64_t epoch_;
+    std::function<void()> deleter_;
+};
+
+// 全局epoch从1开始，0用来表示读者不在临界区
+static std::atomic<uint64_t> global_epoch_(1);
+
+static std::mutex lock_;
+static std::vector<Rcu::Record*> records_;
+static std::vector<Retired> retired_;
+
+static pthread_key_t  record_key_;
+static pthread_once_t record_once_ = PTHREAD_ONCE_INIT;
+static __thread Rcu::Record* local_record_ = NULL;
+
+void Rcu::make_key() {
+    ::pthread_key_create(&record_key_, &Rcu::unregister_thread);
+}
+
+Rcu::Record* Rcu::register_thread() {
+
+    ::pthread_once(&record_once_, &Rcu::make_key);
+
+    Record* record = NULL;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        for (size_t i = 0; i < records_.size(); ++i) {
+            if (!records_[i]->in_use_) {
+                record = records_[i];
+                break;
+            }
+        }
+
+        if (!record) {
+            record = new Record();
+            records_.push_back(record);
+        }
+
+        record->in_use_ = true;
+    }
+
+    ::pthread_setspecific(record_key_, record);
+    local_record_ = record;
+    return record;
+}
+
+// 线程退出的时候归还槽位，Record本身不释放，避免写者遍历的时候访问已经释放的内存
+void Rcu::unregister_thread(void* ptr) {
+
+    Record* record = static_cast<Record*>(ptr);
+    record->nesting_ = 0;
+    record->epoch_.store(0, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lock(lock_);
+    record->in_use_ = false;
+}
+
+void Rcu::read_lock() {
+
+    Record* record = local_record_;
+    if (!record) {
+        record = register_thread();
+    }
+
+    if (record->nesting_++ == 0) {
+        record->epoch_.store(global_epoch_.load(std::memory_order_acquire), std::memory_order_relaxed);
+        // 和写者替换指针、检查读者epoch之间的顺序保证
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+void Rcu::read_unlock() {
+
+    Record* record = local_record_;
+    if (--record->nesting_ == 0) {
+        record->epoch_.store(0, std::memory_order_release);
+    }
+}
+
+void Rcu::retire(const std::function<void()>& deleter) {
+
+    std::vector<std::function<void()>> reclaim;
+
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        Retired item;
+        item.epoch_ = global_epoch_.fetch_add(1);
+        item.deleter_ = deleter;
+        retired_.push_back(item);
+
+        uint64_t min_active = std::numeric_limits<uint64_t>::max();
+        for (size_t i = 0; i < records_.size(); ++i) {
+            uint64_t epoch = records_[i]->epoch_.load();
+            if (epoch != 0 && epoch < min_active) {
+                min_active = epoch;
+            }
+        }
+
+        // 读者的epoch比retire时候的epoch新，说明它进入临界区的时候已经看不到旧的指针了
+        for (auto iter = retired_.begin(); iter != retired_.end();) {
+            if (iter->epoch_ < min_active) {
+                reclaim.push_back(iter->deleter_);
+                iter = retired_.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    // 析构可能比较耗时(比如停止缓存的监视线程)，不持有锁
+    for (size_t i = 0; i < reclaim.size(); ++i) {
+        reclaim[i]();
+    }
+}
+
+} // end namespace tzhttpd
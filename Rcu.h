@@ -0,0 +1,118 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __TZHTTPD_RCU_H__
+#define __TZHTTPD_RCU_H__
+
+#include <xtra_rhel.h>
+
+#include <atomic>
+#include <memory>
+#include <functional>
+
+namespace tzhttpd {
+
+// 基于epoch的延迟回收，用于只读快照的发布
+//
+// 读者进入临界区的时候把全局epoch记录到自己线程的槽位里面，退出的时候清零，
+// 整个过程只有线程私有的普通store和一个fence，没有任何原子RMW操作，临界区可以嵌套
+// 写者原子替换指针之后把旧的快照挂到回收链表上，记下当时的epoch并推进全局epoch，
+// 等到所有活跃读者的epoch都比它新的时候才真正释放
+//
+// 写者从不等待读者：回收检查只在每次retire的时候进行，旧快照可能会多存活一段时间，
+// 所以在临界区内执行耗时的handler、或者在handler里面更新配置都是安全的
+
+class Rcu {
+
+public:
+    struct Record;
+
+    static void read_lock();
+    static void read_unlock();
+
+    // 把对象挂到回收链表上，没有读者引用的时候调用deleter
+    static void retire(const std::function<void()>& deleter);
+
+private:
+    static Record* register_thread();
+    static void unregister_thread(void* record);
+    static void make_key();
+};
+
+class RcuReadGuard {
+
+    __noncopyable__(RcuReadGuard)
+
+public:
+    RcuReadGuard() {
+        Rcu::read_lock();
+    }
+
+    ~RcuReadGuard() {
+        Rcu::read_unlock();
+    }
+};
+
+
+// 通过原子指针发布的只读快照，get()必须在RcuReadGuard的保护下调用，
+// 返回的指针在临界区内一直有效
+// 写者之间需要调用者自己串行化(读取-拷贝-修改-store)
+template<typename T>
+class RcuPtr {
+
+    __noncopyable__(RcuPtr)
+
+public:
+    RcuPtr() :
+        node_(NULL) {
+    }
+
+    ~RcuPtr() {
+        delete node_.load();
+    }
+
+    T* get() const {
+        Node* node = node_.load(std::memory_order_acquire);
+        return node ? node->value_.get() : NULL;
+    }
+
+    // 写者以及非热点路径使用，拷贝出来的快照可以离开临界区使用
+    std::shared_ptr<T> load_shared() const {
+        RcuReadGuard guard;
+        Node* node = node_.load(std::memory_order_acquire);
+        return node ? node->value_ : std::shared_ptr<T>();
+    }
+
+    void store(const std::shared_ptr<T>& value) {
+
+        Node* node = new Node(value);
+        Node* old = node_.exchange(node);
+        if (old) {
+            Rcu::retire(std::bind(&RcuPtr::delete_node, old));
+        }
+    }
+
+private:
+
+    struct Node {
+        explicit Node(const std::shared_ptr<T>& value) :
+            value_(value) {
+        }
+
+        std::shared_ptr<T> value_;
+    };
+
+    static void delete_node(Node* node) {
+        delete node;
+    }
+
+    std::atomic<Node*> node_;
+};
+
+} // end namespace tzhttpd
+
+#endif // __TZHTTPD_RCU_H__
@@ -0,0 +1,118 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <other/Log.h>
+
+#include "RegexSet.h"
+
+namespace tzhttpd {
+
+bool RegexSet::has_back_reference(const std::string& pattern) {
+
+    for (size_t i = 0; i + 1 < pattern.size(); ++i) {
+        if (pattern[i] != '\\') {
+            continue;
+        }
+
+        char c = pattern[++i];
+        if ((c >= '1' && c <= '9') || c == 'g' || c == 'k') {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool RegexSet::assign(const std::vector<std::string>& patterns) {
+
+    std::vector<boost::regex> singles;
+    std::vector<size_t> groups;
+    std::string combined_str;
+    bool combinable = true;
+
+    try {
+
+        size_t group = 1;
+        for (size_t i = 0; i < patterns.size(); ++i) {
+
+            boost::regex single(patterns[i]);
+            if (has_back_reference(patterns[i])) {
+                combinable = false;
+            }
+
+            if (i != 0) {
+                combined_str += "|";
+            }
+            combined_str += "(" + patterns[i] + ")";
+
+            groups.push_back(group);
+            group += 1 + single.mark_count();
+
+            singles.push_back(boost::regex());
+            singles.back().swap(single);
+        }
+
+    } catch (boost::regex_error& e) {
+        roo::log_err("compile regex failed: %s", e.what());
+        return false;
+    }
+
+    boost::regex combined;
+    if (combinable && !patterns.empty()) {
+        try {
+            combined.assign(combined_str);
+        } catch (boost::regex_error& e) {
+            roo::log_warning("compile combined regex failed: %s, match one by one.", e.what());
+            combinable = false;
+        }
+    }
+
+    std::vector<std::string> patterns_copy(patterns);
+    patterns_.swap(patterns_copy);
+    combined_.swap(combined);
+    groups_.swap(groups);
+
+    // 可以合并的时候不需要保留单独的表达式
+    if (combinable) {
+        singles.clear();
+    }
+    singles_.swap(singles);
+
+    return true;
+}
+
+int RegexSet::match(const std::string& str) const {
+
+    if (patterns_.empty()) {
+        return -1;
+    }
+
+    boost::smatch what;
+
+    if (!singles_.empty()) {
+        for (size_t i = 0; i < singles_.size(); ++i) {
+            if (boost::regex_match(str, what, singles_[i])) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    if (!boost::regex_match(str, what, combined_)) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < groups_.size(); ++i) {
+        if (what[groups_[i]].matched) {
+            return static_cast<int>(i);
+        }
+    }
+
+    return -1;
+}
+
+} // end namespace tzhttpd
@@ -0,0 +1,78 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __TZHTTPD_REGEX_SET_H__
+#define __TZHTTPD_REGEX_SET_H__
+
+#include <xtra_rhel.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/regex.hpp>
+
+namespace tzhttpd {
+
+// 一组正则表达式编译成一个 (p0)|(p1)|...|(pn) 的整体表达式，一次匹配就得到
+// 第一个(下标最小的)匹配的表达式
+//
+// perl语义的交替是按照从左到右的顺序尝试的，regex_match要求整体匹配，所以第一个
+// 能够整体匹配的分支就是结果，和逐个regex_match的优先级完全一致
+// 每个分支自己的捕获组会使后续分支的组号偏移，这里记录每个分支外层捕获组的编号
+//
+// 包含反向引用(\1 \g等)的表达式合并之后组号会错乱，这种情况下退化成逐个匹配
+
+class RegexSet {
+
+public:
+    RegexSet() :
+        patterns_(),
+        combined_(),
+        groups_(),
+        singles_() {
+    }
+
+    // 表达式非法的时候返回false，原来的内容保持不变
+    bool assign(const std::vector<std::string>& patterns);
+
+    // 返回第一个匹配的表达式下标，没有匹配返回-1
+    int match(const std::string& str) const;
+
+    size_t size() const {
+        return patterns_.size();
+    }
+
+    bool empty() const {
+        return patterns_.empty();
+    }
+
+    const std::string& pattern(size_t idx) const {
+        return patterns_[idx];
+    }
+
+    void swap(RegexSet& other) {
+        patterns_.swap(other.patterns_);
+        combined_.swap(other.combined_);
+        groups_.swap(other.groups_);
+        singles_.swap(other.singles_);
+    }
+
+private:
+
+    static bool has_back_reference(const std::string& pattern);
+
+    std::vector<std::string> patterns_;
+
+    boost::regex combined_;
+    std::vector<size_t> groups_;            // 每个表达式对应的外层捕获组编号
+
+    std::vector<boost::regex> singles_;     // 无法合并的时候逐个匹配
+};
+
+} // end namespace tzhttpd
+
+#endif // __TZHTTPD_REGEX_SET_H__
@@ -30,11 +30,21 @@ public:
 
     // 根据opCode分发rpc请求的处理
     virtual void handle_http_request(std::shared_ptr<HttpReqInstance> http_req_instance) = 0;
+
+    // 在IO线程中调用，请求命中内联handler的时候直接处理完成并返回true，
+    // 否则返回false，由调用者投递到工作线程处理
+    virtual bool handle_http_request_inline(std::shared_ptr<HttpReqInstance> http_req_instance) = 0;
     virtual std::string instance_name() = 0;
 
     //
-    virtual int add_get_handler(const std::string& uri, const HttpGetHandler& handler, bool built_in) = 0;
-    virtual int add_post_handler(const std::string& uri, const HttpPostHandler& handler, bool built_in) = 0;
+    virtual int add_get_handler(const std::string& uri, const HttpGetHandler& handler,
+                                bool built_in, bool run_inline) = 0;
+    virtual int add_post_handler(const std::string& uri, const HttpPostHandler& handler,
+                                 bool built_in, bool run_inline) = 0;
+    virtual int add_async_get_handler(const std::string& uri, const HttpAsyncGetHandler& handler,
+                                      bool built_in, bool run_inline) = 0;
+    virtual int add_async_post_handler(const std::string& uri, const HttpAsyncPostHandler& handler,
+                                       bool built_in, bool run_inline) = 0;
 
     virtual bool exist_handler(const std::string& uri_regex, enum HTTP_METHOD method) = 0;
     virtual int drop_handler(const std::string& uri_regex, enum HTTP_METHOD method) = 0;
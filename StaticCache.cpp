@@ -0,0 +1,357 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <sys/inotify.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstring>
+#include <sstream>
+
+#include <other/Log.h>
+
+#include "StaticCache.h"
+
+namespace tzhttpd {
+
+static const uint32_t kWatchMask =
+    IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+StaticCache::StaticCache(const std::string& docu_root, size_t capacity) :
+    docu_root_(normalize_path(docu_root)),
+    capacity_(capacity),
+    lock_(),
+    lru_(),
+    items_(),
+    used_(0),
+    generation_(0),
+    hit_count_(0),
+    miss_count_(0),
+    inotify_fd_(-1),
+    watches_(),
+    unwatched_(),
+    stop_(false),
+    inotify_thread_() {
+}
+
+StaticCache::~StaticCache() {
+
+    stop_ = true;
+    if (inotify_thread_.joinable()) {
+        inotify_thread_.join();
+    }
+
+    if (inotify_fd_ >= 0) {
+        ::close(inotify_fd_);
+    }
+}
+
+// 合并重复的'/'，去掉结尾的'/'，保证请求解析出来的路径和inotify拼接出来的路径可以直接比较
+std::string StaticCache::normalize_path(const std::string& path) {
+
+    std::string result;
+    result.reserve(path.size());
+    for (size_t i = 0; i < path.size(); ++i) {
+        if (path[i] == '/' && !result.empty() && result[result.size() - 1] == '/') {
+            continue;
+        }
+        result.push_back(path[i]);
+    }
+
+    if (result.size() > 1 && result[result.size() - 1] == '/') {
+        result.erase(result.size() - 1);
+    }
+
+    return result;
+}
+
+bool StaticCache::init() {
+
+    inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        roo::log_err("inotify_init1 failed, errno: %d", errno);
+        return false;
+    }
+
+    if (!watch_directory(docu_root_)) {
+
+        // 根目录都无法监视的时候缓存完全不可用
+        if (watches_.empty()) {
+            roo::log_err("watch docu_root %s failed.", docu_root_.c_str());
+            return false;
+        }
+
+        roo::log_err("%d directories under %s can not be watched (check max_user_watches), "
+                     "files in them will not be cached.",
+                     static_cast<int>(unwatched_.size()), docu_root_.c_str());
+    }
+
+    inotify_thread_ = std::thread(&StaticCache::inotify_run, this);
+
+    roo::log_warning("static cache for %s enabled, capacity %lu bytes, watch %d directories.",
+                     docu_root_.c_str(), static_cast<unsigned long>(capacity_),
+                     static_cast<int>(watches_.size()));
+    return true;
+}
+
+// inotify不支持递归监视，需要把每一级子目录都加入进来
+// 任何一级目录监视失败都返回false，失败的目录记录在unwatched_中，其下的文件不再缓存，
+// 否则这些文件被修改之后不会有任何通知，缓存中的旧内容会一直被使用
+bool StaticCache::watch_directory(const std::string& dir) {
+
+    int wd = ::inotify_add_watch(inotify_fd_, dir.c_str(), kWatchMask | IN_ONLYDIR);
+    if (wd < 0) {
+        roo::log_err("inotify_add_watch %s failed, errno: %d", dir.c_str(), errno);
+        std::lock_guard<std::mutex> lock(lock_);
+        unwatched_.push_back(dir + "/");
+        ++generation_;
+        return false;
+    }
+    watches_[wd] = dir;
+
+    DIR* dp = ::opendir(dir.c_str());
+    if (!dp) {
+        return true;
+    }
+
+    bool ret = true;
+    struct dirent* ent = NULL;
+    while ((ent = ::readdir(dp)) != NULL) {
+        if (::strcmp(ent->d_name, ".") == 0 || ::strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+
+        std::string sub_dir = dir + "/" + ent->d_name;
+
+        // 有些文件系统不填写d_type，需要自己lstat，符号链接和以前一样不跟随
+        if (ent->d_type == DT_UNKNOWN) {
+            struct stat sb;
+            if (::lstat(sub_dir.c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode)) {
+                continue;
+            }
+        } else if (ent->d_type != DT_DIR) {
+            continue;
+        }
+
+        if (!watch_directory(sub_dir)) {
+            ret = false;
+        }
+    }
+    ::closedir(dp);
+
+    return ret;
+}
+
+void StaticCache::inotify_run() {
+
+    char buf[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (!stop_) {
+
+        struct pollfd pfd;
+        pfd.fd = inotify_fd_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        // 超时返回检查退出标志
+        int ret = ::poll(&pfd, 1, 500);
+        if (ret <= 0) {
+            continue;
+        }
+
+        ssize_t len = ::read(inotify_fd_, buf, sizeof(buf));
+        if (len <= 0) {
+            continue;
+        }
+
+        for (char* ptr = buf; ptr < buf + len;) {
+
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                roo::log_warning("inotify queue overflow, drop all static cache.");
+                invalidate_all();
+                continue;
+            }
+
+            auto iter = watches_.find(event->wd);
+            if (iter == watches_.end()) {
+                continue;
+            }
+            std::string dir = iter->second;
+
+            if (event->mask & IN_IGNORED) {
+                watches_.erase(iter);
+                continue;
+            }
+
+            std::string name = event->len ? event->name : "";
+            invalidate(dir, name);
+
+            // 新建的子目录也需要监视
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)) && !name.empty()) {
+                watch_directory(dir + "/" + name);
+            }
+        }
+    }
+}
+
+std::shared_ptr<const StaticCacheEntry> StaticCache::find(const std::string& key) {
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    auto iter = items_.find(key);
+    if (iter == items_.end()) {
+        ++miss_count_;
+        return std::shared_ptr<const StaticCacheEntry>();
+    }
+
+    ++hit_count_;
+    lru_.splice(lru_.begin(), lru_, iter->second.lru_iter_);
+    return iter->second.entry_;
+}
+
+void StaticCache::insert(const std::string& key, std::shared_ptr<const StaticCacheEntry> entry, uint64_t generation) {
+
+    if (!entry || !entry->content_ || entry->content_->size() > max_entry_size()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    if (generation != generation_) {
+        roo::log_info("static cache invalidated during load, skip %s", key.c_str());
+        return;
+    }
+
+    for (auto iter = unwatched_.cbegin(); iter != unwatched_.cend(); ++iter) {
+        if (entry->file_path_.compare(0, iter->size(), *iter) == 0 ||
+            (entry->index_dir_ + "/").compare(0, iter->size(), *iter) == 0) {
+            return;
+        }
+    }
+
+    auto iter = items_.find(key);
+    if (iter != items_.end()) {
+        erase_item(iter);
+    }
+
+    while (!lru_.empty() && used_ + entry->content_->size() > capacity_) {
+        erase_item(items_.find(lru_.back()));
+    }
+
+    lru_.push_front(key);
+    CacheItem item;
+    item.entry_ = entry;
+    item.lru_iter_ = lru_.begin();
+    item.charge_ = entry->content_->size();
+    items_[key] = item;
+    used_ += item.charge_;
+}
+
+bool StaticCache::find_variant(const std::string& key, const std::shared_ptr<const StaticCacheEntry>& entry,
+                               const std::string& encoding, std::shared_ptr<const std::string>& content) {
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    auto iter = items_.find(key);
+    if (iter == items_.end() || iter->second.entry_ != entry) {
+        return false;
+    }
+
+    auto variant = iter->second.variants_.find(encoding);
+    if (variant == iter->second.variants_.end()) {
+        return false;
+    }
+
+    content = variant->second;
+    return true;
+}
+
+void StaticCache::insert_variant(const std::string& key, const std::shared_ptr<const StaticCacheEntry>& entry,
+                                 const std::string& encoding, std::shared_ptr<const std::string> content) {
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    auto iter = items_.find(key);
+    if (iter == items_.end() || iter->second.entry_ != entry ||
+        iter->second.variants_.find(encoding) != iter->second.variants_.end()) {
+        return;
+    }
+
+    size_t size = content ? content->size() : 0;
+    iter->second.variants_[encoding] = content;
+    iter->second.charge_ += size;
+    used_ += size;
+
+    // 不淘汰自己
+    while (used_ > capacity_ && lru_.size() > 1 && lru_.back() != key) {
+        erase_item(items_.find(lru_.back()));
+    }
+}
+
+void StaticCache::erase_item(std::unordered_map<std::string, CacheItem>::iterator iter) {
+
+    used_ -= iter->second.charge_;
+    lru_.erase(iter->second.lru_iter_);
+    items_.erase(iter);
+}
+
+// 目录dir下的name发生了变化
+// 失效对应的文件、目录name之下的所有文件、预压缩文件(.gz)对应的原始文件，
+// 以及通过docu_index在dir中找到的文件(新建的索引文件可能会改变目录对应的文件)
+void StaticCache::invalidate(const std::string& dir, const std::string& name) {
+
+    std::string full = name.empty() ? dir : dir + "/" + name;
+    std::string prefix = full + "/";
+
+    std::lock_guard<std::mutex> lock(lock_);
+    ++generation_;
+
+    for (auto iter = items_.begin(); iter != items_.end();) {
+        const StaticCacheEntry& entry = *iter->second.entry_;
+        if (entry.file_path_ == full || entry.file_path_ + ".gz" == full ||
+            entry.file_path_.compare(0, prefix.size(), prefix) == 0 ||
+            entry.index_dir_ == dir || entry.index_dir_ == full) {
+            roo::log_info("static cache invalidate %s", entry.file_path_.c_str());
+            erase_item(iter++);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+void StaticCache::invalidate_all() {
+
+    std::lock_guard<std::mutex> lock(lock_);
+    ++generation_;
+
+    items_.clear();
+    lru_.clear();
+    used_ = 0;
+}
+
+std::string StaticCache::status() {
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    std::stringstream ss;
+    ss << "items: " << items_.size() << ", used: " << used_ << "/" << capacity_
+       << ", hit: " << hit_count_ << ", miss: " << miss_count_;
+    if (!unwatched_.empty()) {
+        ss << ", unwatched dirs: " << unwatched_.size();
+    }
+    return ss.str();
+}
+
+} // end namespace tzhttpd
@@ -0,0 +1,145 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __TZHTTPD_STATIC_CACHE_H__
+#define __TZHTTPD_STATIC_CACHE_H__
+
+#include <xtra_rhel.h>
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+#include <boost/atomic/atomic.hpp>
+
+namespace tzhttpd {
+
+// 缓存的静态文件，创建之后就不再修改，可以被多个响应同时引用
+struct StaticCacheEntry {
+
+    StaticCacheEntry() :
+        file_path_(),
+        index_dir_(),
+        content_(),
+        etag_(),
+        headers_(),
+        compressible_(false),
+        mtime_(0),
+        size_(0) {
+    }
+
+    std::string file_path_;     // 实际对应的文件
+    std::string index_dir_;     // 通过docu_index找到的时候，请求的目录
+
+    std::shared_ptr<const std::string> content_;
+
+    // 命中时直接用于条件请求判断
+    std::string etag_;
+
+    // 预先生成的完整响应头部(ETag、Last-Modified、缓存控制、内容类型、Vary)，
+    // 命中的时候直接追加，不需要再查找配置
+    std::vector<std::string> headers_;
+    bool compressible_;         // 扩展名配置了压缩
+
+    time_t mtime_;
+    off_t  size_;
+};
+
+// 虚拟主机的静态文件缓存，以请求路径为键
+// 按照内存预算进行LRU淘汰，通过inotify监视docu_root下所有目录的变化来失效，
+// 所以命中的时候不需要任何文件系统调用
+class StaticCache {
+
+    __noncopyable__(StaticCache)
+
+public:
+    StaticCache(const std::string& docu_root, size_t capacity);
+    ~StaticCache();
+
+    bool init();
+
+    std::shared_ptr<const StaticCacheEntry> find(const std::string& key);
+
+    // 在读取文件之前取得generation，插入的时候如果期间发生过失效就放弃插入，
+    // 避免把失效之前读到的旧内容放入缓存
+    uint64_t generation() const {
+        return generation_;
+    }
+    void insert(const std::string& key, std::shared_ptr<const StaticCacheEntry> entry, uint64_t generation);
+
+    // 压缩后的内容(gzip、deflate)和原始内容存放在同一个缓存项中，一起淘汰、一起失效
+    // 只有缓存项仍然是entry的时候才有效(文件修改之后entry就被替换了)
+    // content为空表示已经尝试过，这个编码不值得压缩
+    bool find_variant(const std::string& key, const std::shared_ptr<const StaticCacheEntry>& entry,
+                      const std::string& encoding, std::shared_ptr<const std::string>& content);
+    void insert_variant(const std::string& key, const std::shared_ptr<const StaticCacheEntry>& entry,
+                        const std::string& encoding, std::shared_ptr<const std::string> content);
+
+    // 单个文件超过这个大小就不缓存了，直接sendfile发送
+    size_t max_entry_size() const {
+        return capacity_ / 16;
+    }
+
+    const std::string& docu_root() const {
+        return docu_root_;
+    }
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    // 丢弃所有缓存项，配置变化导致预先生成的头部失效的时候也需要调用
+    void invalidate_all();
+
+    std::string status();
+
+    static std::string normalize_path(const std::string& path);
+
+private:
+
+    typedef std::list<std::string> LruList;
+    struct CacheItem {
+        std::shared_ptr<const StaticCacheEntry> entry_;
+        LruList::iterator lru_iter_;
+        std::map<std::string, std::shared_ptr<const std::string>> variants_;
+        size_t charge_;     // 原始内容和所有压缩内容占用的总大小
+    };
+
+    void erase_item(std::unordered_map<std::string, CacheItem>::iterator iter);
+
+    void invalidate(const std::string& dir, const std::string& name);
+
+    bool watch_directory(const std::string& dir);
+    void inotify_run();
+
+    const std::string docu_root_;
+    const size_t capacity_;
+
+    std::mutex lock_;
+    LruList lru_;       // 头部是最近使用的
+    std::unordered_map<std::string, CacheItem> items_;
+    size_t used_;
+
+    boost::atomic<uint64_t> generation_;
+
+    uint64_t hit_count_;
+    uint64_t miss_count_;
+
+    int inotify_fd_;
+    std::map<int, std::string> watches_;    // 只在inotify线程中访问(初始化之后)
+    std::vector<std::string> unwatched_;    // 无法监视的目录(带结尾的'/')，由lock_保护
+    boost::atomic<bool> stop_;
+    std::thread inotify_thread_;
+};
+
+} // end namespace tzhttpd
+
+#endif // __TZHTTPD_STATIC_CACHE_H__
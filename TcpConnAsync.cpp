@@ -7,6 +7,9 @@
 
 #include <xtra_rhel.h>
 
+#include <sys/sendfile.h>
+#include <errno.h>
+
 #include <thread>
 #include <functional>
 
@@ -33,14 +36,28 @@ extern int default_http_get_handler(const HttpParser& http_parser,
 boost::atomic<int32_t> TcpConnAsync::current_concurrency_(0);
 
 TcpConnAsync::TcpConnAsync(std::shared_ptr<boost::asio::ip::tcp::socket> socket,
-                           HttpServer& server) :
+                           HttpServer& server, TimerWheel& timer_wheel) :
     ConnIf(socket),
+    head_buf_(),
+    head_size_(0),
+    head_parser_(),
+    vhost_memo_(),
     was_cancelled_(false),
     ops_cancel_mutex_(),
-    ops_cancel_timer_(),
-    session_cancel_timer_(),
+    timer_wheel_(timer_wheel),
+    ops_cancel_node_(),
+    session_cancel_node_(),
     http_server_(server),
-    strand_(std::make_shared<boost::asio::io_service::strand>(server.io_service())) {
+    io_service_(timer_wheel.io_service()),
+    strand_() {
+
+    // 节点挂在时间轮上的时候持有连接的引用，所以这里直接使用this
+    ops_cancel_node_.callback_ = std::bind(&TcpConnAsync::ops_cancel_timeout_call, this);
+    session_cancel_node_.callback_ = std::bind(&TcpConnAsync::ops_cancel_timeout_call, this);
+
+    if (!http_server_.io_service_per_thread()) {
+        strand_ = std::make_shared<boost::asio::io_service::strand>(io_service_);
+    }
 
     set_tcp_nodelay(true);
     set_tcp_nonblocking(true);
@@ -78,16 +95,40 @@ void TcpConnAsync::do_read_head() {
         return;
     }
 
-    // roo::log_info("strand read read_until ... in thread %#lx", (long)pthread_self());
+    // 流水线中在处理的请求太多，或者已经读到了该连接的最后一个请求
+    if (pause_read_if_needed()) {
+        return;
+    }
+
+    // 之前读取的时候已经多读了后续请求的数据，先尝试直接解析，数据不够的话
+    // 解析函数中会再发起读操作
+    if (head_size_ > 0) {
+        post_handler(
+            std::bind(&TcpConnAsync::read_head_handler,
+                      shared_from_this(),
+                      boost::system::error_code(), 0));
+        return;
+    }
+
+    do_read_head_some();
+}
+
+void TcpConnAsync::do_read_head_some() {
+
+    if (head_size_ == head_buf_.size()) {
+        head_buf_.resize(std::min(std::max(head_buf_.size() * 2, static_cast<size_t>(kHeadBufferInitSize)),
+                                  static_cast<size_t>(kMaxHeaderSize)));
+    }
+
+    // roo::log_info("strand read async_read_some ... in thread %#lx", (long)pthread_self());
 
     set_session_cancel_timeout();
-    async_read_until(*socket_, request_,
-                     http_proto::header_crlfcrlf_str,
-                     strand_->wrap(
-                         std::bind(&TcpConnAsync::read_head_handler,
-                                   shared_from_this(),
-                                   std::placeholders::_1,
-                                   std::placeholders::_2)));
+    socket_->async_read_some(boost::asio::buffer(&head_buf_[head_size_], head_buf_.size() - head_size_),
+                             wrap_handler(
+                                 std::bind(&TcpConnAsync::read_head_handler,
+                                           shared_from_this(),
+                                           std::placeholders::_1,
+                                           std::placeholders::_2)));
     return;
 }
 
@@ -100,27 +141,60 @@ void TcpConnAsync::read_head_handler(const boost::system::error_code& ec, size_t
         return;
     }
 
+    head_size_ += bytes_transferred;
 
-    boost::system::error_code call_ec;
-    SAFE_ASSERT(bytes_transferred > 0);
+    if (!head_parser_) {
+        head_parser_ = std::make_shared<HttpParser>();
+        if (!head_parser_) {
+            roo::log_err("Create HttpParser object failed.");
+            return;
+        }
+    }
 
-    std::string head_str(boost::asio::buffers_begin(request_.data()),
-                         boost::asio::buffers_begin(request_.data()) + request_.size());
+    // 每次有新的数据到达都从原来的位置继续解析，只有头部完整之后才会开始处理请求
+    enum HttpParseStatus parse_stat = head_parser_->parse_request_header(&head_buf_[0], head_size_);
+    if (parse_stat == HttpParseStatus::kIncomplete) {
+
+        if (head_size_ >= kMaxHeaderSize) {
+            roo::log_err("Request header exceed max size %d, drop it.", static_cast<int>(kMaxHeaderSize));
+            head_parser_.reset();
+            head_size_ = 0;
+            fill_std_http_for_send(std::shared_ptr<HttpParser>(),
+                                   http_proto::StatusCode::client_error_request_header_fields_too_large);
+            do_write_pending();
+
+            // 前面的请求可能还在处理中，start()会暂停读取并持有连接直到响应发送完
+            start();
+            return;
+        }
 
-    request_.consume(bytes_transferred); // skip the already head
+        do_read_head_some();
+        return;
+    }
 
+    boost::system::error_code call_ec;
+    std::shared_ptr<HttpParser> http_parser;
+    http_parser.swap(head_parser_);
 
-    auto http_parser = std::make_shared<HttpParser>();
-    if (!http_parser) {
-        roo::log_err("Create HttpParser object failed.");
-        goto error_return;
-    }
+    if (parse_stat == HttpParseStatus::kError) {
 
-    if (!http_parser->parse_request_header(head_str.c_str())) {
-        roo::log_err("Parse request error: %s", head_str.c_str());
-        goto error_return;
+        // 请求格式错误，后续的数据也无法定界了，回复之后直接关闭连接
+        roo::log_err("Parse request error: %.*s", static_cast<int>(head_size_), &head_buf_[0]);
+        head_size_ = 0;
+        fill_std_http_for_send(std::shared_ptr<HttpParser>(),
+                               http_proto::StatusCode::client_error_bad_request);
+        do_write_pending();
+
+        // 前面的请求可能还在处理中，start()会暂停读取并持有连接直到响应发送完
+        start();
+        return;
     }
 
+    head_consume(http_parser->get_header_length()); // skip the already head
+
+    // 分配流水线序号，之后无论成功还是出错，响应都按照这个序号发送
+    register_request(http_parser);
+
     // 保存远程客户端信息
     http_parser->remote_ = socket_->remote_endpoint(call_ec);
     if (call_ec) {
@@ -149,12 +223,12 @@ void TcpConnAsync::read_head_handler(const boost::system::error_code& ec, size_t
             = std::make_shared<HttpReqInstance>(http_parser->get_method(), shared_from_this(),
                                                 vhost_name, real_path_info,
                                                 http_parser, "");
-        Dispatcher::instance().handle_http_request(http_req_instance);
+        Dispatcher::instance().handle_http_request(http_req_instance, &vhost_memo_);
 
         // 再次开始读取请求，可以shared_from_this()保持住连接
         //
-        // 我们不支持pipeline流水线机制，所以根据HTTP的鸟性，及时是长连接，客户端的下
-        // 一次请求过来，也是等到服务端发送完请求后才会有数据
+        // 支持pipeline流水线机制，缓冲区中已经有的后续请求会被继续解析并且并发
+        // 派发处理，响应通过序号保证按照请求的顺序发送
         //
         start();
         return;
@@ -162,18 +236,13 @@ void TcpConnAsync::read_head_handler(const boost::system::error_code& ec, size_t
 
         size_t len = ::atoi(http_parser->find_request_header(http_proto::header_options::content_length).c_str());
         recv_bound_.length_hint_ = len;  // 登记需要读取的长度
-        size_t additional_size = request_.size(); // net additional body size
-
-        SAFE_ASSERT(additional_size <= len);
 
-        // first async_read_until may read more additional data, if so
-        // then move additional data possible
+        // 读取头部的时候可能已经读到了部分(或者全部)请求体，将其移入请求体缓冲区
+        // 超出请求体长度的数据属于后续的请求，继续保留在头部缓冲区中
+        size_t additional_size = std::min(head_size_, len);
         if (additional_size) {
-
-            std::string additional(boost::asio::buffers_begin(request_.data()),
-                                   boost::asio::buffers_begin(request_.data()) + additional_size);
-            recv_bound_.buffer_.append_internal(additional);
-            request_.consume(additional_size);
+            recv_bound_.buffer_.append(&head_buf_[0], additional_size);
+            head_consume(additional_size);
         }
 
         // normally, we will return these 2 cases
@@ -203,7 +272,6 @@ void TcpConnAsync::read_head_handler(const boost::system::error_code& ec, size_t
 
  error_return:
     fill_std_http_for_send(http_parser, http_proto::StatusCode::server_error_internal_server_error);
-    request_.consume(request_.size());
 
  write_return:
 
@@ -219,11 +287,10 @@ void TcpConnAsync::read_head_handler(const boost::system::error_code& ec, size_t
     // 在这个路径返回的，基本都是异常情况导致的错误返回，此时根据情况看是否发起请求
     // 读操作必须在写操作之前，否则可能会导致引用计数消失
 
-    do_write(http_parser);
+    do_write_pending();
 
-    if (keep_continue(http_parser)) {
-        start();
-    }
+    // 不保持连接的时候do_read_head()会暂停读取，直到响应发送完毕关闭连接
+    start();
 }
 
 void TcpConnAsync::do_read_body(std::shared_ptr<HttpParser> http_parser) {
@@ -242,20 +309,23 @@ void TcpConnAsync::do_read_body(std::shared_ptr<HttpParser> http_parser) {
     }
 
     size_t to_read = std::min(static_cast<size_t>(recv_bound_.length_hint_ - recv_bound_.buffer_.get_length()),
-                              static_cast<size_t>(kFixedIoBufferSize));
+                              static_cast<size_t>(kMaxIoReadSize));
 
-    // roo::log_info("strand read async_read exactly(%lu)... in thread %#lx",
+    // roo::log_info("strand read async_read_some(%lu)... in thread %#lx",
     //              to_read, (long)pthread_self());
 
+    // 直接读入接收缓冲区尾部的可写区域，有多少读多少，不再经过中转拷贝
+    std::vector<boost::asio::mutable_buffer> bufs;
+    recv_bound_.buffer_.prepare(to_read, bufs);
+
     set_ops_cancel_timeout();
-    async_read(*socket_, boost::asio::buffer(recv_bound_.io_block_, to_read),
-               boost::asio::transfer_at_least(to_read),
-               strand_->wrap(
-                   std::bind(&TcpConnAsync::read_body_handler,
-                             shared_from_this(),
-                             http_parser,
-                             std::placeholders::_1,
-                             std::placeholders::_2)));
+    socket_->async_read_some(bufs,
+                             wrap_handler(
+                                 std::bind(&TcpConnAsync::read_body_handler,
+                                           shared_from_this(),
+                                           http_parser,
+                                           std::placeholders::_1,
+                                           std::placeholders::_2)));
     return;
 }
 
@@ -273,8 +343,7 @@ void TcpConnAsync::read_body_handler(std::shared_ptr<HttpParser> http_parser,
     // 如果在读取HTTP头部的同时就将数据也读取出来了，这时候实际的
     // bytes_transferred == 0
     if (bytes_transferred > 0) {
-        std::string additional(recv_bound_.io_block_, bytes_transferred);
-        recv_bound_.buffer_.append_internal(additional);
+        recv_bound_.buffer_.commit(bytes_transferred);
     }
 
     if (recv_bound_.buffer_.get_length() < recv_bound_.length_hint_) {
@@ -296,7 +365,7 @@ void TcpConnAsync::read_body_handler(std::shared_ptr<HttpParser> http_parser,
                                             http_parser, post_body);
 
 
-    Dispatcher::instance().handle_http_request(http_req_instance);
+    Dispatcher::instance().handle_http_request(http_req_instance, &vhost_memo_);
 
     // default, OK
     // go through write return;
@@ -311,56 +380,179 @@ void TcpConnAsync::read_body_handler(std::shared_ptr<HttpParser> http_parser,
     start();
 }
 
-bool TcpConnAsync::do_write(std::shared_ptr<HttpParser> http_parser) {
+bool TcpConnAsync::do_write_pending() {
 
     if (get_conn_stat() != ConnStat::kWorking) {
         roo::log_err("Socket Status Error: %d", get_conn_stat());
         return false;
     }
 
-    if (send_bound_.buffer_.get_length() == 0) {
+    std::vector<boost::asio::const_buffer> buffers;
+    bool closing = false;
+    bool sendfile = false;
 
-        // 看是否关闭主动关闭连接
-        // 因为在读取请求的时候默认就当作长连接发起再次读了，所以如果这里检测到是
-        // 短连接，就采取主动关闭操作，否则就让之前的长连接假设继续生效
-        if (!keep_continue(http_parser)) {
+    {
+        std::lock_guard<std::mutex> lock(send_bound_.lock_);
 
-            revoke_ops_cancel_timeout();
-            ops_cancel();
-            sock_shutdown_and_close(ShutdownType::kBoth);
+        // 已经有写操作在进行中，其回调中会继续发送新追加的分段
+        if (send_bound_.writing_) {
+            return true;
         }
 
+        // 每次取出pending_开头的一组分段: 连续的内存分段合并成一次writev，
+        // 写操作进行中按序完成的多个响应都积累在这里，也就一起发送了；
+        // 文件分段单独通过sendfile发送
+        if (!send_bound_.pending_.empty()) {
+
+            size_t count = 1;
+            if (!send_bound_.pending_[0].file_) {
+                while (count < send_bound_.pending_.size() && !send_bound_.pending_[count].file_) {
+                    ++count;
+                }
+            }
+
+            send_bound_.inflight_.resize(count);
+            for (size_t i = 0; i < count; ++i) {
+                send_bound_.inflight_[i].swap(send_bound_.pending_[i]);
+            }
+            send_bound_.pending_.erase(send_bound_.pending_.begin(), send_bound_.pending_.begin() + count);
+            send_bound_.writing_ = true;
+
+            if (send_bound_.inflight_[0].file_) {
+                sendfile = true;
+            } else {
+                buffers.reserve(count);
+                for (auto iter = send_bound_.inflight_.cbegin(); iter != send_bound_.inflight_.cend(); ++iter) {
+                    if (iter->shared_) {
+                        if (iter->length_ > 0) {
+                            buffers.push_back(boost::asio::buffer(iter->shared_->data() + iter->offset_, iter->length_));
+                        }
+                    } else if (!iter->data_.empty()) {
+                        buffers.push_back(boost::asio::buffer(iter->data_));
+                    }
+                }
+            }
+        }
+
+        if (!sendfile && buffers.empty()) {
+            send_bound_.inflight_.clear();
+            send_bound_.writing_ = false;
+            closing = send_bound_.closing_;
+        }
+    }
+
+    if (sendfile) {
+        do_sendfile();
         return true;
     }
 
-    SAFE_ASSERT(send_bound_.buffer_.get_length() > 0);
+    if (buffers.empty()) {
 
-    size_t to_write = std::min(static_cast<size_t>(send_bound_.buffer_.get_length()),
-                               static_cast<size_t>(kFixedIoBufferSize));
+        // 不保持连接的请求，其响应(以及之前所有的响应)已经发送完毕，主动关闭连接
+        if (closing) {
+            revoke_ops_cancel_timeout();
+            ops_cancel();
+            sock_shutdown_and_close(ShutdownType::kBoth);
+            release_paused_read();
+        }
 
-    // roo::log_info("strand write async_write exactly (%lu)... in thread thread %#lx",
-    //              to_write, (long)pthread_self());
+        return true;
+    }
 
-    send_bound_.buffer_.consume(send_bound_.io_block_, to_write);
+    // roo::log_info("strand write async_write %lu segments ... in thread thread %#lx",
+    //              buffers.size(), (long)pthread_self());
 
+    // 所有的分段作为一个const_buffer序列提交，async_write内部会使用writev
+    // 并在短写的时候自动续写，整个响应只产生一次回调
     set_ops_cancel_timeout();
-    async_write(*socket_, boost::asio::buffer(send_bound_.io_block_, to_write),
-                boost::asio::transfer_exactly(to_write),
-                strand_->wrap(
+    async_write(*socket_, buffers,
+                boost::asio::transfer_all(),
+                wrap_handler(
                     std::bind(&TcpConnAsync::self_write_handler,
                               shared_from_this(),
-                              http_parser,
                               std::placeholders::_1,
                               std::placeholders::_2)));
     return true;
 }
 
+// 在非阻塞的socket上直接调用sendfile(2)，发送缓冲区满了之后等待可写再继续
+// 单个大文件连续发送一定量之后重新投递，避免长时间占用IO线程
+void TcpConnAsync::do_sendfile() {
+
+    SendSegment* segment = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(send_bound_.lock_);
+        SAFE_ASSERT(send_bound_.inflight_.size() == 1 && send_bound_.inflight_[0].file_);
+        segment = &send_bound_.inflight_[0];    // writing_期间inflight_不会被改动
+    }
+
+    size_t burst = 0;
+    while (segment->length_ > 0) {
+
+        ssize_t n = ::sendfile(socket_->native_handle(), segment->file_->fd_, &segment->offset_,
+                               std::min(segment->length_, kSendfileChunkSize));
+        if (n > 0) {
+            segment->length_ -= n;
+            burst += n;
+
+            if (segment->length_ > 0 && burst >= kSendfileBurstSize) {
+                post_handler(std::bind(&TcpConnAsync::do_sendfile, shared_from_this()));
+                return;
+            }
+            continue;
+        }
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            set_ops_cancel_timeout();
+            socket_->async_write_some(boost::asio::null_buffers(),
+                                      wrap_handler(
+                                          std::bind(&TcpConnAsync::sendfile_handler,
+                                                    shared_from_this(),
+                                                    std::placeholders::_1,
+                                                    std::placeholders::_2)));
+            return;
+        }
+
+        // 返回0说明文件在发送过程中被截断了，已经发送的头部无法撤回，只能关闭连接
+        int err = (n < 0) ? errno : EIO;
+        roo::log_err("sendfile failed with %d, remain %lu bytes.", err,
+                     static_cast<unsigned long>(segment->length_));
+        self_write_handler(boost::system::error_code(err, boost::system::system_category()), 0);
+        return;
+    }
+
+    self_write_handler(boost::system::error_code(), burst);
+}
+
+void TcpConnAsync::sendfile_handler(const boost::system::error_code& ec, size_t bytes_transferred) {
 
-void TcpConnAsync::self_write_handler(std::shared_ptr<HttpParser> http_parser,
-                                      const boost::system::error_code& ec, size_t bytes_transferred) {
+    revoke_ops_cancel_timeout();
+
+    if (ec) {
+        self_write_handler(ec, 0);
+        return;
+    }
+
+    do_sendfile();
+}
+
+
+void TcpConnAsync::self_write_handler(const boost::system::error_code& ec, size_t bytes_transferred) {
 
     revoke_ops_cancel_timeout();
 
+    {
+        // 释放已经发送完成的分段
+        std::lock_guard<std::mutex> lock(send_bound_.lock_);
+        send_bound_.inflight_.clear();
+        send_bound_.writing_ = false;
+    }
+
     if (ec) {
         handle_socket_ec(ec);
         return;
@@ -368,23 +560,138 @@ void TcpConnAsync::self_write_handler(std::shared_ptr<HttpParser> http_parser,
 
     SAFE_ASSERT(bytes_transferred > 0);
 
-    //
-    // 再次触发写，如果为空就直接返回
-    // 函数中会检查，如果内容为空，就直接返回不执行写操作
+    // 再次触发写，发送期间按序完成的响应，或者在没有数据的时候检查是否需要关闭连接
+    // 是否关闭连接在响应入队的时候就已经根据各自的请求确定了，这里不再访问
+    // http_parser，之前长连接时这里和新请求头部解析之间的竞争也就不存在了
+    do_write_pending();
+}
+
+
+void TcpConnAsync::register_request(const std::shared_ptr<HttpParser>& http_parser) {
+
+    bool keep_next = keep_continue(http_parser);
+
+    std::lock_guard<std::mutex> lock(send_bound_.lock_);
+    http_parser->pipeline_seq_ = send_bound_.next_seq_++;
 
+    // 不保持连接的请求之后就不再读取新的请求了
+    if (!keep_next && send_bound_.close_seq_ == SendBound::kInvalidSeq) {
+        send_bound_.close_seq_ = http_parser->pipeline_seq_;
+    }
+}
+
+// 当前请求不是该连接的最后一个请求，并且流水线中的请求还没有达到上限时，
+// 才继续读取下一个请求
+bool TcpConnAsync::pause_read_if_needed() {
+
+    {
+        std::lock_guard<std::mutex> lock(send_bound_.lock_);
+
+        if (send_bound_.close_seq_ == SendBound::kInvalidSeq &&
+            send_bound_.next_seq_ - send_bound_.send_seq_ < kMaxPipelineDepth) {
+            return false;
+        }
+
+        // 暂停期间连接上可能没有任何异步操作，而HttpReqInstance只持有弱引用，
+        // 所以这里需要自己持有连接，直到响应入队恢复读取或者连接关闭
+        send_bound_.read_paused_ = true;
+        paused_self_ = shared_from_this();
+    }
+
+    // handler一直不完成或者对端消失的时候，依靠会话超时关闭连接并释放paused_self_
+    set_session_cancel_timeout();
+    return true;
+}
+
+void TcpConnAsync::release_paused_read() {
+
+    std::shared_ptr<TcpConnAsync> self;
 
-    // Bug 这里会有竞争条件 !!!
-    // 当使用http客户端长连接的时候，下面的do_write()如果没有数据会触发
-    // keep_continue()调用，而该实现是遍历http_parser的head来实现的，
-    // 但是此时可能在write_handler调用之前或之中就触发了客户端新的head解析，导致
-    // 该调用访问http_parser会产生问题
+    {
+        std::lock_guard<std::mutex> lock(send_bound_.lock_);
+        send_bound_.read_paused_ = false;
+        self.swap(paused_self_);
+    }
+
+    // 连接已经关闭，暂停期间设置的会话超时不再需要
+    revoke_session_cancel_timeout();
 
-    do_write(http_parser);
+    // self在这里析构，调用者本身都持有连接的引用，所以不会在成员函数中释放this
+}
+
+void TcpConnAsync::enqueue_response(const std::shared_ptr<HttpParser>& http_parser,
+                                    std::vector<SendSegment>& segments) {
+
+    std::shared_ptr<TcpConnAsync> resume;
+
+    {
+        std::lock_guard<std::mutex> lock(send_bound_.lock_);
+
+        uint64_t seq = 0;
+        if (http_parser) {
+            seq = http_parser->pipeline_seq_;
+        } else {
+            // 没有对应请求的响应(请求头部就无法解析)，排在所有已经读取的请求之后，
+            // 发送完就关闭连接
+            seq = send_bound_.next_seq_++;
+            if (send_bound_.close_seq_ == SendBound::kInvalidSeq) {
+                send_bound_.close_seq_ = seq;
+            }
+        }
+
+        if (send_bound_.closing_ || seq < send_bound_.send_seq_) {
+            roo::log_err("connection closing or response for seq %lu already sent, drop it.",
+                         static_cast<unsigned long>(seq));
+            return;
+        }
+
+        // 前面还有请求没有处理完成，先暂存起来
+        if (seq != send_bound_.send_seq_) {
+            send_bound_.completed_[seq].segments_.swap(segments);
+            return;
+        }
+
+        PendingResponse current;
+        current.segments_.swap(segments);
+
+        while (true) {
+
+            for (auto iter = current.segments_.begin(); iter != current.segments_.end(); ++iter) {
+                send_bound_.pending_.push_back(SendSegment());
+                send_bound_.pending_.back().swap(*iter);
+            }
+
+            if (send_bound_.send_seq_++ == send_bound_.close_seq_) {
+                send_bound_.closing_ = true;
+                send_bound_.completed_.clear();
+                break;
+            }
+
+            auto next = send_bound_.completed_.find(send_bound_.send_seq_);
+            if (next == send_bound_.completed_.end()) {
+                break;
+            }
+
+            current.segments_.swap(next->second.segments_);
+            send_bound_.completed_.erase(next);
+        }
+
+        if (send_bound_.read_paused_ &&
+            send_bound_.close_seq_ == SendBound::kInvalidSeq &&
+            send_bound_.next_seq_ - send_bound_.send_seq_ < kMaxPipelineDepth) {
+            send_bound_.read_paused_ = false;
+            resume.swap(paused_self_);
+        }
+    }
+
+    if (resume) {
+        post_handler(std::bind(&TcpConnAsync::do_read_head, resume));
+    }
 }
 
 
 void TcpConnAsync::fill_http_for_send(std::shared_ptr<HttpParser> http_parser,
-                                      const std::string& str, const std::string& status_line,
+                                      std::string& body, const std::string& status_line,
                                       const std::vector<std::string>& additional_header) {
 
     bool keep_next = false;
@@ -397,8 +704,14 @@ void TcpConnAsync::fill_http_for_send(std::shared_ptr<HttpParser> http_parser,
         str_method = HTTP_METHOD_STRING(http_parser->get_method());
     }
 
-    std::string content = http_proto::http_response_generate(str, status_line, keep_next, additional_header);
-    send_bound_.buffer_.append_internal(content);
+    std::vector<SendSegment> segments(1);
+    segments[0].data_ = http_proto::http_response_header_generate(body.size(), status_line, keep_next, additional_header);
+    if (!body.empty()) {
+        segments.push_back(SendSegment());
+        segments.back().data_.swap(body);
+    }
+
+    enqueue_response(http_parser, segments);
 
     roo::log_warning("\n =====> \"%s %s\" %s",
                      str_method.c_str(), str_uri.c_str(), status_line.c_str());
@@ -407,6 +720,47 @@ void TcpConnAsync::fill_http_for_send(std::shared_ptr<HttpParser> http_parser,
 }
 
 
+void TcpConnAsync::fill_body_for_send(std::shared_ptr<HttpParser> http_parser,
+                                      std::vector<SendSegment>& body, const std::string& status_line,
+                                      const std::vector<std::string>& additional_header) {
+
+    bool keep_next = false;
+    std::string str_uri = "UNDETECTED_URI";
+    std::string str_method = "UNDETECTED_METHOD";
+
+    if (http_parser) {
+        keep_next = keep_continue(http_parser);
+        str_uri = http_parser->get_uri();
+        str_method = HTTP_METHOD_STRING(http_parser->get_method());
+    }
+
+    size_t length = 0;
+    for (auto iter = body.begin(); iter != body.end(); ++iter) {
+        SAFE_ASSERT(!iter->file_ || iter->file_->fd_ >= 0);
+        length += iter->prepare();
+    }
+
+    std::vector<SendSegment> segments(1);
+    segments[0].data_ = http_proto::http_response_header_generate(length, status_line, keep_next, additional_header);
+    segments.reserve(body.size() + 1);
+    for (auto iter = body.begin(); iter != body.end(); ++iter) {
+        if (iter->prepare() > 0) {
+            segments.push_back(SendSegment());
+            segments.back().swap(*iter);
+        }
+    }
+    body.clear();
+
+    enqueue_response(http_parser, segments);
+
+    roo::log_warning("\n =====> \"%s %s\" %s (%lu bytes)",
+                     str_method.c_str(), str_uri.c_str(), status_line.c_str(),
+                     static_cast<unsigned long>(length));
+
+    return;
+}
+
+
 void TcpConnAsync::fill_std_http_for_send(std::shared_ptr<HttpParser> http_parser,
                                           enum http_proto::StatusCode code) {
 
@@ -424,10 +778,10 @@ void TcpConnAsync::fill_std_http_for_send(std::shared_ptr<HttpParser> http_parse
 
 
     std::string status_line = generate_response_status_line(http_ver, code);
-    std::string content =
-        http_proto::http_std_response_generate(http_ver, status_line, code, keep_next);
+    std::vector<SendSegment> segments(1);
+    segments[0].data_ = http_proto::http_std_response_generate(http_ver, status_line, code, keep_next);
 
-    send_bound_.buffer_.append_internal(content);
+    enqueue_response(http_parser, segments);
 
     roo::log_warning("\n =====> \"%s %s\" %s",
                      str_method.c_str(), str_uri.c_str(), status_line.c_str());
@@ -461,6 +815,7 @@ bool TcpConnAsync::handle_socket_ec(const boost::system::error_code& ec) {
         revoke_ops_cancel_timeout();
         ops_cancel();
         sock_shutdown_and_close(ShutdownType::kBoth);
+        release_paused_read();
     }
 
     return close_socket;
@@ -492,83 +847,40 @@ bool TcpConnAsync::keep_continue(const std::shared_ptr<HttpParser>& http_parser)
 
 void TcpConnAsync::set_session_cancel_timeout() {
 
-    std::lock_guard<std::mutex> lock(ops_cancel_mutex_);
-
-    if (http_server_.session_cancel_time_out() == 0) {
-        SAFE_ASSERT(!session_cancel_timer_);
+    int32_t time_out = http_server_.session_cancel_time_out();
+    if (time_out <= 0) {
         return;
     }
 
-    // cancel the already timer first if any
-    boost::system::error_code ignore_ec;
-    if (session_cancel_timer_) {
-        session_cancel_timer_->cancel(ignore_ec);
-    } else {
-        session_cancel_timer_.reset(new steady_timer(http_server_.io_service()));
-    }
-
-    SAFE_ASSERT(http_server_.session_cancel_time_out());
-    session_cancel_timer_->expires_from_now(seconds(http_server_.session_cancel_time_out()));
-    session_cancel_timer_->async_wait(std::bind(&TcpConnAsync::ops_cancel_timeout_call, shared_from_this(),
-                                                std::placeholders::_1));
-    roo::log_info("register session_cancel_time_out %d sec", http_server_.session_cancel_time_out());
+    // 重新定时会自动从原来的槽位摘除
+    timer_wheel_.arm(&session_cancel_node_, time_out, shared_from_this());
 }
 
 void TcpConnAsync::revoke_session_cancel_timeout() {
-
-    std::lock_guard<std::mutex> lock(ops_cancel_mutex_);
-
-    boost::system::error_code ignore_ec;
-    if (session_cancel_timer_) {
-        session_cancel_timer_->cancel(ignore_ec);
-    }
+    timer_wheel_.cancel(&session_cancel_node_);
 }
 
 void TcpConnAsync::set_ops_cancel_timeout() {
 
-    std::lock_guard<std::mutex> lock(ops_cancel_mutex_);
-
-    if (http_server_.ops_cancel_time_out() == 0) {
-        SAFE_ASSERT(!ops_cancel_timer_);
+    int32_t time_out = http_server_.ops_cancel_time_out();
+    if (time_out <= 0) {
         return;
     }
 
-    // cancel the already timer first if any
-    boost::system::error_code ignore_ec;
-    if (ops_cancel_timer_) {
-        ops_cancel_timer_->cancel(ignore_ec);
-    } else {
-        ops_cancel_timer_.reset(new steady_timer(http_server_.io_service()));
-    }
-
-    SAFE_ASSERT(http_server_.ops_cancel_time_out());
-    ops_cancel_timer_->expires_from_now(seconds(http_server_.ops_cancel_time_out()));
-    ops_cancel_timer_->async_wait(std::bind(&TcpConnAsync::ops_cancel_timeout_call, shared_from_this(),
-                                            std::placeholders::_1));
-    roo::log_info("register ops_cancel_time_out %d sec", http_server_.ops_cancel_time_out());
+    timer_wheel_.arm(&ops_cancel_node_, time_out, shared_from_this());
 }
 
 void TcpConnAsync::revoke_ops_cancel_timeout() {
-
-    std::lock_guard<std::mutex> lock(ops_cancel_mutex_);
-
-    boost::system::error_code ignore_ec;
-    if (ops_cancel_timer_) {
-        ops_cancel_timer_->cancel(ignore_ec);
-    }
+    timer_wheel_.cancel(&ops_cancel_node_);
 }
 
-void TcpConnAsync::ops_cancel_timeout_call(const boost::system::error_code& ec) {
+void TcpConnAsync::ops_cancel_timeout_call() {
 
-    if (ec == 0) {
-        roo::log_warning("ops_cancel_timeout_call called with timeout: %d", http_server_.ops_cancel_time_out());
-        ops_cancel();
-        sock_shutdown_and_close(ShutdownType::kBoth);
-    } else if (ec == boost::asio::error::operation_aborted) {
-        // normal cancel
-    } else {
-        roo::log_err("unknown and won't handle error_code: {%d} %s", ec.value(), ec.message().c_str());
-    }
+    roo::log_warning("ops_cancel_timeout_call called with timeout, ops: %d, session: %d",
+                     http_server_.ops_cancel_time_out(), http_server_.session_cancel_time_out());
+    ops_cancel();
+    sock_shutdown_and_close(ShutdownType::kBoth);
+    release_paused_read();
 }
 
 
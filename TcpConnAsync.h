@@ -12,11 +12,9 @@
 #include <boost/atomic/atomic.hpp>
 
 #include "ConnIf.h"
+#include "Dispatcher.h"
 #include "HttpParser.h"
-
-#include <boost/chrono.hpp>
-#include <boost/asio/steady_timer.hpp>
-using boost::asio::steady_timer;
+#include "TimerWheel.h"
 
 namespace tzhttpd {
 
@@ -36,7 +34,8 @@ public:
     static boost::atomic<int32_t> current_concurrency_;
 
     /// Construct a connection with the given socket.
-    TcpConnAsync(std::shared_ptr<boost::asio::ip::tcp::socket> socket, HttpServer& server);
+    TcpConnAsync(std::shared_ptr<boost::asio::ip::tcp::socket> socket, HttpServer& server,
+                 TimerWheel& timer_wheel);
     virtual ~TcpConnAsync();
 
     virtual void start();
@@ -60,16 +59,57 @@ private:
     }
 
     void do_read_head();
+    void do_read_head_some();
     void read_head_handler(const boost::system::error_code& ec, std::size_t bytes_transferred);
 
     void do_read_body(std::shared_ptr<HttpParser> http_parser);
     void read_body_handler(std::shared_ptr<HttpParser> http_parser,
                            const boost::system::error_code& ec, std::size_t bytes_transferred);
 
-    bool do_write(std::shared_ptr<HttpParser> http_parser);
+    bool do_write_pending();
+    void do_sendfile();
+    void sendfile_handler(const boost::system::error_code& ec, std::size_t bytes_transferred);
+    // 工作线程中生成响应之后，写操作投递回连接所在的线程(strand)中发起
+    // 内联handler本身就在连接的strand中执行，这时候直接发起写操作
+    void post_write_pending() {
+        dispatch_handler(std::bind(&TcpConnAsync::do_write_pending, shared_from_this()));
+    }
     // std::bind无法使用重载函数，所以这里另起函数名
-    void self_write_handler(std::shared_ptr<HttpParser> http_parser,
-                            const boost::system::error_code& ec, std::size_t bytes_transferred);
+    void self_write_handler(const boost::system::error_code& ec, std::size_t bytes_transferred);
+
+    // 流水线相关: 为读到的请求分配序号，响应按序号排队
+    void register_request(const std::shared_ptr<HttpParser>& http_parser);
+    void enqueue_response(const std::shared_ptr<HttpParser>& http_parser,
+                          std::vector<SendSegment>& segments);
+    bool pause_read_if_needed();
+    void release_paused_read();
+
+    // 异步操作的回调，共享io_service的时候需要经过strand串行化，io_service_per_thread
+    // 模式下连接只会在一个线程上执行，直接调用即可
+    typedef std::function<void(const boost::system::error_code&, std::size_t)> IoHandler;
+    IoHandler wrap_handler(const IoHandler& handler) {
+        if (strand_) {
+            return strand_->wrap(handler);
+        }
+        return handler;
+    }
+
+    void post_handler(const std::function<void()>& handler) {
+        if (strand_) {
+            strand_->post(handler);
+        } else {
+            io_service_.post(handler);
+        }
+    }
+
+    // 已经在连接所在的线程(strand)中的时候直接调用，否则和post_handler一样投递
+    void dispatch_handler(const std::function<void()>& handler) {
+        if (strand_) {
+            strand_->dispatch(handler);
+        } else {
+            io_service_.dispatch(handler);
+        }
+    }
 
     void set_session_cancel_timeout();
     void revoke_session_cancel_timeout();
@@ -87,7 +127,7 @@ private:
         was_cancelled_ = true;
         return was_cancelled_;
     }
-    void ops_cancel_timeout_call(const boost::system::error_code& ec);
+    void ops_cancel_timeout_call();
 
     // 是否Connection长连接
     bool keep_continue(const std::shared_ptr<HttpParser>& http_parser);
@@ -101,7 +141,8 @@ private:
 
     void fill_http_for_send(std::shared_ptr<HttpParser> http_parser,
                             const std::string& str, const std::string& status) {
-        fill_http_for_send(http_parser, str, status, { });
+        std::string msg(str);
+        fill_http_for_send(http_parser, msg, status, { });
     }
 
     void fill_http_for_send(std::shared_ptr<HttpParser> http_parser,
@@ -112,8 +153,15 @@ private:
         return fill_http_for_send(http_parser, msg, status, additional_header);
     }
 
+    // body的内容会被swap取走作为独立的发送分段，调用返回后body为空
     void fill_http_for_send(std::shared_ptr<HttpParser> http_parser,
-                            const std::string& str, const std::string& status,
+                            std::string& body, const std::string& status,
+                            const std::vector<std::string>& additional_header);
+
+    // 响应体由多个分段组成，可以是内存数据、文件片段(通过sendfile发送)或者共享的缓存内容，
+    // body中的分段会被swap取走
+    void fill_body_for_send(std::shared_ptr<HttpParser> http_parser,
+                            std::vector<SendSegment>& body, const std::string& status,
                             const std::vector<std::string>& additional_header);
 
     // 标准的HTTP响应头和响应体
@@ -122,25 +170,49 @@ private:
 
 private:
 
-    // 用于读取HTTP的头部使用
-    boost::asio::streambuf request_;   // client request_ read
+    // 用于读取HTTP的头部使用，解析器直接在其中增量解析
+    // 多读的数据(请求体或者客户端流水线发送的后续请求)也保留在这里
+    std::vector<char> head_buf_;
+    size_t head_size_;
+    std::shared_ptr<HttpParser> head_parser_;   // 当前正在解析的请求
+
+    // 上一个请求解析到的虚拟主机
+    Dispatcher::VhostMemo vhost_memo_;
+
+    // 移除头部缓冲区开头已经处理的n字节
+    void head_consume(size_t n) {
+        SAFE_ASSERT(n <= head_size_);
+        if (n < head_size_) {
+            ::memmove(&head_buf_[0], &head_buf_[n], head_size_ - n);
+        }
+        head_size_ -= n;
+    }
 
     IOBound recv_bound_;
-    IOBound send_bound_;
+    SendBound send_bound_;
+
+    // 暂停读取期间持有自身的引用，由send_bound_.lock_保护
+    std::shared_ptr<TcpConnAsync> paused_self_;
 
     bool was_cancelled_;
     std::mutex ops_cancel_mutex_;
 
+    // 超时都挂在所属io_service的时间轮上，定时和取消不再需要锁和系统调用
+    TimerWheel& timer_wheel_;
+
     // IO操作的最大时长
-    std::unique_ptr<steady_timer> ops_cancel_timer_;
+    TimerWheelNode ops_cancel_node_;
 
     // 会话间隔的最大时长
-    std::unique_ptr<steady_timer> session_cancel_timer_;
+    TimerWheelNode session_cancel_node_;
 
 private:
 
     HttpServer& http_server_;
 
+    // 连接所属的io_service
+    boost::asio::io_service& io_service_;
+
     // Of course, the handlers may still execute concurrently with other handlers that
     // were not dispatched through an boost::asio::strand, or were dispatched through
     // a different boost::asio::strand object.
@@ -150,6 +222,7 @@ private:
     // is no possibility of concurrent execution of the handlers. This is an implicit strand.
 
     // Strand to ensure the connection's handlers are not called concurrently. ???
+    // io_service_per_thread模式下为空
     std::shared_ptr<boost::asio::io_service::strand> strand_;
 
 };
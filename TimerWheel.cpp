@@ -0,0 +1,156 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <vector>
+
+#include <other/Log.h>
+
+#include "TimerWheel.h"
+
+namespace tzhttpd {
+
+TimerWheel::TimerWheel(boost::asio::io_service& io_service, bool thread_safe) :
+    io_service_(io_service),
+    thread_safe_(thread_safe),
+    lock_(),
+    current_tick_(0),
+    tick_timer_(io_service),
+    running_(false) {
+
+    for (size_t i = 0; i < kWheelSlots; ++i) {
+        slots_[i].prev_ = slots_[i].next_ = &slots_[i];
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    stop();
+}
+
+void TimerWheel::start() {
+
+    running_ = true;
+    tick_timer_.expires_from_now(boost::chrono::seconds(1));
+    tick_timer_.async_wait(std::bind(&TimerWheel::tick_handler, this, std::placeholders::_1));
+}
+
+void TimerWheel::stop() {
+
+    boost::system::error_code ignore_ec;
+    running_ = false;
+    tick_timer_.cancel(ignore_ec);
+
+    // 释放所有节点持有的引用
+    std::unique_lock<std::mutex> lock(lock_, std::defer_lock);
+    if (thread_safe_) {
+        lock.lock();
+    }
+
+    for (size_t i = 0; i < kWheelSlots; ++i) {
+        while (slots_[i].next_ != &slots_[i]) {
+            TimerWheelNode* node = slots_[i].next_;
+            unlink(node);
+            node->hold_.reset();
+        }
+    }
+}
+
+void TimerWheel::link(TimerWheelNode* node) {
+
+    TimerWheelNode* head = &slots_[node->expire_tick_ & (kWheelSlots - 1)];
+    node->prev_ = head->prev_;
+    node->next_ = head;
+    head->prev_->next_ = node;
+    head->prev_ = node;
+}
+
+void TimerWheel::unlink(TimerWheelNode* node) {
+
+    node->prev_->next_ = node->next_;
+    node->next_->prev_ = node->prev_;
+    node->prev_ = node->next_ = NULL;
+}
+
+void TimerWheel::arm(TimerWheelNode* node, uint32_t seconds, std::shared_ptr<void> hold) {
+
+    std::unique_lock<std::mutex> lock(lock_, std::defer_lock);
+    if (thread_safe_) {
+        lock.lock();
+    }
+
+    if (node->linked()) {
+        unlink(node);
+    }
+
+    // 下一次tick可能马上就到，多加一个tick保证至少经过seconds秒才超时，实际在[seconds, seconds+1)秒之间
+    node->expire_tick_ = current_tick_ + (seconds > 0 ? seconds : 1) + 1;
+    node->hold_.swap(hold);
+    link(node);
+}
+
+void TimerWheel::cancel(TimerWheelNode* node) {
+
+    std::shared_ptr<void> hold;
+
+    {
+        std::unique_lock<std::mutex> lock(lock_, std::defer_lock);
+        if (thread_safe_) {
+            lock.lock();
+        }
+
+        if (!node->linked()) {
+            return;
+        }
+
+        unlink(node);
+        hold.swap(node->hold_);
+    }
+
+    // hold在锁外释放，可能触发使用者的析构
+}
+
+void TimerWheel::tick_handler(const boost::system::error_code& ec) {
+
+    if (ec || !running_) {
+        return;
+    }
+
+    // 超时的节点先摘下来，在锁外执行回调
+    std::vector<std::pair<std::function<void()>, std::shared_ptr<void>>> expired;
+
+    {
+        std::unique_lock<std::mutex> lock(lock_, std::defer_lock);
+        if (thread_safe_) {
+            lock.lock();
+        }
+
+        ++current_tick_;
+
+        TimerWheelNode* head = &slots_[current_tick_ & (kWheelSlots - 1)];
+        TimerWheelNode* node = head->next_;
+        while (node != head) {
+            TimerWheelNode* next = node->next_;
+            if (node->expire_tick_ <= current_tick_) {
+                unlink(node);
+                expired.push_back(std::make_pair(node->callback_, std::shared_ptr<void>()));
+                expired.back().second.swap(node->hold_);
+            }
+            node = next;
+        }
+    }
+
+    for (size_t i = 0; i < expired.size(); ++i) {
+        if (expired[i].first) {
+            expired[i].first();
+        }
+    }
+
+    // 基于上次的到期时间推进，避免累积误差
+    tick_timer_.expires_at(tick_timer_.expires_at() + boost::chrono::seconds(1));
+    tick_timer_.async_wait(std::bind(&TimerWheel::tick_handler, this, std::placeholders::_1));
+}
+
+} // end namespace tzhttpd
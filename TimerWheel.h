@@ -0,0 +1,101 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __TZHTTPD_TIMER_WHEEL_H__
+#define __TZHTTPD_TIMER_WHEEL_H__
+
+#include <xtra_rhel.h>
+
+#include <mutex>
+#include <memory>
+#include <functional>
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+namespace tzhttpd {
+
+class TimerWheel;
+
+// 时间轮上的定时节点，直接嵌入在使用者(连接)中，挂接和摘除都是侵入式链表操作
+//
+// 挂接期间hold_持有使用者的引用(和原先steady_timer::async_wait绑定shared_from_this()
+// 的语义一致)，保证节点在时间轮上的时候使用者不会被析构，超时或者取消之后释放
+struct TimerWheelNode {
+
+    TimerWheelNode() :
+        prev_(NULL),
+        next_(NULL),
+        expire_tick_(0),
+        callback_(),
+        hold_() {
+    }
+
+    bool linked() const {
+        return prev_ != NULL;
+    }
+
+    TimerWheelNode* prev_;
+    TimerWheelNode* next_;
+    uint64_t expire_tick_;
+
+    std::function<void()> callback_;    // 超时回调，只需要设置一次
+    std::shared_ptr<void> hold_;
+};
+
+
+// 1秒精度的哈希时间轮
+// 节点按照到期的tick散列到各个槽位中，定时、重新定时、取消都是O(1)的，
+// 不涉及系统调用。每个时间轮由自己的一个周期性steady_timer驱动tick，
+// 每次只检查当前槽位中的节点，超过一圈的节点依靠expire_tick_区分
+// 超时的精度是1秒，arm(seconds)之后实际在seconds到seconds+1秒之间到期，不会提前
+//
+// 在io_service_per_thread模式下，时间轮和使用它的连接都只在同一个线程上执行，
+// 不需要任何锁；共享io_service的时候tick和连接可能在不同线程，此时才加锁，
+// 并且每个IO线程对应一个时间轮，连接分散在各个时间轮上，锁只在少量连接之间竞争
+
+class TimerWheel {
+
+    __noncopyable__(TimerWheel)
+
+public:
+    TimerWheel(boost::asio::io_service& io_service, bool thread_safe);
+    ~TimerWheel();
+
+    void start();
+    void stop();
+
+    // 重新定时会先从原来的位置摘除
+    void arm(TimerWheelNode* node, uint32_t seconds, std::shared_ptr<void> hold);
+    void cancel(TimerWheelNode* node);
+
+    boost::asio::io_service& io_service() {
+        return io_service_;
+    }
+
+private:
+
+    static const size_t kWheelSlots = 512;  // 必须是2的幂
+
+    void link(TimerWheelNode* node);
+    void unlink(TimerWheelNode* node);
+    void tick_handler(const boost::system::error_code& ec);
+
+    boost::asio::io_service& io_service_;
+    const bool thread_safe_;
+    std::mutex lock_;
+
+    uint64_t current_tick_;
+    TimerWheelNode slots_[kWheelSlots];     // 每个槽位的哨兵，构成双向循环链表
+
+    boost::asio::steady_timer tick_timer_;
+    bool running_;
+};
+
+} // end namespace tzhttpd
+
+#endif // __TZHTTPD_TIMER_WHEEL_H__
@@ -0,0 +1,212 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#ifndef __TZHTTPD_WORK_STEALING_QUEUE_H__
+#define __TZHTTPD_WORK_STEALING_QUEUE_H__
+
+#include <xtra_rhel.h>
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+
+#include "MpmcQueue.h"
+
+namespace tzhttpd {
+
+// 每个执行线程一个本地队列，空闲的线程从其他线程的队列中窃取
+//
+// 生产者(IO线程)每次在轮转得到的两个槽位中选择负载较小的投递，执行线程优先处理
+// 自己的队列，没有任务的时候按顺序扫描其他槽位，少数慢请求只会阻塞一个线程的
+// 本地队列，排在后面的请求会被其他空闲线程取走
+//
+// 槽位数目是线程数目的上限，线程在运行期间占用一个槽位，挂起和退出的时候释放，
+// 没有占用槽位的线程只窃取。窃取取的是被窃队列中最早的请求，对尾延迟更友好
+// 所有线程在同一个条件变量上休眠，投递的时候只有存在休眠线程才需要唤醒
+
+template<typename T>
+class WorkStealingQueue {
+
+    __noncopyable__(WorkStealingQueue)
+
+public:
+
+    static const size_t kNoSlot = static_cast<size_t>(-1);
+
+    WorkStealingQueue(size_t slot_count, size_t capacity_per_slot) :
+        slots_(),
+        sleepers_(0),
+        lock_(),
+        item_notify_() {
+
+        if (slot_count == 0) {
+            slot_count = 1;
+        }
+
+        for (size_t i = 0; i < slot_count; ++i) {
+            slots_.push_back(std::make_shared<Slot>(capacity_per_slot));
+        }
+    }
+
+    // 线程开始运行的时候占用一个空闲的槽位，没有的时候返回kNoSlot
+    size_t acquire_slot() {
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            bool expect = false;
+            if (slots_[i]->owned_.compare_exchange_strong(expect, true)) {
+                return i;
+            }
+        }
+        return kNoSlot;
+    }
+
+    void release_slot(size_t slot) {
+        if (slot < slots_.size()) {
+            slots_[slot]->owned_.store(false);
+        }
+    }
+
+    // 所有的槽位都满了返回false
+    bool PUSH(const T& t) {
+
+        static __thread size_t round_robin = 0;
+
+        size_t count = slots_.size();
+        size_t first = round_robin++ % count;
+        size_t second = (first + count / 2) % count;
+
+        // 优先投递给有线程占用的、负载较小的槽位
+        size_t target = first;
+        if (slot_score(second) < slot_score(first)) {
+            target = second;
+        }
+
+        bool pushed = slots_[target]->queue_.try_push(t);
+        for (size_t i = 1; !pushed && i < count; ++i) {
+            pushed = slots_[(target + i) % count]->queue_.try_push(t);
+        }
+
+        if (!pushed) {
+            return false;
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(lock_);
+            item_notify_.notify_one();
+        }
+
+        return true;
+    }
+
+    // self是acquire_slot得到的槽位，可以是kNoSlot
+    bool POP(size_t self, T& t, uint64_t msec) {
+
+        if (try_pop(self, t)) {
+            return true;
+        }
+
+        for (int i = 0; i < kSpinCount; ++i) {
+            cpu_relax();
+            if (try_pop(self, t)) {
+                return true;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(lock_);
+
+        sleepers_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool ret = try_pop(self, t);
+        if (!ret) {
+            item_notify_.wait_for(lock, std::chrono::milliseconds(msec));
+            ret = try_pop(self, t);
+        }
+
+        sleepers_.fetch_sub(1);
+        return ret;
+    }
+
+    size_t SIZE() const {
+        size_t total = 0;
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            total += slots_[i]->queue_.SIZE();
+        }
+        return total;
+    }
+
+    // 不等待，也不会唤醒休眠的消费者，self可以是kNoSlot
+    bool try_pop(size_t self, T& t) {
+
+        if (self < slots_.size() && slots_[self]->queue_.try_pop(t)) {
+            return true;
+        }
+
+        size_t count = slots_.size();
+        size_t start = self < count ? self + 1 : 0;
+        for (size_t i = 0; i < count; ++i) {
+            size_t victim = (start + i) % count;
+            if (victim != self && slots_[victim]->queue_.try_pop(t)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    size_t slot_count() const {
+        return slots_.size();
+    }
+
+    size_t capacity() const {
+        return slots_.size() * slots_[0]->queue_.capacity();
+    }
+
+private:
+
+    static const int kSpinCount = 200;
+
+    static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __asm__ __volatile__("pause" ::: "memory");
+#else
+        __asm__ __volatile__("" ::: "memory");
+#endif
+    }
+
+    struct Slot {
+        explicit Slot(size_t capacity) :
+            queue_(capacity),
+            owned_(false) {
+        }
+
+        MpmcQueue<T> queue_;
+        std::atomic<bool> owned_;
+    };
+
+    // 没有线程占用的槽位只能等待被窃取，尽量不往里面投递
+    size_t slot_score(size_t slot) const {
+        size_t score = slots_[slot]->queue_.SIZE();
+        if (!slots_[slot]->owned_.load(std::memory_order_relaxed)) {
+            score += slots_[slot]->queue_.capacity();
+        }
+        return score;
+    }
+
+    std::vector<std::shared_ptr<Slot>> slots_;
+
+    std::atomic<int> sleepers_;
+    std::mutex lock_;
+    std::condition_variable item_notify_;
+};
+
+} // end namespace tzhttpd
+
+#endif // __TZHTTPD_WORK_STEALING_QUEUE_H__
@@ -7,7 +7,7 @@ g++ -std=c++0x -g -O0 -DNP_DEBUG -Wall  main.cpp setup.cpp \
     -L../build/ -L../../xtra_rhelz.x/libs/ -L../../xtra_rhelz.x/libs/google/ \
     -L../../xtra_rhelz.x/libs/boost/ \
     -ltzhttpd libRoo.a \
-    -lboost_system -lboost_thread -lboost_chrono -lboost_regex \
+    -lboost_system -lboost_thread -lboost_chrono -lboost_regex -lboost_coroutine -lboost_context \
     -lpthread -lrt -rdynamic -ldl -lconfig++ -lssl -lcryptopp -lcrypto \
     -lglog_syslog \
     -o httpsrv
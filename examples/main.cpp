@@ -31,6 +31,14 @@ int get_test_handler(const HttpParser& http_parser,
     return 0;
 }
 
+// 异步handler: 保存responder之后立即返回，通常在后端调用的回调里面(任何线程)完成响应
+void get_async_test_handler(const HttpParser& http_parser, std::shared_ptr<HttpResponder> responder) {
+    std::string response = "async test uri called...";
+    std::vector<std::string> add_header;
+    std::string status_line = generate_response_status_line(http_parser.get_version(), StatusCode::success_ok);
+    responder->complete(0, response, status_line, add_header);
+}
+
 namespace http_handler {
 extern std::string http_server_version;
 }
@@ -142,6 +150,7 @@ int main(int argc, char* argv[]) {
     }
 
     http_server_ptr->add_http_get_handler("^/test$", tzhttpd::get_test_handler);
+    http_server_ptr->add_http_async_get_handler("^/async_test$", tzhttpd::get_async_test_handler);
     http_server_ptr->register_http_status_callback("httpsrv", module_status);
 
     http_server_ptr->io_service_threads_.start_threads();
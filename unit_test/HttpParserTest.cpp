@@ -0,0 +1,186 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../HttpParser.h"
+
+using namespace tzhttpd;
+
+static const char* kSimpleRequest =
+    "GET /cgi-bin/getdemo.cgi?name=tzhttpd&id=12 HTTP/1.1\r\n"
+    "Host: 127.0.0.1:18430\r\n"
+    "User-Agent: unit-test\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "X-Request-Id: abcdef\r\n"
+    "\r\n";
+
+static std::string make_request(size_t header_count) {
+
+    std::string request = "GET /index.html HTTP/1.1\r\n";
+    for (size_t i = 0; i < header_count; ++i) {
+        request += "X-Header-" + std::to_string(i) + ": " + std::to_string(i) + "\r\n";
+    }
+    request += "\r\n";
+    return request;
+}
+
+static void check_simple_request(HttpParser& parser) {
+    EXPECT_EQ(HTTP_METHOD::GET, parser.get_method());
+    EXPECT_EQ("/cgi-bin/getdemo.cgi?name=tzhttpd&id=12", parser.get_uri());
+    ASSERT_TRUE(parser.parse_request_uri());
+    EXPECT_EQ("/cgi-bin/getdemo.cgi", parser.get_request_path_info());
+    EXPECT_EQ("127.0.0.1:18430", parser.find_request_header("Host"));
+    EXPECT_EQ("unit-test", parser.find_request_header("User-Agent"));
+    EXPECT_EQ("gzip, deflate", parser.find_request_header("Accept-Encoding"));
+    EXPECT_EQ("abcdef", parser.find_request_header("X-Request-Id"));
+}
+
+TEST(HttpParserTest, WholeRequest) {
+
+    std::string request(kSimpleRequest);
+    request += "POSTDATA";
+
+    HttpParser parser;
+    ASSERT_EQ(HttpParseStatus::kComplete, parser.parse_request_header(request.data(), request.size()));
+    EXPECT_EQ(request.size() - 8, parser.get_header_length());
+    check_simple_request(parser);
+}
+
+// 每次只多给一个字节，模拟头部被拆分到任意位置的情况
+TEST(HttpParserTest, SplitByteFeed) {
+
+    std::string request(kSimpleRequest);
+
+    HttpParser parser;
+    for (size_t len = 0; len < request.size(); ++len) {
+        ASSERT_EQ(HttpParseStatus::kIncomplete, parser.parse_request_header(request.data(), len))
+            << "len " << len;
+    }
+    ASSERT_EQ(HttpParseStatus::kComplete, parser.parse_request_header(request.data(), request.size()));
+    EXPECT_EQ(request.size(), parser.get_header_length());
+    check_simple_request(parser);
+}
+
+// 在每一个位置拆成两次，\r和\n被分开的情况也要正确处理
+TEST(HttpParserTest, SplitTwoParts) {
+
+    std::string request(kSimpleRequest);
+
+    for (size_t split = 1; split < request.size(); ++split) {
+        HttpParser parser;
+        ASSERT_EQ(HttpParseStatus::kIncomplete, parser.parse_request_header(request.data(), split))
+            << "split " << split;
+        ASSERT_EQ(HttpParseStatus::kComplete, parser.parse_request_header(request.data(), request.size()))
+            << "split " << split;
+        check_simple_request(parser);
+    }
+}
+
+TEST(HttpParserTest, HeaderCountLimit) {
+
+    std::string request = make_request(HttpParser::kMaxHeaderCount);
+    HttpParser parser;
+    ASSERT_EQ(HttpParseStatus::kComplete, parser.parse_request_header(request.data(), request.size()));
+    for (size_t i = 0; i < HttpParser::kMaxHeaderCount; ++i) {
+        EXPECT_EQ(std::to_string(i), parser.find_request_header("X-Header-" + std::to_string(i)));
+    }
+
+    std::string overflow = make_request(HttpParser::kMaxHeaderCount + 1);
+    HttpParser overflow_parser;
+    EXPECT_EQ(HttpParseStatus::kError, overflow_parser.parse_request_header(overflow.data(), overflow.size()));
+}
+
+TEST(HttpParserTest, DuplicateHeaders) {
+
+    std::string request =
+        "GET / HTTP/1.1\r\n"
+        "Host: first.example.com\r\n"
+        "X-Forwarded-For: 10.0.0.1\r\n"
+        "host: second.example.com\r\n"
+        "x-forwarded-for: 10.0.0.2\r\n"
+        "\r\n";
+
+    // 重复的头部只返回第一个
+    HttpParser parser;
+    ASSERT_EQ(HttpParseStatus::kComplete, parser.parse_request_header(request.data(), request.size()));
+    EXPECT_EQ("first.example.com", parser.find_request_header("Host"));
+    EXPECT_EQ("10.0.0.1", parser.find_request_header("X-Forwarded-For"));
+}
+
+TEST(HttpParserTest, CaseInsensitiveHeaders) {
+
+    std::string request =
+        "GET / HTTP/1.1\r\n"
+        "CONTENT-LENGTH: 10\r\n"
+        "x-custom-header:   padded value  \r\n"
+        "\r\n";
+
+    HttpParser parser;
+    ASSERT_EQ(HttpParseStatus::kComplete, parser.parse_request_header(request.data(), request.size()));
+    EXPECT_EQ("10", parser.find_request_header("Content-Length"));
+    EXPECT_EQ("10", parser.find_request_header("content-length"));
+    EXPECT_EQ("padded value", parser.find_request_header("X-Custom-Header"));
+    EXPECT_EQ("padded value", parser.find_request_header("X-CUSTOM-HEADER"));
+    EXPECT_EQ("", parser.find_request_header("X-Missing"));
+}
+
+// 常用头部的完美哈希只用到长度和首尾字符，和它们冲突的其他头部
+// 必须落到通用的哈希表中，两者互不覆盖
+TEST(HttpParserTest, KnownHeaderSlotCollision) {
+
+    const char* known[] = {
+        "Cookie", "Accept", "Authorization", "Transfer-Encoding", "Content-Type",
+        "Content-Range", "Range", "Content-Length", "Content-Encoding", "Connection",
+        "Proxy-Connection", "Host", "User-Agent", "If-None-Match", "If-Modified-Since",
+        "Referer", "Accept-Encoding",
+    };
+
+    std::string request = "GET / HTTP/1.1\r\n";
+    std::vector<std::string> colliders;
+    for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); ++i) {
+        // 长度、首尾字符都相同，中间不同
+        std::string name(known[i]);
+        std::string collider(name);
+        for (size_t j = 1; j + 1 < collider.size(); ++j) {
+            collider[j] = 'z';
+        }
+        colliders.push_back(collider);
+
+        // 冲突的头部放在前面，确认不会占用常用头部的槽位
+        request += collider + ": collider-" + std::to_string(i) + "\r\n";
+        request += name + ": known-" + std::to_string(i) + "\r\n";
+    }
+    request += "\r\n";
+
+    HttpParser parser;
+    ASSERT_EQ(HttpParseStatus::kComplete, parser.parse_request_header(request.data(), request.size()));
+    for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); ++i) {
+        EXPECT_EQ("known-" + std::to_string(i), parser.find_request_header(known[i])) << known[i];
+        EXPECT_EQ("collider-" + std::to_string(i), parser.find_request_header(colliders[i])) << colliders[i];
+    }
+}
+
+TEST(HttpParserTest, InvalidRequest) {
+
+    // 没有':'的头部行被忽略，不影响后面的头部
+    std::string no_colon =
+        "GET / HTTP/1.1\r\n"
+        "Broken header line\r\n"
+        "Host: localhost\r\n"
+        "\r\n";
+    HttpParser parser;
+    ASSERT_EQ(HttpParseStatus::kComplete, parser.parse_request_header(no_colon.data(), no_colon.size()));
+    EXPECT_EQ("localhost", parser.find_request_header("Host"));
+
+    std::string bad_line = "GARBAGE\r\n\r\n";
+    HttpParser bad_parser;
+    EXPECT_EQ(HttpParseStatus::kError, bad_parser.parse_request_header(bad_line.data(), bad_line.size()));
+}
@@ -0,0 +1,132 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../HttpProto.h"
+
+using namespace tzhttpd;
+
+typedef std::vector<std::pair<off_t, off_t>> RangeVec;
+
+static RangeVec make_ranges(off_t s0, off_t e0) {
+    return RangeVec(1, std::make_pair(s0, e0));
+}
+
+TEST(HttpProtoTest, SingleRange) {
+
+    RangeVec ranges;
+    EXPECT_EQ(1, http_proto::parse_byte_ranges("bytes=0-99", 1000, ranges));
+    EXPECT_EQ(make_ranges(0, 99), ranges);
+
+    // 结束位置超过文件大小的截断到最后一个字节
+    ranges.clear();
+    EXPECT_EQ(1, http_proto::parse_byte_ranges("bytes=900-2000", 1000, ranges));
+    EXPECT_EQ(make_ranges(900, 999), ranges);
+
+    // 没有结束位置的到文件末尾
+    ranges.clear();
+    EXPECT_EQ(1, http_proto::parse_byte_ranges(" Bytes=500- ", 1000, ranges));
+    EXPECT_EQ(make_ranges(500, 999), ranges);
+}
+
+TEST(HttpProtoTest, SuffixRange) {
+
+    RangeVec ranges;
+    EXPECT_EQ(1, http_proto::parse_byte_ranges("bytes=-100", 1000, ranges));
+    EXPECT_EQ(make_ranges(900, 999), ranges);
+
+    // 后缀比文件大的时候返回整个文件
+    ranges.clear();
+    EXPECT_EQ(1, http_proto::parse_byte_ranges("bytes=-5000", 1000, ranges));
+    EXPECT_EQ(make_ranges(0, 999), ranges);
+
+    // 长度为0的后缀不能满足
+    ranges.clear();
+    EXPECT_EQ(0, http_proto::parse_byte_ranges("bytes=-0", 1000, ranges));
+    EXPECT_TRUE(ranges.empty());
+}
+
+TEST(HttpProtoTest, MultipleRanges) {
+
+    RangeVec ranges;
+    EXPECT_EQ(1, http_proto::parse_byte_ranges("bytes=0-9, 20-29, -10", 1000, ranges));
+    ASSERT_EQ(3u, ranges.size());
+    EXPECT_EQ(std::make_pair(off_t(0), off_t(9)), ranges[0]);
+    EXPECT_EQ(std::make_pair(off_t(20), off_t(29)), ranges[1]);
+    EXPECT_EQ(std::make_pair(off_t(990), off_t(999)), ranges[2]);
+
+    // 不能满足的区间被跳过，其余的仍然有效
+    ranges.clear();
+    EXPECT_EQ(1, http_proto::parse_byte_ranges("bytes=5000-6000,0-9", 1000, ranges));
+    EXPECT_EQ(make_ranges(0, 9), ranges);
+}
+
+// 所有区间都在文件之外，返回0由调用者响应416
+TEST(HttpProtoTest, Unsatisfiable) {
+
+    RangeVec ranges;
+    EXPECT_EQ(0, http_proto::parse_byte_ranges("bytes=1000-", 1000, ranges));
+    EXPECT_TRUE(ranges.empty());
+
+    EXPECT_EQ(0, http_proto::parse_byte_ranges("bytes=2000-3000,1000-1001", 1000, ranges));
+    EXPECT_TRUE(ranges.empty());
+
+    EXPECT_EQ(0, http_proto::parse_byte_ranges("bytes=0-", 0, ranges));
+    EXPECT_EQ(0, http_proto::parse_byte_ranges("bytes=-10", 0, ranges));
+    EXPECT_TRUE(ranges.empty());
+}
+
+// 重叠的区间总长度超过文件大小的，退化为完整响应
+TEST(HttpProtoTest, OverlapFallback) {
+
+    RangeVec ranges;
+    EXPECT_EQ(-1, http_proto::parse_byte_ranges("bytes=0-599,400-999", 1000, ranges));
+    EXPECT_TRUE(ranges.empty());
+
+    std::string many = "bytes=0-";
+    for (int i = 0; i < 10; ++i) {
+        many += ",0-";
+    }
+    EXPECT_EQ(-1, http_proto::parse_byte_ranges(many, 1000, ranges));
+    EXPECT_TRUE(ranges.empty());
+
+    // 重叠但是总长度没有超过文件大小的照常处理
+    EXPECT_EQ(1, http_proto::parse_byte_ranges("bytes=0-99,50-149", 1000, ranges));
+    EXPECT_EQ(2u, ranges.size());
+}
+
+// 无法解析的Range被忽略，按照完整响应处理
+TEST(HttpProtoTest, Malformed) {
+
+    const char* malformed[] = {
+        "items=0-99",
+        "bytes=abc",
+        "bytes=99-0",
+        "bytes=-",
+        "bytes=1-2-3",
+        "bytes=x-10",
+        "bytes=10-y",
+        "bytes=--10",
+    };
+
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); ++i) {
+        RangeVec ranges;
+        EXPECT_EQ(-1, http_proto::parse_byte_ranges(malformed[i], 1000, ranges)) << malformed[i];
+    }
+
+    // 区间数目过多
+    std::string too_many = "bytes=0-0";
+    for (int i = 1; i < 1000; ++i) {
+        too_many += "," + std::to_string(i) + "-" + std::to_string(i);
+    }
+    RangeVec ranges;
+    EXPECT_EQ(-1, http_proto::parse_byte_ranges(too_many, 1000, ranges));
+}
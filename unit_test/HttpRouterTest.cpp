@@ -0,0 +1,176 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../HttpRouter.h"
+
+using namespace tzhttpd;
+
+static int dummy_handler(const HttpParser& http_parser,
+                         std::string& response, std::string& status_line, std::vector<std::string>& add_header) {
+    return 0;
+}
+
+static HttpHandlerObjectPtr make_handler(const std::string& path) {
+    return std::make_shared<HttpHandlerObject>(path, HttpGetHandler(dummy_handler));
+}
+
+static const char* matched_path(const HttpRouter& router, const std::string& uri,
+                                PathParamContainer* params = NULL) {
+    HttpHandlerObject* handler = router.match(uri, params);
+    return handler ? handler->path_.c_str() : "";
+}
+
+static std::string capture(const std::string& uri, const PathParamContainer& params, const std::string& name) {
+    for (size_t i = 0; i < params.size(); ++i) {
+        if (params[i].first == name) {
+            return uri.substr(params[i].second.offset_, params[i].second.length_);
+        }
+    }
+    return "<none>";
+}
+
+TEST(HttpRouterTest, ExactTrieRegex) {
+
+    HttpRouter router;
+    ASSERT_TRUE(router.add("^/cgi-bin/getdemo\\.cgi$", make_handler("exact")));
+    ASSERT_TRUE(router.add("^/static/.*", make_handler("prefix")));
+    ASSERT_TRUE(router.add("^/api/v[0-9]+/ping$", make_handler("regex")));
+
+    EXPECT_STREQ("exact", matched_path(router, "/cgi-bin/getdemo.cgi"));
+    EXPECT_STREQ("", matched_path(router, "/cgi-bin/getdemoxcgi"));
+    EXPECT_STREQ("prefix", matched_path(router, "/static/css/site.css"));
+    EXPECT_STREQ("regex", matched_path(router, "/api/v12/ping"));
+    EXPECT_STREQ("", matched_path(router, "/api/vx/ping"));
+    EXPECT_STREQ("", matched_path(router, "/unknown"));
+}
+
+// 无论落在哪一种索引中，都是先注册的优先
+TEST(HttpRouterTest, RegistrationOrderPriority) {
+
+    HttpRouter router;
+    ASSERT_TRUE(router.add("^/(static|assets)/.*\\.js$", make_handler("regex")));
+    ASSERT_TRUE(router.add("^/static/.*", make_handler("prefix")));
+    ASSERT_TRUE(router.add("^/static/app\\.js$", make_handler("exact")));
+
+    EXPECT_STREQ("regex", matched_path(router, "/static/app.js"));
+    EXPECT_STREQ("prefix", matched_path(router, "/static/app.css"));
+    EXPECT_STREQ("regex", matched_path(router, "/assets/lib.js"));
+
+    HttpRouter reverse;
+    ASSERT_TRUE(reverse.add("^/static/app\\.js$", make_handler("exact")));
+    ASSERT_TRUE(reverse.add("^/static/.*", make_handler("prefix")));
+    ASSERT_TRUE(reverse.add("^/(static|assets)/.*\\.js$", make_handler("regex")));
+
+    EXPECT_STREQ("exact", matched_path(reverse, "/static/app.js"));
+    EXPECT_STREQ("prefix", matched_path(reverse, "/static/lib.js"));
+    EXPECT_STREQ("regex", matched_path(reverse, "/assets/lib.js"));
+}
+
+// 没有转义的'.'匹配任意单个字符，和正则的语义一致
+TEST(HttpRouterTest, UnescapedDot) {
+
+    HttpRouter router;
+    ASSERT_TRUE(router.add("^/cgi-bin/getdemo.cgi$", make_handler("dot")));
+
+    EXPECT_STREQ("dot", matched_path(router, "/cgi-bin/getdemo.cgi"));
+    EXPECT_STREQ("dot", matched_path(router, "/cgi-bin/getdemoxcgi"));
+    EXPECT_STREQ("", matched_path(router, "/cgi-bin/getdemo.cgi2"));
+}
+
+TEST(HttpRouterTest, PathParams) {
+
+    HttpRouter router;
+    ASSERT_TRUE(router.add("/users/{id:int}/orders/{oid}", make_handler("orders")));
+    ASSERT_TRUE(router.add("/users/{name}", make_handler("user")));
+
+    PathParamContainer params;
+    std::string uri = "/users/1024/orders/A-77";
+    EXPECT_STREQ("orders", matched_path(router, uri, &params));
+    ASSERT_EQ(2u, params.size());
+    EXPECT_EQ("1024", capture(uri, params, "id"));
+    EXPECT_EQ("A-77", capture(uri, params, "oid"));
+
+    // {id:int}只接受数字
+    uri = "/users/abc/orders/A-77";
+    EXPECT_STREQ("", matched_path(router, uri, &params));
+
+    // {name}不跨越'/'
+    uri = "/users/tao";
+    EXPECT_STREQ("user", matched_path(router, uri, &params));
+    ASSERT_EQ(1u, params.size());
+    EXPECT_EQ("tao", capture(uri, params, "name"));
+    EXPECT_STREQ("", matched_path(router, "/users/tao/extra"));
+
+    // 参数至少一个字符
+    EXPECT_STREQ("", matched_path(router, "/users/"));
+}
+
+TEST(HttpRouterTest, PathParamsThroughParser) {
+
+    HttpRouter router;
+    ASSERT_TRUE(router.add("/items/{id:int}/{slug}", make_handler("item")));
+
+    PathParamContainer params;
+    std::string uri = "/items/42/hello-world";
+    ASSERT_STREQ("item", matched_path(router, uri, &params));
+
+    std::string request = "GET " + uri + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    HttpParser parser;
+    ASSERT_EQ(HttpParseStatus::kComplete, parser.parse_request_header(request.data(), request.size()));
+    ASSERT_TRUE(parser.parse_request_uri());
+    parser.set_request_path_params(params);
+
+    int64_t id = 0;
+    boost::string_ref slug;
+    EXPECT_TRUE(parser.get_request_path_param("id", id));
+    EXPECT_EQ(42, id);
+    EXPECT_TRUE(parser.get_request_path_param("slug", slug));
+    EXPECT_EQ("hello-world", slug.to_string());
+    EXPECT_FALSE(parser.get_request_path_param("slug", id));
+    EXPECT_FALSE(parser.get_request_path_param("missing", slug));
+}
+
+// 参数不能紧跟在另一个参数或者通配的'.'后面，否则切分有歧义
+TEST(HttpRouterTest, InvalidPatterns) {
+
+    HttpRouter router;
+    EXPECT_FALSE(router.add("/a/{x}{y}", make_handler("adjacent")));
+    EXPECT_FALSE(router.add("/a/{x:int}{y}", make_handler("adjacent_int")));
+    EXPECT_FALSE(router.add("/a/.{y}", make_handler("after_dot")));
+    EXPECT_FALSE(router.add("/a/{x:float}", make_handler("bad_type")));
+    EXPECT_TRUE(router.routes().empty());
+
+    // 失败的注册不影响已有的路由
+    ASSERT_TRUE(router.add("/a/{x}-{y}", make_handler("separated")));
+    EXPECT_FALSE(router.add("/b/{x}{y}", make_handler("adjacent")));
+    EXPECT_EQ(1u, router.routes().size());
+    EXPECT_STREQ("separated", matched_path(router, "/a/1-2"));
+}
+
+TEST(HttpRouterTest, RemoveAndUpdate) {
+
+    HttpRouter router;
+    ASSERT_TRUE(router.add("^/static/.*", make_handler("prefix")));
+    ASSERT_TRUE(router.add("^/static/app\\.js$", make_handler("exact")));
+
+    EXPECT_STREQ("prefix", matched_path(router, "/static/app.js"));
+    EXPECT_TRUE(router.update("^/static/.*", make_handler("prefix2")));
+    EXPECT_STREQ("prefix2", matched_path(router, "/static/app.js"));
+
+    EXPECT_TRUE(router.remove("^/static/.*"));
+    EXPECT_FALSE(router.remove("^/static/.*"));
+    EXPECT_STREQ("exact", matched_path(router, "/static/app.js"));
+    EXPECT_STREQ("", matched_path(router, "/static/app.css"));
+
+    EXPECT_TRUE(router.find("^/static/app\\.js$"));
+    EXPECT_FALSE(router.find("^/static/.*"));
+}
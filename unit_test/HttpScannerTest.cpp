@@ -0,0 +1,117 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../HttpScanner.h"
+
+#ifndef SCANNER_VARIANT
+#define SCANNER_VARIANT "native"
+#endif
+
+using namespace tzhttpd;
+
+// 当前机器不支持编译时选择的指令集的时候跳过
+static bool variant_supported() {
+#if defined(__AVX2__)
+    return __builtin_cpu_supports("avx2");
+#elif defined(__SSE4_2__)
+    return __builtin_cpu_supports("sse4.2");
+#else
+    return true;
+#endif
+}
+
+// 向量化的实现按照32/16字节分块，长度覆盖若干个完整块以及各种尾部，
+// 结果必须和逐字节的实现完全一致
+TEST(HttpScannerTest, ParityWithScalar) {
+
+    if (!variant_supported()) {
+        std::cout << "skip " << SCANNER_VARIANT << ": not supported by cpu" << std::endl;
+        return;
+    }
+
+    const char delims[] = { '\r', '\n', ':', ' ' };
+
+    for (size_t len = 0; len <= 100; ++len) {
+        // 多分配一些，确认不会越过end读到后面的分隔符
+        std::string buffer(len + 64, 'a');
+        for (size_t i = len; i < buffer.size(); ++i) {
+            buffer[i] = '\n';
+        }
+        const char* begin = buffer.data();
+        const char* end = begin + len;
+
+        for (size_t count = 1; count <= http_scanner::kMaxDelims; ++count) {
+            EXPECT_EQ(end, http_scanner::find_first_of(begin, end, delims, count))
+                << SCANNER_VARIANT << " len " << len << " count " << count;
+        }
+
+        for (size_t pos = 0; pos < len; ++pos) {
+            for (size_t d = 0; d < http_scanner::kMaxDelims; ++d) {
+                buffer[pos] = delims[d];
+                for (size_t count = 1; count <= http_scanner::kMaxDelims; ++count) {
+                    const char* expect = http_scanner::find_first_of_scalar(begin, end, delims, count);
+                    EXPECT_EQ(expect, http_scanner::find_first_of(begin, end, delims, count))
+                        << SCANNER_VARIANT << " len " << len << " pos " << pos << " count " << count;
+                }
+                buffer[pos] = 'a';
+            }
+        }
+    }
+}
+
+TEST(HttpScannerTest, FirstOfMultipleHits) {
+
+    if (!variant_supported()) {
+        return;
+    }
+
+    // 同一个块内和跨块的多个命中都应该返回最靠前的
+    std::string buffer(80, 'x');
+    buffer[70] = '\n';
+    buffer[40] = ':';
+    buffer[33] = '\r';
+    const char* begin = buffer.data();
+    const char* end = begin + buffer.size();
+    const char delims[] = { '\n', ':', '\r' };
+
+    EXPECT_EQ(begin + 33, http_scanner::find_first_of(begin, end, delims, 3));
+    EXPECT_EQ(begin + 40, http_scanner::find_first_of(begin + 34, end, delims, 3));
+    EXPECT_EQ(begin + 70, http_scanner::find_char(begin, end, '\n'));
+    EXPECT_EQ(begin + 69, http_scanner::find_char(begin + 41, begin + 69, '\n'));
+}
+
+TEST(HttpScannerTest, HighBitBytes) {
+
+    if (!variant_supported()) {
+        return;
+    }
+
+    // 按照无符号字节比较，非ASCII的数据不能误判
+    std::string buffer(64, '\xff');
+    buffer[50] = '\x80';
+    const char* begin = buffer.data();
+    const char* end = begin + buffer.size();
+
+    EXPECT_EQ(begin + 50, http_scanner::find_char(begin, end, '\x80'));
+    EXPECT_EQ(end, http_scanner::find_char(begin, end, '\x7f'));
+}
+
+TEST(HttpScannerTest, InvalidDelimCount) {
+
+    std::string buffer("abc:def");
+    const char* begin = buffer.data();
+    const char* end = begin + buffer.size();
+    const char delims[] = { ':', ':', ':', ':', ':' };
+
+    EXPECT_EQ(end, http_scanner::find_first_of(begin, end, delims, 0));
+    EXPECT_EQ(end, http_scanner::find_first_of(begin, end, delims, http_scanner::kMaxDelims + 1));
+}
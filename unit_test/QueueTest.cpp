@@ -0,0 +1,203 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <sched.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+
+#include <gtest/gtest.h>
+
+#include "../MpmcQueue.h"
+#include "../WorkStealingQueue.h"
+
+using namespace tzhttpd;
+
+static const size_t kProducers = 4;
+static const size_t kConsumers = 4;
+static const size_t kItemsPerProducer = 100000;
+static const size_t kTotalItems = kProducers * kItemsPerProducer;
+
+// 每个元素必须恰好被取出一次
+struct Checker {
+
+    Checker() :
+        seen_(new std::atomic<uint8_t>[kTotalItems]),
+        consumed_(0),
+        duplicated_(0) {
+        for (size_t i = 0; i < kTotalItems; ++i) {
+            seen_[i].store(0);
+        }
+    }
+
+    void consume(size_t item) {
+        if (item >= kTotalItems || seen_[item].fetch_add(1) != 0) {
+            duplicated_.fetch_add(1);
+        }
+        consumed_.fetch_add(1);
+    }
+
+    bool done() const {
+        return consumed_.load() >= kTotalItems;
+    }
+
+    size_t missing() const {
+        size_t count = 0;
+        for (size_t i = 0; i < kTotalItems; ++i) {
+            if (seen_[i].load() == 0) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    std::unique_ptr<std::atomic<uint8_t>[]> seen_;
+    std::atomic<size_t> consumed_;
+    std::atomic<size_t> duplicated_;
+};
+
+// 容量远小于元素总数，生产者会不断碰到队列满的情况
+static void mpmc_producer(MpmcQueue<size_t>* queue, size_t id) {
+    for (size_t i = 0; i < kItemsPerProducer; ++i) {
+        size_t item = id * kItemsPerProducer + i;
+        while (!queue->PUSH(item)) {
+            ::sched_yield();
+        }
+    }
+}
+
+static void mpmc_consumer(MpmcQueue<size_t>* queue, Checker* checker) {
+    size_t item = 0;
+    while (!checker->done()) {
+        if (queue->POP(item, 10)) {
+            checker->consume(item);
+        }
+    }
+}
+
+TEST(QueueTest, MpmcCapacity) {
+
+    // 容量向上取整为2的幂
+    MpmcQueue<size_t> queue(100);
+    EXPECT_EQ(128u, queue.capacity());
+
+    for (size_t i = 0; i < queue.capacity(); ++i) {
+        EXPECT_TRUE(queue.try_push(i));
+    }
+    EXPECT_FALSE(queue.try_push(0));
+    EXPECT_EQ(queue.capacity(), queue.SIZE());
+
+    size_t item = 0;
+    for (size_t i = 0; i < queue.capacity(); ++i) {
+        ASSERT_TRUE(queue.try_pop(item));
+        EXPECT_EQ(i, item);
+    }
+    EXPECT_FALSE(queue.try_pop(item));
+    EXPECT_TRUE(queue.EMPTY());
+    EXPECT_FALSE(queue.POP(item, 1));
+}
+
+TEST(QueueTest, MpmcContention) {
+
+    MpmcQueue<size_t> queue(256);
+    Checker checker;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < kConsumers; ++i) {
+        threads.push_back(std::thread(std::bind(mpmc_consumer, &queue, &checker)));
+    }
+    for (size_t i = 0; i < kProducers; ++i) {
+        threads.push_back(std::thread(std::bind(mpmc_producer, &queue, i)));
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    EXPECT_EQ(kTotalItems, checker.consumed_.load());
+    EXPECT_EQ(0u, checker.duplicated_.load());
+    EXPECT_EQ(0u, checker.missing());
+    EXPECT_TRUE(queue.EMPTY());
+}
+
+static void ws_producer(WorkStealingQueue<size_t>* queue, size_t id) {
+    for (size_t i = 0; i < kItemsPerProducer; ++i) {
+        size_t item = id * kItemsPerProducer + i;
+        while (!queue->PUSH(item)) {
+            ::sched_yield();
+        }
+    }
+}
+
+static void ws_consumer(WorkStealingQueue<size_t>* queue, Checker* checker) {
+
+    size_t self = queue->acquire_slot();
+    size_t item = 0;
+    while (!checker->done()) {
+        if (queue->POP(self, item, 10)) {
+            checker->consume(item);
+        }
+    }
+    queue->release_slot(self);
+}
+
+TEST(QueueTest, WorkStealingSlots) {
+
+    WorkStealingQueue<size_t> queue(2, 16);
+    EXPECT_EQ(2u, queue.slot_count());
+    EXPECT_EQ(32u, queue.capacity());
+
+    size_t first = queue.acquire_slot();
+    size_t second = queue.acquire_slot();
+    EXPECT_NE(first, second);
+    size_t no_slot = WorkStealingQueue<size_t>::kNoSlot;
+    EXPECT_EQ(no_slot, queue.acquire_slot());
+
+    // 所有槽位都满了才返回false
+    for (size_t i = 0; i < queue.capacity(); ++i) {
+        EXPECT_TRUE(queue.PUSH(i));
+    }
+    EXPECT_FALSE(queue.PUSH(0));
+    EXPECT_EQ(queue.capacity(), queue.SIZE());
+
+    // 自己的槽位空了之后从其他槽位窃取
+    size_t item = 0;
+    size_t count = 0;
+    while (queue.try_pop(first, item)) {
+        ++count;
+    }
+    EXPECT_EQ(queue.capacity(), count);
+    EXPECT_FALSE(queue.POP(second, item, 1));
+
+    queue.release_slot(first);
+    EXPECT_EQ(first, queue.acquire_slot());
+}
+
+// 消费者比槽位多，有的消费者没有槽位，只能窃取
+TEST(QueueTest, WorkStealingContention) {
+
+    WorkStealingQueue<size_t> queue(kConsumers - 1, 64);
+    Checker checker;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < kConsumers; ++i) {
+        threads.push_back(std::thread(std::bind(ws_consumer, &queue, &checker)));
+    }
+    for (size_t i = 0; i < kProducers; ++i) {
+        threads.push_back(std::thread(std::bind(ws_producer, &queue, i)));
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    EXPECT_EQ(kTotalItems, checker.consumed_.load());
+    EXPECT_EQ(0u, checker.duplicated_.load());
+    EXPECT_EQ(0u, checker.missing());
+    EXPECT_EQ(0u, queue.SIZE());
+}
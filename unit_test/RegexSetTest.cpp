@@ -0,0 +1,95 @@
+/*-
+ * Copyright (c) 2018-2019 TAO Zhijiang<taozhijiang@gmail.com>
+ *
+ * Licensed under the BSD-3-Clause license, see LICENSE for full information.
+ *
+ */
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../RegexSet.h"
+
+using namespace tzhttpd;
+
+TEST(RegexSetTest, LowestIndexWins) {
+
+    std::vector<std::string> patterns;
+    patterns.push_back("^/api/(v[0-9]+)/users$");
+    patterns.push_back("^/api/.*");
+    patterns.push_back("^/api/v1/users$");
+    patterns.push_back("^/(a|b)(c|d)/x$");
+    patterns.push_back("^/.*");
+
+    RegexSet regex_set;
+    ASSERT_TRUE(regex_set.assign(patterns));
+    EXPECT_EQ(patterns.size(), regex_set.size());
+
+    EXPECT_EQ(0, regex_set.match("/api/v1/users"));
+    EXPECT_EQ(1, regex_set.match("/api/v1/orders"));
+    // 前面分支的捕获组不影响后面分支下标的计算
+    EXPECT_EQ(3, regex_set.match("/bd/x"));
+    EXPECT_EQ(4, regex_set.match("/other"));
+    EXPECT_EQ(-1, regex_set.match("no-slash"));
+}
+
+// 要求整体匹配，前缀能够匹配的分支不能抢占后面整体匹配的分支
+TEST(RegexSetTest, FullMatchOnly) {
+
+    std::vector<std::string> patterns;
+    patterns.push_back("/abc");
+    patterns.push_back("/abc/def");
+
+    RegexSet regex_set;
+    ASSERT_TRUE(regex_set.assign(patterns));
+    EXPECT_EQ(0, regex_set.match("/abc"));
+    EXPECT_EQ(1, regex_set.match("/abc/def"));
+    EXPECT_EQ(-1, regex_set.match("/abc/de"));
+}
+
+// 反向引用的组号在合并之后会错乱，退化成逐个匹配，结果必须不变
+TEST(RegexSetTest, BackReferenceFallback) {
+
+    std::vector<std::string> patterns;
+    patterns.push_back("^/(x)(y)/z$");
+    patterns.push_back("^/([a-z]+)/\\1$");
+    patterns.push_back("^/([a-z]+)/.*");
+
+    RegexSet regex_set;
+    ASSERT_TRUE(regex_set.assign(patterns));
+
+    EXPECT_EQ(0, regex_set.match("/xy/z"));
+    EXPECT_EQ(1, regex_set.match("/abc/abc"));
+    EXPECT_EQ(2, regex_set.match("/abc/abd"));
+    EXPECT_EQ(-1, regex_set.match("/123/123"));
+}
+
+TEST(RegexSetTest, InvalidPatternKeepsOld) {
+
+    std::vector<std::string> patterns;
+    patterns.push_back("^/ok$");
+
+    RegexSet regex_set;
+    ASSERT_TRUE(regex_set.assign(patterns));
+
+    std::vector<std::string> invalid;
+    invalid.push_back("^/good$");
+    invalid.push_back("^/(unclosed$");
+    EXPECT_FALSE(regex_set.assign(invalid));
+
+    EXPECT_EQ(1u, regex_set.size());
+    EXPECT_EQ(0, regex_set.match("/ok"));
+    EXPECT_EQ(-1, regex_set.match("/good"));
+}
+
+TEST(RegexSetTest, Empty) {
+
+    RegexSet regex_set;
+    EXPECT_TRUE(regex_set.empty());
+    EXPECT_EQ(-1, regex_set.match("/anything"));
+
+    ASSERT_TRUE(regex_set.assign(std::vector<std::string>()));
+    EXPECT_EQ(-1, regex_set.match("/anything"));
+}